@@ -0,0 +1,82 @@
+#include "AdmissionController.h"
+
+#include <algorithm>
+#include <string>
+
+AdmissionController::Ticket& AdmissionController::Ticket::operator=(Ticket&& o) noexcept {
+    if (this != &o) {
+        release();
+        owner_ = std::move(o.owner_);
+        addr_ = std::move(o.addr_);
+    }
+    return *this;
+}
+
+void AdmissionController::Ticket::release() {
+    if (!owner_) return;
+    auto owner = std::move(owner_);
+    owner->release(addr_);
+}
+
+AdmissionController::AdmissionController(AdmissionConfig config)
+    : config_(config)
+    , tokens_(config.accept_burst)
+    , refilled_(std::chrono::steady_clock::now())
+    , active_gauge_(Metrics::instance().gauge("ws_connections_active"))
+    , rejected_global_(Metrics::instance().counter("ws_connections_rejected_total", "reason=\"global_limit\""))
+    , rejected_per_ip_(Metrics::instance().counter("ws_connections_rejected_total", "reason=\"per_ip_limit\""))
+    , rejected_rate_(Metrics::instance().counter("ws_connections_rejected_total", "reason=\"rate_limit\""))
+{
+}
+
+AdmissionController::Ticket AdmissionController::admit(const boost::asio::ip::address& addr, Verdict& verdict) {
+    const auto now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        const double elapsed = std::chrono::duration<double>(now - refilled_).count();
+        tokens_ = std::min(config_.accept_burst, tokens_ + elapsed * config_.accept_rate);
+        refilled_ = now;
+
+        if (tokens_ < 1.0) {
+            verdict = Verdict::kRateLimit;
+        }
+        else if (active_ >= config_.max_connections) {
+            verdict = Verdict::kGlobalLimit;
+        }
+        else {
+            auto& count = per_ip_[addr];
+            if (count >= config_.max_per_ip) {
+                verdict = Verdict::kPerIpLimit;
+            }
+            else {
+                ++count;
+                ++active_;
+                tokens_ -= 1.0;
+                verdict = Verdict::kAdmitted;
+                active_gauge_.set(static_cast<double>(active_));
+                return Ticket(shared_from_this(), addr);
+            }
+        }
+    }
+
+    switch (verdict) {
+    case Verdict::kRateLimit: rejected_rate_.inc(); break;
+    case Verdict::kGlobalLimit: rejected_global_.inc(); break;
+    case Verdict::kPerIpLimit: rejected_per_ip_.inc(); break;
+    default: break;
+    }
+    return Ticket();
+}
+
+void AdmissionController::release(const boost::asio::ip::address& addr) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = per_ip_.find(addr);
+    if (it != per_ip_.end() && --it->second == 0) per_ip_.erase(it);
+    if (active_ > 0) --active_;
+    active_gauge_.set(static_cast<double>(active_));
+}
+
+void AdmissionController::countRejection(const char* reason) {
+    Metrics::instance().counter("ws_connections_rejected_total", std::string("reason=\"") + reason + "\"").inc();
+}
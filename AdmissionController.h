@@ -0,0 +1,76 @@
+#pragma once
+
+#include <boost/asio/ip/address.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "Metrics.h"
+
+struct AdmissionConfig {
+    std::size_t max_connections = 4096;  // open WebSocket connections, handshaking included
+    std::size_t max_per_ip = 32;
+    double accept_rate = 200.0;          // new connections per second, token bucket
+    double accept_burst = 400.0;
+    int handshake_timeout_ms = 5000;     // upgrade request plus WebSocket handshake
+    int accept_backoff_ms = 100;         // pause after EMFILE/ENFILE instead of spinning
+};
+
+// Decides whether a freshly accepted socket may proceed, before anything is
+// read from it or allocated for it. Shared by every Listener.
+class AdmissionController : public std::enable_shared_from_this<AdmissionController> {
+public:
+    enum class Verdict { kAdmitted, kGlobalLimit, kPerIpLimit, kRateLimit };
+
+    // Held for the life of the connection; releases its slot on destruction.
+    class Ticket {
+    public:
+        Ticket() = default;
+        Ticket(Ticket&& o) noexcept = default;
+        Ticket& operator=(Ticket&& o) noexcept;
+        Ticket(const Ticket&) = delete;
+        Ticket& operator=(const Ticket&) = delete;
+        ~Ticket() { release(); }
+
+        explicit operator bool() const { return owner_ != nullptr; }
+
+    private:
+        friend class AdmissionController;
+        Ticket(std::shared_ptr<AdmissionController> owner, boost::asio::ip::address addr)
+            : owner_(std::move(owner)), addr_(std::move(addr)) {
+        }
+        void release();
+
+        std::shared_ptr<AdmissionController> owner_;
+        boost::asio::ip::address addr_;
+    };
+
+    explicit AdmissionController(AdmissionConfig config = AdmissionConfig());
+
+    const AdmissionConfig& config() const { return config_; }
+
+    // An empty ticket means rejected; `verdict` says why.
+    Ticket admit(const boost::asio::ip::address& addr, Verdict& verdict);
+
+    // For rejections decided outside admit(): "handshake_timeout", "bad_request", ...
+    static void countRejection(const char* reason);
+
+private:
+    void release(const boost::asio::ip::address& addr);
+
+    const AdmissionConfig config_;
+
+    std::mutex mutex_;
+    std::size_t active_ = 0;
+    std::map<boost::asio::ip::address, std::size_t> per_ip_;
+    double tokens_;
+    std::chrono::steady_clock::time_point refilled_;
+
+    Metrics::Gauge& active_gauge_;
+    Metrics::Counter& rejected_global_;
+    Metrics::Counter& rejected_per_ip_;
+    Metrics::Counter& rejected_rate_;
+};
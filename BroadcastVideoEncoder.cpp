@@ -0,0 +1,413 @@
+#include "BroadcastVideoEncoder.h"
+
+#include <api/units/time_delta.h>
+#include <api/video/encoded_image.h>
+#include <api/video/video_timing.h>
+#include <api/video/video_frame.h>
+#include <modules/video_coding/include/video_codec_interface.h>
+#include <modules/video_coding/include/video_error_codes.h>
+#include <rtc_base/time_utils.h>
+
+#include <algorithm>
+#include <iostream>
+
+namespace {
+
+    // Viewers asking for a keyframe within this window share one.
+    constexpr int64_t kKeyframeCoalesceMs = 300;
+
+    // Assumed until two frames have been encoded; gaps above the maximum
+    // (a pause, a stray frame of an old timeline) are not an interval.
+    constexpr int64_t kDefaultFrameIntervalUs = 1000000 / 30;
+    constexpr int64_t kMaxFrameIntervalUs = 1000000;
+    // A frame further behind than this many intervals starts a new timeline
+    // (a restarted source counts from 0 again) rather than arriving late.
+    constexpr int64_t kRestartIntervals = 2;
+
+}
+
+class BroadcastEncoderHub::Group : public webrtc::EncodedImageCallback {
+public:
+    Group(BroadcastEncoderHub* hub, std::unique_ptr<webrtc::VideoEncoder> encoder)
+        : hub_(hub), encoder_(std::move(encoder)) {
+    }
+
+    ~Group() override {
+        if (encoder_) encoder_->Release();
+    }
+
+    int32_t init(const webrtc::VideoCodec& codec, const webrtc::VideoEncoder::Settings& settings) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const int32_t rc = encoder_->InitEncode(&codec, settings);
+        if (rc == WEBRTC_VIDEO_CODEC_OK) encoder_->RegisterEncodeCompleteCallback(this);
+        return rc;
+    }
+
+    void addMember(const void* member) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        members_[member];
+        keyframe_pending_ = true;
+    }
+
+    std::size_t removeMember(const void* member) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        members_.erase(member);
+        applyRatesLocked();
+        return members_.size();
+    }
+
+    std::size_t memberCount() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return members_.size();
+    }
+
+    void setCallback(const void* member, webrtc::EncodedImageCallback* callback) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = members_.find(member);
+        if (it != members_.end()) it->second.callback = callback;
+    }
+
+    int32_t encode(const webrtc::VideoFrame& frame,
+        const std::vector<webrtc::VideoFrameType>* frame_types) {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (frame_types) {
+            for (auto t : *frame_types) {
+                if (t == webrtc::VideoFrameType::kVideoFrameKey) {
+                    keyframe_pending_ = true;
+                    hub_->keyframe_requests_++;
+                    break;
+                }
+            }
+        }
+
+        // Every member is fed the same source frame; only the first caller
+        // encodes it, the others already received the output via fan-out.
+        // Members sit on different encoder queues, so a slow one can still
+        // hand over a frame the group has already moved past: encoding it
+        // would send every member an older frame after a newer one.
+        if (frame.timestamp_us() == last_timestamp_us_) {
+            hub_->frames_deduplicated_++;
+            return WEBRTC_VIDEO_CODEC_OK;
+        }
+        bool restarted = false;
+        if (frame.timestamp_us() < last_timestamp_us_) {
+            if (last_timestamp_us_ - frame.timestamp_us() <= kRestartIntervals * frame_interval_us_) {
+                hub_->frames_late_++;
+                return WEBRTC_VIDEO_CODEC_OK;
+            }
+            restarted = true;
+            hub_->timeline_restarts_++;
+        }
+        else if (last_timestamp_us_ >= 0 && frame.timestamp_us() - last_timestamp_us_ <= kMaxFrameIntervalUs) {
+            frame_interval_us_ = frame.timestamp_us() - last_timestamp_us_;
+        }
+        last_timestamp_us_ = frame.timestamp_us();
+
+        const int64_t now_ms = webrtc::TimeMillis();
+        bool key = false;
+        if (restarted || (keyframe_pending_ && now_ms - last_keyframe_ms_ >= kKeyframeCoalesceMs)) {
+            key = true;
+            keyframe_pending_ = false;
+            last_keyframe_ms_ = now_ms;
+            hub_->keyframes_forced_++;
+        }
+
+        std::vector<webrtc::VideoFrameType> types{
+            key ? webrtc::VideoFrameType::kVideoFrameKey : webrtc::VideoFrameType::kVideoFrameDelta };
+
+        hub_->frames_encoded_++;
+        return encoder_->Encode(frame, &types);
+    }
+
+    void setRates(const void* member, const webrtc::VideoEncoder::RateControlParameters& params) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = members_.find(member);
+        if (it == members_.end()) return;
+        it->second.rates = params;
+        it->second.has_rates = true;
+        applyRatesLocked();
+    }
+
+    webrtc::VideoEncoder::EncoderInfo info() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return encoder_->GetEncoderInfo();
+    }
+
+    void onPacketLossRateUpdate(float loss) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        encoder_->OnPacketLossRateUpdate(loss);
+    }
+
+    void onRttUpdate(int64_t rtt_ms) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        encoder_->OnRttUpdate(rtt_ms);
+    }
+
+    // Called synchronously from encoder_->Encode(), i.e. with mutex_ held.
+    Result OnEncodedImage(const webrtc::EncodedImage& image,
+        const webrtc::CodecSpecificInfo* info) override {
+        int min_ms = 0;
+        int max_ms = 0;
+        const webrtc::EncodedImage* out = &image;
+        webrtc::EncodedImage stamped;
+        if (hub_->playoutDelay(min_ms, max_ms)) {
+            // Copies only the descriptor; the payload buffer is ref-counted.
+            stamped = image;
+            stamped.SetPlayoutDelay(webrtc::VideoPlayoutDelay(
+                webrtc::TimeDelta::Millis(min_ms), webrtc::TimeDelta::Millis(max_ms)));
+            out = &stamped;
+        }
+
+        for (auto& [member, state] : members_) {
+            (void)member;
+            if (!state.callback) continue;
+            state.callback->OnEncodedImage(*out, info);
+            hub_->frames_fanned_out_++;
+        }
+        return Result(Result::OK, image.RtpTimestamp());
+    }
+
+    void OnDroppedFrame(DropReason reason) override {
+        for (auto& [member, state] : members_) {
+            (void)member;
+            if (state.callback) state.callback->OnDroppedFrame(reason);
+        }
+    }
+
+private:
+    struct MemberState {
+        webrtc::EncodedImageCallback* callback = nullptr;
+        webrtc::VideoEncoder::RateControlParameters rates;
+        bool has_rates = false;
+    };
+
+    // The shared encoder runs at the rate of the weakest member of its tier.
+    void applyRatesLocked() {
+        const MemberState* weakest = nullptr;
+        for (const auto& [member, state] : members_) {
+            (void)member;
+            if (!state.has_rates) continue;
+            if (!weakest || state.rates.bitrate.get_sum_bps() < weakest->rates.bitrate.get_sum_bps()) {
+                weakest = &state;
+            }
+        }
+        if (weakest) encoder_->SetRates(weakest->rates);
+    }
+
+    BroadcastEncoderHub* hub_;
+    std::unique_ptr<webrtc::VideoEncoder> encoder_;
+
+    mutable std::mutex mutex_;
+    std::map<const void*, MemberState> members_;
+    int64_t last_timestamp_us_ = -1;
+    int64_t frame_interval_us_ = kDefaultFrameIntervalUs;
+    bool keyframe_pending_ = true;
+    int64_t last_keyframe_ms_ = -kKeyframeCoalesceMs;
+};
+
+namespace {
+
+    class BroadcastVideoEncoder : public webrtc::VideoEncoder {
+    public:
+        BroadcastVideoEncoder(std::shared_ptr<BroadcastEncoderHub> hub,
+            const webrtc::Environment& env,
+            webrtc::SdpVideoFormat format)
+            : hub_(std::move(hub)), env_(env), format_(std::move(format)) {
+        }
+
+        ~BroadcastVideoEncoder() override {
+            Release();
+        }
+
+        int InitEncode(const webrtc::VideoCodec* codec_settings,
+            const webrtc::VideoEncoder::Settings& settings) override {
+            if (!codec_settings) return WEBRTC_VIDEO_CODEC_ERR_PARAMETER;
+
+            Release();
+
+            group_ = hub_->acquire(env_, format_, *codec_settings, settings, this);
+            if (!group_) return WEBRTC_VIDEO_CODEC_ERROR;
+
+            if (callback_) group_->setCallback(this, callback_);
+            return WEBRTC_VIDEO_CODEC_OK;
+        }
+
+        int32_t RegisterEncodeCompleteCallback(webrtc::EncodedImageCallback* callback) override {
+            callback_ = callback;
+            if (group_) group_->setCallback(this, callback);
+            return WEBRTC_VIDEO_CODEC_OK;
+        }
+
+        int32_t Release() override {
+            if (group_) {
+                hub_->release(group_, this);
+                group_.reset();
+            }
+            return WEBRTC_VIDEO_CODEC_OK;
+        }
+
+        int32_t Encode(const webrtc::VideoFrame& frame,
+            const std::vector<webrtc::VideoFrameType>* frame_types) override {
+            if (!group_) return WEBRTC_VIDEO_CODEC_UNINITIALIZED;
+            return group_->encode(frame, frame_types);
+        }
+
+        void SetRates(const RateControlParameters& parameters) override {
+            if (group_) group_->setRates(this, parameters);
+        }
+
+        void OnPacketLossRateUpdate(float packet_loss_rate) override {
+            if (group_) group_->onPacketLossRateUpdate(packet_loss_rate);
+        }
+
+        void OnRttUpdate(int64_t rtt_ms) override {
+            if (group_) group_->onRttUpdate(rtt_ms);
+        }
+
+        EncoderInfo GetEncoderInfo() const override {
+            EncoderInfo info = group_ ? group_->info() : EncoderInfo();
+            if (hub_->shared()) {
+                // Resolution is a property of the group; a per-viewer quality
+                // scaler would only split viewers into more groups.
+                info.scaling_settings = ScalingSettings(ScalingSettings::kOff);
+                info.implementation_name = "Broadcast(" + info.implementation_name + ")";
+            }
+            return info;
+        }
+
+    private:
+        std::shared_ptr<BroadcastEncoderHub> hub_;
+        webrtc::Environment env_;
+        webrtc::SdpVideoFormat format_;
+        std::shared_ptr<BroadcastEncoderHub::Group> group_;
+        webrtc::EncodedImageCallback* callback_ = nullptr;
+    };
+
+}
+
+BroadcastEncoderHub::BroadcastEncoderHub(std::unique_ptr<webrtc::VideoEncoderFactory> factory, bool shared)
+    : factory_(std::move(factory)), shared_(shared) {
+}
+
+int BroadcastEncoderHub::bitrateTier(unsigned max_bitrate_kbps) {
+    if (max_bitrate_kbps == 0) return 0;
+    if (max_bitrate_kbps <= 300) return 1;
+    if (max_bitrate_kbps <= 1000) return 2;
+    if (max_bitrate_kbps <= 2500) return 3;
+    return 4;
+}
+
+std::shared_ptr<BroadcastEncoderHub::Group> BroadcastEncoderHub::acquire(const webrtc::Environment& env,
+    const webrtc::SdpVideoFormat& format,
+    const webrtc::VideoCodec& codec,
+    const webrtc::VideoEncoder::Settings& settings,
+    const void* member) {
+    GroupKey key{ format.ToString(), codec.width, codec.height, bitrateTier(codec.maxBitrate),
+        shared_ ? nullptr : member };
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = groups_.find(key);
+    if (it != groups_.end()) {
+        it->second->addMember(member);
+        return it->second;
+    }
+
+    auto encoder = factory_->Create(env, format);
+    if (!encoder) {
+        std::cerr << "[ENC] Failed to create encoder for " << format.ToString() << std::endl;
+        return nullptr;
+    }
+
+    webrtc::VideoCodec tuned = codec;
+    tuned.SetVideoEncoderComplexity(complexity_.load());
+
+    auto group = std::make_shared<Group>(this, std::move(encoder));
+    if (group->init(tuned, settings) != WEBRTC_VIDEO_CODEC_OK) {
+        std::cerr << "[ENC] InitEncode failed for " << format.ToString() << " "
+            << codec.width << "x" << codec.height << std::endl;
+        return nullptr;
+    }
+
+    group->addMember(member);
+    groups_.emplace(key, group);
+
+    if (shared_) {
+        std::cout << "[ENC] Broadcast group created: " << format.name << " "
+            << codec.width << "x" << codec.height << " tier " << bitrateTier(codec.maxBitrate)
+            << " (groups: " << groups_.size() << ")" << std::endl;
+    }
+    return group;
+}
+
+void BroadcastEncoderHub::release(const std::shared_ptr<Group>& group, const void* member) {
+    if (!group) return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (group->removeMember(member) > 0) return;
+
+    for (auto it = groups_.begin(); it != groups_.end(); ++it) {
+        if (it->second == group) {
+            groups_.erase(it);
+            break;
+        }
+    }
+}
+
+void BroadcastEncoderHub::setPlayoutDelay(int min_ms, int max_ms) {
+    // Order matters for the lock-free reader: never expose max < min.
+    if (min_ms < 0) {
+        playout_min_ms_ = -1;
+        playout_max_ms_ = -1;
+        return;
+    }
+    playout_min_ms_ = -1;
+    playout_max_ms_ = max_ms;
+    playout_min_ms_ = min_ms;
+}
+
+bool BroadcastEncoderHub::playoutDelay(int& min_ms, int& max_ms) const {
+    min_ms = playout_min_ms_.load();
+    max_ms = playout_max_ms_.load();
+    return min_ms >= 0 && max_ms >= min_ms;
+}
+
+BroadcastEncoderHub::Stats BroadcastEncoderHub::stats() const {
+    Stats st;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        st.groups = static_cast<int>(groups_.size());
+        for (const auto& [key, group] : groups_) {
+            (void)key;
+            st.members += static_cast<int>(group->memberCount());
+        }
+    }
+    st.frames_encoded = frames_encoded_.load();
+    st.frames_deduplicated = frames_deduplicated_.load();
+    st.frames_late = frames_late_.load();
+    st.timeline_restarts = timeline_restarts_.load();
+    st.frames_fanned_out = frames_fanned_out_.load();
+    st.keyframe_requests = keyframe_requests_.load();
+    st.keyframes_forced = keyframes_forced_.load();
+    return st;
+}
+
+BroadcastVideoEncoderFactory::BroadcastVideoEncoderFactory(std::shared_ptr<BroadcastEncoderHub> hub)
+    : hub_(std::move(hub)) {
+}
+
+std::vector<webrtc::SdpVideoFormat> BroadcastVideoEncoderFactory::GetSupportedFormats() const {
+    return hub_->realFactory().GetSupportedFormats();
+}
+
+webrtc::VideoEncoderFactory::CodecSupport BroadcastVideoEncoderFactory::QueryCodecSupport(
+    const webrtc::SdpVideoFormat& format,
+    std::optional<std::string> scalability_mode) const {
+    return hub_->realFactory().QueryCodecSupport(format, std::move(scalability_mode));
+}
+
+std::unique_ptr<webrtc::VideoEncoder> BroadcastVideoEncoderFactory::Create(const webrtc::Environment& env,
+    const webrtc::SdpVideoFormat& format) {
+    return std::make_unique<BroadcastVideoEncoder>(hub_, env, format);
+}
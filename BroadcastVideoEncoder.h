@@ -0,0 +1,100 @@
+#pragma once
+
+#include <api/environment/environment.h>
+#include <api/video_codecs/sdp_video_format.h>
+#include <api/video_codecs/video_codec.h>
+#include <api/video_codecs/video_encoder.h>
+#include <api/video_codecs/video_encoder_factory.h>
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// Owns the real encoder factory and hands out encode groups. In shared mode
+// every proxy encoder with the same (codec, resolution, bitrate tier) joins a
+// single group: one real encoder, encoded frames fanned out to all members.
+class BroadcastEncoderHub {
+public:
+    struct Stats {
+        int groups = 0;
+        int members = 0;
+        uint64_t frames_encoded = 0;
+        uint64_t frames_deduplicated = 0;
+        uint64_t frames_late = 0;
+        uint64_t timeline_restarts = 0;
+        uint64_t frames_fanned_out = 0;
+        uint64_t keyframe_requests = 0;
+        uint64_t keyframes_forced = 0;
+    };
+
+    class Group;
+
+    BroadcastEncoderHub(std::unique_ptr<webrtc::VideoEncoderFactory> factory, bool shared);
+
+    bool shared() const { return shared_; }
+    const webrtc::VideoEncoderFactory& realFactory() const { return *factory_; }
+
+    std::shared_ptr<Group> acquire(const webrtc::Environment& env,
+        const webrtc::SdpVideoFormat& format,
+        const webrtc::VideoCodec& codec,
+        const webrtc::VideoEncoder::Settings& settings,
+        const void* member);
+    void release(const std::shared_ptr<Group>& group, const void* member);
+
+    Stats stats() const;
+
+    // Applied to encoders initialised from now on; existing groups keep theirs
+    // until their members re-init (e.g. on a resolution change).
+    void setComplexity(webrtc::VideoCodecComplexity complexity) { complexity_ = complexity; }
+    webrtc::VideoCodecComplexity complexity() const { return complexity_.load(); }
+
+    // Playout-delay extension bounds stamped on every frame handed to the
+    // senders; a negative min clears them.
+    void setPlayoutDelay(int min_ms, int max_ms);
+    // The bounds to stamp right now; false when there are none.
+    bool playoutDelay(int& min_ms, int& max_ms) const;
+
+    static int bitrateTier(unsigned max_bitrate_kbps);
+
+private:
+    friend class Group;
+
+    using GroupKey = std::tuple<std::string, int, int, int, const void*>;
+
+    std::unique_ptr<webrtc::VideoEncoderFactory> factory_;
+    const bool shared_;
+
+    mutable std::mutex mutex_;
+    std::map<GroupKey, std::shared_ptr<Group>> groups_;
+
+    std::atomic<uint64_t> frames_encoded_{ 0 };
+    std::atomic<uint64_t> frames_deduplicated_{ 0 };
+    std::atomic<uint64_t> frames_late_{ 0 };
+    std::atomic<uint64_t> timeline_restarts_{ 0 };
+    std::atomic<uint64_t> frames_fanned_out_{ 0 };
+    std::atomic<uint64_t> keyframe_requests_{ 0 };
+    std::atomic<uint64_t> keyframes_forced_{ 0 };
+    std::atomic<webrtc::VideoCodecComplexity> complexity_{ webrtc::VideoCodecComplexity::kComplexityNormal };
+    std::atomic<int> playout_min_ms_{ -1 };
+    std::atomic<int> playout_max_ms_{ -1 };
+};
+
+class BroadcastVideoEncoderFactory : public webrtc::VideoEncoderFactory {
+public:
+    explicit BroadcastVideoEncoderFactory(std::shared_ptr<BroadcastEncoderHub> hub);
+
+    std::vector<webrtc::SdpVideoFormat> GetSupportedFormats() const override;
+    CodecSupport QueryCodecSupport(const webrtc::SdpVideoFormat& format,
+        std::optional<std::string> scalability_mode) const override;
+    std::unique_ptr<webrtc::VideoEncoder> Create(const webrtc::Environment& env,
+        const webrtc::SdpVideoFormat& format) override;
+
+private:
+    std::shared_ptr<BroadcastEncoderHub> hub_;
+};
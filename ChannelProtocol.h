@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Binary frames exchanged over the RTC data channels. Every frame starts with
+// a one-byte type; all multi-byte fields are little-endian. web/client.js
+// mirrors these layouts.
+
+enum class ChannelFrameType : uint8_t {
+    kSync = 1,
+    kPing = 2, // viewer -> server
+    kPong = 3, // server -> viewer
+    kTelemetry = 4, // viewer -> server
+};
+
+// [0] type  [1] flags (bit0 = playing)  [2..3] room playout target u16 (ms, 0 = none)
+// [4..7] seq u32  [8..15] media time f64 (s)  [16..23] server wall clock i64 (us since epoch)
+struct SyncFrame {
+    uint32_t seq = 0;
+    double media_time = 0.0;
+    int64_t wallclock_us = 0;
+    bool playing = false;
+    uint16_t playout_target_ms = 0;
+};
+
+constexpr std::size_t kSyncFrameSize = 24;
+
+// NTP-style clock exchange. The viewer stamps t0 on its own clock; the server
+// echoes it with t1 (receive) and t2 (send) on its wall clock, and the viewer
+// takes t3 on arrival. Each ping also carries the viewer's current estimate
+// so the server can report per-viewer sync error without a second channel.
+//
+// ping: [0] type  [1..3] reserved  [4..7] seq u32  [8..15] t0 i64 (us)
+//       [16..23] offset estimate i64 (us, server - viewer)  [24..27] rtt estimate u32 (us)
+//       [28..31] render delay u32 (us, jitter buffer + decode as seen by the viewer, 0 = unknown)
+// pong: [0] type  [1..3] reserved  [4..7] seq u32  [8..15] t0 i64  [16..23] t1 i64  [24..31] t2 i64
+struct PingFrame {
+    uint32_t seq = 0;
+    int64_t t0_us = 0;
+    int64_t offset_us = 0;
+    uint32_t rtt_us = 0; // 0 = no estimate yet
+    uint32_t render_delay_us = 0;
+};
+
+struct PongFrame {
+    uint32_t seq = 0;
+    int64_t t0_us = 0;
+    int64_t t1_us = 0;
+    int64_t t2_us = 0;
+};
+
+// Periodic viewer report; counters cover the interval since the previous one.
+// [0] type  [1] flags (bit0 = stalled right now)  [2..3] reserved  [4..7] seq u32
+// [8..11] interval u32 (ms)  [12..15] frames decoded u32  [16..19] frames dropped u32
+// [20..23] mean jitter-buffer delay u32 (us)  [24..31] playback position f64 (s)
+// [32..35] stalls started u32  [36..39] time spent stalled u32 (ms)
+struct TelemetryFrame {
+    uint32_t seq = 0;
+    bool stalled = false;
+    uint32_t interval_ms = 0;
+    uint32_t frames_decoded = 0;
+    uint32_t frames_dropped = 0;
+    uint32_t jitter_buffer_us = 0;
+    double position_s = 0.0;
+    uint32_t stalls = 0;
+    uint32_t stall_ms = 0;
+};
+
+constexpr std::size_t kTelemetryFrameSize = 40;
+
+constexpr std::size_t kPingFrameSize = 32;
+constexpr std::size_t kPongFrameSize = 32;
+
+namespace channel_protocol {
+
+    inline void put_u32(uint8_t* p, uint32_t v) {
+        for (int i = 0; i < 4; ++i) p[i] = static_cast<uint8_t>(v >> (8 * i));
+    }
+
+    inline void put_u64(uint8_t* p, uint64_t v) {
+        for (int i = 0; i < 8; ++i) p[i] = static_cast<uint8_t>(v >> (8 * i));
+    }
+
+    inline uint32_t get_u32(const uint8_t* p) {
+        uint32_t v = 0;
+        for (int i = 0; i < 4; ++i) v |= static_cast<uint32_t>(p[i]) << (8 * i);
+        return v;
+    }
+
+    inline uint64_t get_u64(const uint8_t* p) {
+        uint64_t v = 0;
+        for (int i = 0; i < 8; ++i) v |= static_cast<uint64_t>(p[i]) << (8 * i);
+        return v;
+    }
+
+    inline void put_f64(uint8_t* p, double v) {
+        uint64_t bits;
+        std::memcpy(&bits, &v, sizeof(bits));
+        put_u64(p, bits);
+    }
+
+    inline double get_f64(const uint8_t* p) {
+        const uint64_t bits = get_u64(p);
+        double v;
+        std::memcpy(&v, &bits, sizeof(v));
+        return v;
+    }
+
+}
+
+inline void encodeSyncFrame(const SyncFrame& f, uint8_t* out) {
+    out[0] = static_cast<uint8_t>(ChannelFrameType::kSync);
+    out[1] = f.playing ? 1 : 0;
+    out[2] = static_cast<uint8_t>(f.playout_target_ms);
+    out[3] = static_cast<uint8_t>(f.playout_target_ms >> 8);
+    channel_protocol::put_u32(out + 4, f.seq);
+    channel_protocol::put_f64(out + 8, f.media_time);
+    channel_protocol::put_u64(out + 16, static_cast<uint64_t>(f.wallclock_us));
+}
+
+inline bool decodeSyncFrame(const uint8_t* data, std::size_t size, SyncFrame& out) {
+    if (size < kSyncFrameSize || data[0] != static_cast<uint8_t>(ChannelFrameType::kSync)) return false;
+    out.playing = (data[1] & 1) != 0;
+    out.playout_target_ms = static_cast<uint16_t>(data[2] | (data[3] << 8));
+    out.seq = channel_protocol::get_u32(data + 4);
+    out.media_time = channel_protocol::get_f64(data + 8);
+    out.wallclock_us = static_cast<int64_t>(channel_protocol::get_u64(data + 16));
+    return true;
+}
+
+inline bool decodePingFrame(const uint8_t* data, std::size_t size, PingFrame& out) {
+    if (size < kPingFrameSize || data[0] != static_cast<uint8_t>(ChannelFrameType::kPing)) return false;
+    out.seq = channel_protocol::get_u32(data + 4);
+    out.t0_us = static_cast<int64_t>(channel_protocol::get_u64(data + 8));
+    out.offset_us = static_cast<int64_t>(channel_protocol::get_u64(data + 16));
+    out.rtt_us = channel_protocol::get_u32(data + 24);
+    out.render_delay_us = channel_protocol::get_u32(data + 28);
+    return true;
+}
+
+inline void encodePongFrame(const PongFrame& f, uint8_t* out) {
+    out[0] = static_cast<uint8_t>(ChannelFrameType::kPong);
+    out[1] = 0;
+    out[2] = 0;
+    out[3] = 0;
+    channel_protocol::put_u32(out + 4, f.seq);
+    channel_protocol::put_u64(out + 8, static_cast<uint64_t>(f.t0_us));
+    channel_protocol::put_u64(out + 16, static_cast<uint64_t>(f.t1_us));
+    channel_protocol::put_u64(out + 24, static_cast<uint64_t>(f.t2_us));
+}
+
+inline bool decodeTelemetryFrame(const uint8_t* data, std::size_t size, TelemetryFrame& out) {
+    if (size < kTelemetryFrameSize || data[0] != static_cast<uint8_t>(ChannelFrameType::kTelemetry)) return false;
+    out.stalled = (data[1] & 1) != 0;
+    out.seq = channel_protocol::get_u32(data + 4);
+    out.interval_ms = channel_protocol::get_u32(data + 8);
+    out.frames_decoded = channel_protocol::get_u32(data + 12);
+    out.frames_dropped = channel_protocol::get_u32(data + 16);
+    out.jitter_buffer_us = channel_protocol::get_u32(data + 20);
+    out.position_s = channel_protocol::get_f64(data + 24);
+    out.stalls = channel_protocol::get_u32(data + 32);
+    out.stall_ms = channel_protocol::get_u32(data + 36);
+    return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+
+// Server-side view of one viewer's clock, as reported back in its pings.
+struct ViewerClock {
+    int64_t updated_ms = 0;
+    uint32_t samples = 0;
+    double offset_ms = 0.0;      // server wall clock minus viewer clock
+    double rtt_ms = 0.0;
+    double min_rtt_ms = 0.0;
+    double drift_ms = 0.0;       // offset change since the previous report
+    double sync_error_ms = 0.0;  // bound on how far the viewer's presentation time can be off
+    double render_delay_ms = 0.0;  // receive-to-render delay the viewer reports, 0 = unknown
+    double render_offset_ms = 0.0; // send-to-render: one-way delay plus render_delay_ms
+};
+
+// The offset from a single exchange is only known to within half its round
+// trip; on top of that, whatever the offset moved since the last report is
+// error the viewer has been rendering with until now.
+inline void updateViewerClock(ViewerClock& c, int64_t now_ms, double offset_ms, double rtt_ms,
+    double render_delay_ms) {
+    c.drift_ms = c.samples > 0 ? offset_ms - c.offset_ms : 0.0;
+    c.offset_ms = offset_ms;
+    c.rtt_ms = rtt_ms;
+    c.min_rtt_ms = c.samples > 0 && c.min_rtt_ms < rtt_ms ? c.min_rtt_ms : rtt_ms;
+    c.sync_error_ms = rtt_ms / 2.0 + (c.drift_ms < 0.0 ? -c.drift_ms : c.drift_ms);
+    c.render_delay_ms = render_delay_ms;
+    c.render_offset_ms = render_delay_ms > 0.0 ? rtt_ms / 2.0 + render_delay_ms : 0.0;
+    c.updated_ms = now_ms;
+    c.samples++;
+}
@@ -0,0 +1,255 @@
+#include "ContentHash.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+    constexpr uint64_t kPrime64_1 = 0x9E3779B185EBCA87ull;
+    constexpr uint64_t kPrime64_2 = 0xC2B2AE3D27D4EB4Full;
+    constexpr uint64_t kPrime64_3 = 0x165667B19E3779F9ull;
+    constexpr uint64_t kPrime64_4 = 0x85EBCA77C2B2AE63ull;
+    constexpr uint64_t kPrime64_5 = 0x27D4EB2F165667C5ull;
+
+    inline uint64_t rotl64(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+    inline uint32_t rotr32(uint32_t x, int r) { return (x >> r) | (x << (32 - r)); }
+
+    // xxHash is defined on little-endian input, which is every target we
+    // build for.
+    inline uint64_t read64le(const unsigned char* p) {
+        uint64_t v;
+        std::memcpy(&v, p, 8);
+        return v;
+    }
+
+    inline uint32_t read32le(const unsigned char* p) {
+        uint32_t v;
+        std::memcpy(&v, p, 4);
+        return v;
+    }
+
+    inline uint32_t read32be(const unsigned char* p) {
+        return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+    }
+
+    inline uint64_t xxhRound(uint64_t acc, uint64_t input) {
+        acc += input * kPrime64_2;
+        acc = rotl64(acc, 31);
+        return acc * kPrime64_1;
+    }
+
+    inline uint64_t xxhMerge(uint64_t acc, uint64_t v) {
+        acc ^= xxhRound(0, v);
+        return acc * kPrime64_1 + kPrime64_4;
+    }
+
+    constexpr uint32_t kSha256K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+
+}
+
+Xxh64::Xxh64(uint64_t seed) : seed_(seed) {
+    v_[0] = seed + kPrime64_1 + kPrime64_2;
+    v_[1] = seed + kPrime64_2;
+    v_[2] = seed;
+    v_[3] = seed - kPrime64_1;
+}
+
+void Xxh64::update(const void* data, std::size_t len) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const unsigned char* const end = p + len;
+    total_ += len;
+
+    if (buffered_ + len < 32) {
+        std::memcpy(buf_ + buffered_, p, len);
+        buffered_ += len;
+        return;
+    }
+
+    if (buffered_ > 0) {
+        const std::size_t take = 32 - buffered_;
+        std::memcpy(buf_ + buffered_, p, take);
+        p += take;
+        for (int i = 0; i < 4; ++i) v_[i] = xxhRound(v_[i], read64le(buf_ + 8 * i));
+        buffered_ = 0;
+    }
+
+    // The hot loop: 32 bytes per iteration, the four lanes independent.
+    uint64_t v0 = v_[0], v1 = v_[1], v2 = v_[2], v3 = v_[3];
+    while (end - p >= 32) {
+        v0 = xxhRound(v0, read64le(p));
+        v1 = xxhRound(v1, read64le(p + 8));
+        v2 = xxhRound(v2, read64le(p + 16));
+        v3 = xxhRound(v3, read64le(p + 24));
+        p += 32;
+    }
+    v_[0] = v0; v_[1] = v1; v_[2] = v2; v_[3] = v3;
+
+    buffered_ = static_cast<std::size_t>(end - p);
+    if (buffered_ > 0) std::memcpy(buf_, p, buffered_);
+}
+
+uint64_t Xxh64::digest() const {
+    uint64_t h;
+    if (total_ >= 32) {
+        h = rotl64(v_[0], 1) + rotl64(v_[1], 7) + rotl64(v_[2], 12) + rotl64(v_[3], 18);
+        for (int i = 0; i < 4; ++i) h = xxhMerge(h, v_[i]);
+    }
+    else {
+        h = seed_ + kPrime64_5;
+    }
+    h += total_;
+
+    const unsigned char* p = buf_;
+    const unsigned char* const end = buf_ + buffered_;
+    while (end - p >= 8) {
+        h ^= xxhRound(0, read64le(p));
+        h = rotl64(h, 27) * kPrime64_1 + kPrime64_4;
+        p += 8;
+    }
+    if (end - p >= 4) {
+        h ^= uint64_t(read32le(p)) * kPrime64_1;
+        h = rotl64(h, 23) * kPrime64_2 + kPrime64_3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (*p++) * kPrime64_5;
+        h = rotl64(h, 11) * kPrime64_1;
+    }
+
+    h ^= h >> 33;
+    h *= kPrime64_2;
+    h ^= h >> 29;
+    h *= kPrime64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t Xxh64::hash(const void* data, std::size_t len, uint64_t seed) {
+    Xxh64 x(seed);
+    x.update(data, len);
+    return x.digest();
+}
+
+Sha256::Sha256() {
+    static constexpr uint32_t kInit[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    std::memcpy(h_, kInit, sizeof(h_));
+}
+
+void Sha256::block(const unsigned char* p) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; ++i) w[i] = read32be(p + 4 * i);
+    for (int i = 16; i < 64; ++i) {
+        const uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        const uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = h_[0], b = h_[1], c = h_[2], d = h_[3], e = h_[4], f = h_[5], g = h_[6], h = h_[7];
+    for (int i = 0; i < 64; ++i) {
+        const uint32_t s1 = rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25);
+        const uint32_t ch = (e & f) ^ (~e & g);
+        const uint32_t t1 = h + s1 + ch + kSha256K[i] + w[i];
+        const uint32_t s0 = rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22);
+        const uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        const uint32_t t2 = s0 + maj;
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    h_[0] += a; h_[1] += b; h_[2] += c; h_[3] += d;
+    h_[4] += e; h_[5] += f; h_[6] += g; h_[7] += h;
+}
+
+void Sha256::update(const void* data, std::size_t len) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    total_ += len;
+
+    if (buffered_ > 0) {
+        const std::size_t take = std::min<std::size_t>(64 - buffered_, len);
+        std::memcpy(buf_ + buffered_, p, take);
+        buffered_ += take;
+        p += take;
+        len -= take;
+        if (buffered_ < 64) return;
+        block(buf_);
+        buffered_ = 0;
+    }
+    while (len >= 64) {
+        block(p);
+        p += 64;
+        len -= 64;
+    }
+    if (len > 0) {
+        std::memcpy(buf_, p, len);
+        buffered_ = len;
+    }
+}
+
+std::array<uint8_t, 32> Sha256::digest() {
+    const uint64_t bits = total_ * 8;
+    const unsigned char pad = 0x80;
+    update(&pad, 1);
+    const unsigned char zero[64] = {};
+    update(zero, buffered_ <= 56 ? 56 - buffered_ : 120 - buffered_);
+
+    unsigned char length[8];
+    for (int i = 0; i < 8; ++i) length[i] = static_cast<unsigned char>(bits >> (56 - 8 * i));
+    update(length, 8);
+
+    std::array<uint8_t, 32> out{};
+    for (int i = 0; i < 8; ++i) {
+        out[4 * i] = static_cast<uint8_t>(h_[i] >> 24);
+        out[4 * i + 1] = static_cast<uint8_t>(h_[i] >> 16);
+        out[4 * i + 2] = static_cast<uint8_t>(h_[i] >> 8);
+        out[4 * i + 3] = static_cast<uint8_t>(h_[i]);
+    }
+    return out;
+}
+
+ContentHasher::ContentHasher(bool sha256) {
+    if (sha256) sha_ = std::make_unique<Sha256>();
+}
+
+void ContentHasher::update(const void* data, std::size_t len) {
+    xxh_.update(data, len);
+    if (sha_) sha_->update(data, len);
+    size_ += len;
+}
+
+ContentDigest ContentHasher::finish() {
+    ContentDigest d;
+    d.size = size_;
+    d.xxh64 = xxh_.digest();
+    if (sha_) {
+        const auto sum = sha_->digest();
+        d.sha256 = toHex(sum.data(), sum.size());
+    }
+    return d;
+}
+
+std::string toHex(const void* data, std::size_t len) {
+    static constexpr char kDigits[] = "0123456789abcdef";
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    std::string out(len * 2, '0');
+    for (std::size_t i = 0; i < len; ++i) {
+        out[2 * i] = kDigits[p[i] >> 4];
+        out[2 * i + 1] = kDigits[p[i] & 0x0f];
+    }
+    return out;
+}
+
+std::string toHex(uint64_t value) {
+    unsigned char be[8];
+    for (int i = 0; i < 8; ++i) be[i] = static_cast<unsigned char>(value >> (56 - 8 * i));
+    return toHex(be, sizeof(be));
+}
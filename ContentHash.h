@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// XXH64, streaming. Four independent accumulator lanes keep the multipliers
+// busy, so it hashes at roughly memory bandwidth with plain scalar code.
+// Not collision resistant: use it for change detection, not as an identity.
+class Xxh64 {
+public:
+    explicit Xxh64(uint64_t seed = 0);
+
+    void update(const void* data, std::size_t len);
+    uint64_t digest() const;
+
+    static uint64_t hash(const void* data, std::size_t len, uint64_t seed = 0);
+
+private:
+    uint64_t seed_;
+    uint64_t v_[4];
+    uint64_t total_ = 0;
+    unsigned char buf_[32];
+    std::size_t buffered_ = 0;
+};
+
+// SHA-256 (FIPS 180-4), streaming.
+class Sha256 {
+public:
+    Sha256();
+
+    void update(const void* data, std::size_t len);
+    // Finalizes; the object cannot be updated afterwards.
+    std::array<uint8_t, 32> digest();
+
+private:
+    void block(const unsigned char* p);
+
+    uint32_t h_[8];
+    uint64_t total_ = 0;
+    unsigned char buf_[64];
+    std::size_t buffered_ = 0;
+};
+
+struct ContentDigest {
+    uint64_t size = 0;
+    uint64_t xxh64 = 0;
+    std::string sha256; // lowercase hex; empty when not computed
+};
+
+// Both hashes over one pass of the data, fed in order as it arrives.
+class ContentHasher {
+public:
+    explicit ContentHasher(bool sha256);
+
+    void update(const void* data, std::size_t len);
+    uint64_t bytes() const { return size_; }
+    ContentDigest finish();
+
+private:
+    Xxh64 xxh_;
+    std::unique_ptr<Sha256> sha_;
+    uint64_t size_ = 0;
+};
+
+std::string toHex(const void* data, std::size_t len);
+std::string toHex(uint64_t value); // 16 digits, big-endian order
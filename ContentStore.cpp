@@ -0,0 +1,97 @@
+#include "ContentStore.h"
+
+#include <filesystem>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+    bool is_hex(std::string_view s) {
+        return !s.empty() && s.find_first_not_of("0123456789abcdef") == std::string_view::npos;
+    }
+
+}
+
+ContentStore::ContentStore(std::string directory, bool sha256)
+    : objects_dir_(std::move(directory) + "/objects")
+    , sha256_(sha256)
+{
+}
+
+std::string ContentStore::keyFor(const ContentDigest& digest) const {
+    if (sha256_) return "sha256-" + digest.sha256;
+    return "xxh64-" + toHex(digest.xxh64) + "-" + std::to_string(digest.size);
+}
+
+std::string ContentStore::keyFromHeader(std::string_view value, uint64_t size) const {
+    while (!value.empty() && value.front() == ' ') value.remove_prefix(1);
+    while (!value.empty() && value.back() == ' ') value.remove_suffix(1);
+
+    const auto eq = value.find('=');
+    if (eq == std::string_view::npos) return {};
+    const std::string_view alg = value.substr(0, eq);
+    const std::string_view hex = value.substr(eq + 1);
+
+    if (sha256_ && alg == "sha256" && hex.size() == 64 && is_hex(hex)) {
+        return "sha256-" + std::string(hex);
+    }
+    if (!sha256_ && alg == "xxh64" && hex.size() == 16 && is_hex(hex)) {
+        return "xxh64-" + std::string(hex) + "-" + std::to_string(size);
+    }
+    return {};
+}
+
+std::string ContentStore::objectPath(const std::string& key) const {
+    return objects_dir_ + "/" + key;
+}
+
+bool ContentStore::linkExisting(const std::string& key, uint64_t size, const std::string& path) {
+    const std::string object = objectPath(key);
+    std::error_code ec;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto object_size = fs::file_size(object, ec);
+    if (ec || object_size != size) return false;
+
+    fs::create_hard_link(object, path, ec);
+    if (ec) {
+        std::cerr << "[STORE] Cannot link " << key << " to " << path << ": " << ec.message() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ContentStore::publish(const std::string& key, const std::string& path) {
+    const std::string object = objectPath(key);
+    std::error_code ec;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    fs::create_directories(objects_dir_, ec);
+
+    if (fs::exists(object, ec)) {
+        if (fs::equivalent(object, path, ec)) return true;
+        std::error_code size_ec;
+        const auto object_size = fs::file_size(object, ec);
+        if (ec || object_size != fs::file_size(path, size_ec) || size_ec) return false;
+
+        // Link beside the upload and rename over it, so `path` always names
+        // a complete file; the duplicate's blocks go with its last name.
+        const std::string tmp = path + ".dedup";
+        fs::create_hard_link(object, tmp, ec);
+        if (!ec) fs::rename(tmp, path, ec);
+        if (ec) {
+            std::cerr << "[STORE] Cannot deduplicate " << path << ": " << ec.message() << std::endl;
+            fs::remove(tmp, ec);
+            return false;
+        }
+        return true;
+    }
+
+    fs::create_hard_link(path, object, ec);
+    if (ec) {
+        // No hard links on this volume: uploads are simply not deduplicated.
+        std::cerr << "[STORE] Cannot store " << key << ": " << ec.message() << std::endl;
+    }
+    return false;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "ContentHash.h"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+// Content-addressed copies of finished uploads, one per distinct body, under
+// <directory>/objects. Every upload keeps its own stream_*.ext path; when the
+// body is already stored that path becomes a hard link to the existing
+// object, so identical content takes its disk space once. Objects are never
+// removed here. Thread-safe; everything touches the filesystem, so call it
+// from the file I/O pool.
+class ContentStore {
+public:
+    // With `sha256` the objects are keyed by SHA-256. Without it they are
+    // keyed by XXH64 and size, which is cheaper to compute but trusts that no
+    // one crafts a collision.
+    ContentStore(std::string directory, bool sha256);
+
+    bool sha256() const { return sha256_; }
+
+    // "sha256-<hex>" or "xxh64-<hex>-<size>".
+    std::string keyFor(const ContentDigest& digest) const;
+
+    // Key from a client-declared X-Content-Hash ("sha256=<hex>" or
+    // "xxh64=<hex>"), or empty if malformed or not the algorithm the objects
+    // are keyed by.
+    std::string keyFromHeader(std::string_view value, uint64_t size) const;
+
+    // Creates `path` as a link to the object for `key` if there is one of
+    // `size` bytes. The body does not have to be transferred at all.
+    bool linkExisting(const std::string& key, uint64_t size, const std::string& path);
+
+    // A finished upload at `path` with the given key: replaces `path` with a
+    // link to the stored copy when there is one (returns true), otherwise
+    // stores `path` as the object. Failure to link leaves `path` untouched.
+    bool publish(const std::string& key, const std::string& path);
+
+private:
+    std::string objectPath(const std::string& key) const;
+
+    const std::string objects_dir_;
+    const bool sha256_;
+    std::mutex mutex_;
+};
@@ -0,0 +1,143 @@
+#include "CpuGovernor.h"
+#include "CpuTime.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+    struct QualityStep {
+        double max_framerate;
+        double extra_scale;
+    };
+
+    // Frame rate goes first, resolution second; each level is one step.
+    constexpr QualityStep kSteps[CpuGovernor::kMaxLevel + 1] = {
+        { 0.0, 1.0 },
+        { 24.0, 1.0 },
+        { 24.0, 1.5 },
+        { 15.0, 1.5 },
+        { 15.0, 2.0 },
+        { 10.0, 2.0 },
+    };
+
+}
+
+CpuGovernor::CpuGovernor(CpuGovernorConfig config)
+    : config_(config) {
+}
+
+CpuGovernor::Decision CpuGovernor::update(const std::map<std::string, double>& encode_time_s) {
+    Decision d;
+
+    const int64_t now_ns = steadyTimeNs();
+    const int64_t cpu_ns = processCpuTimeNs();
+    const double wall_s = last_wall_ns_ > 0 ? static_cast<double>(now_ns - last_wall_ns_) / 1e9 : 0.0;
+    const double cores = static_cast<double>(logicalCpuCount());
+
+    if (wall_s > 0.0) {
+        d.cpu_percent = 100.0 * (static_cast<double>(cpu_ns - last_cpu_ns_) / 1e9) / (wall_s * cores);
+    }
+    last_wall_ns_ = now_ns;
+    last_cpu_ns_ = cpu_ns;
+
+    double encode_s = 0.0;
+    std::map<std::string, int> levels;
+    for (const auto& [id, total] : encode_time_s) {
+        auto prev = last_encode_time_s_.find(id);
+        if (prev != last_encode_time_s_.end() && total >= prev->second) encode_s += total - prev->second;
+
+        auto lv = levels_.find(id);
+        levels[id] = lv != levels_.end() ? lv->second : 0;
+    }
+    if (wall_s > 0.0) d.encode_percent = 100.0 * encode_s / (wall_s * cores);
+
+    last_encode_time_s_ = encode_time_s;
+    levels_ = std::move(levels);
+
+    if (wall_s <= 0.0 || levels_.empty()) return d;
+
+    if (d.cpu_percent > config_.budget_percent) {
+        calm_samples_ = 0;
+
+        const double overshoot = (d.cpu_percent - config_.budget_percent) / config_.budget_percent;
+        const int wanted = std::max(1, static_cast<int>(std::ceil(overshoot * static_cast<double>(levels_.size()))));
+
+        for (int i = 0; i < wanted; ++i) {
+            auto pick = levels_.end();
+            for (auto it = levels_.begin(); it != levels_.end(); ++it) {
+                if (it->second >= kMaxLevel) continue;
+                if (pick == levels_.end() || it->second < pick->second) pick = it;
+            }
+            if (pick == levels_.end()) break;
+            pick->second++;
+            d.stepped_down++;
+        }
+    }
+    else if (d.cpu_percent < config_.budget_percent * config_.recover_ratio) {
+        if (++calm_samples_ >= config_.recover_samples) {
+            calm_samples_ = 0;
+
+            auto pick = levels_.end();
+            for (auto it = levels_.begin(); it != levels_.end(); ++it) {
+                if (it->second <= 0) continue;
+                if (pick == levels_.end() || it->second >= pick->second) pick = it;
+            }
+            if (pick != levels_.end()) {
+                pick->second--;
+                d.stepped_up++;
+            }
+        }
+    }
+    else {
+        calm_samples_ = 0;
+    }
+
+    return d;
+}
+
+int CpuGovernor::level(const std::string& clientId) const {
+    auto it = levels_.find(clientId);
+    return it != levels_.end() ? it->second : 0;
+}
+
+bool CpuGovernor::preferFastEncoding() const {
+    if (levels_.empty()) return false;
+    int sum = 0;
+    for (const auto& [id, lv] : levels_) {
+        (void)id;
+        sum += lv;
+    }
+    return sum >= 3 * static_cast<int>(levels_.size());
+}
+
+void CpuGovernor::constrain(SenderLimits& limits, int level, const std::vector<VideoLayer>* ladder) {
+    level = std::clamp(level, 0, kMaxLevel);
+    const QualityStep& step = kSteps[level];
+
+    if (step.max_framerate > 0.0) {
+        limits.max_framerate = limits.max_framerate > 0.0
+            ? std::min(limits.max_framerate, step.max_framerate)
+            : step.max_framerate;
+    }
+    if (step.extra_scale <= 1.0) return;
+
+    const double wanted = limits.scale_resolution_down_by * step.extra_scale;
+    if (!ladder || ladder->empty()) {
+        limits.scale_resolution_down_by = wanted;
+        return;
+    }
+
+    // Rungs run from the smallest resolution up; take the first one below
+    // the current rung (the top one for an unconstrained sender) that is at
+    // least as small as asked, or the bottom.
+    const int top = static_cast<int>(ladder->size()) - 1;
+    int target = limits.layer < 0 ? top : std::min(limits.layer, top);
+    while (target > 0 && (*ladder)[target].scale_resolution_down_by < wanted) --target;
+    const VideoLayer& rung = (*ladder)[target];
+    limits.layer = target;
+    limits.scale_resolution_down_by = std::max(limits.scale_resolution_down_by, rung.scale_resolution_down_by);
+    limits.max_bitrate_bps = limits.max_bitrate_bps > 0
+        ? std::min(limits.max_bitrate_bps, rung.max_bitrate_bps)
+        : rung.max_bitrate_bps;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "SenderPolicy.h"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+struct CpuGovernorConfig {
+    double budget_percent = 85.0;  // share of all cores the process may use
+    double recover_ratio = 0.8;    // step back up below budget * recover_ratio
+    int recover_samples = 3;       // ...for this many consecutive samples
+};
+
+// Process-wide encoder CPU governor. Each sender carries a quality level
+// (0 = untouched); over budget the governor raises levels one sender at a
+// time, always picking the least degraded sender first and breaking ties by
+// client id, so the outcome does not depend on thread timing.
+class CpuGovernor {
+public:
+    static constexpr int kMaxLevel = 5;
+
+    struct Decision {
+        double cpu_percent = 0.0;
+        double encode_percent = 0.0;
+        int stepped_down = 0;
+        int stepped_up = 0;
+    };
+
+    explicit CpuGovernor(CpuGovernorConfig config);
+
+    const CpuGovernorConfig& config() const { return config_; }
+
+    // `encode_time_s` maps every live sender to its cumulative totalEncodeTime.
+    Decision update(const std::map<std::string, double>& encode_time_s);
+
+    int level(const std::string& clientId) const;
+    const std::map<std::string, int>& levels() const { return levels_; }
+    bool preferFastEncoding() const;
+
+    // With a ladder (broadcast encoding), resolution steps move the viewer
+    // to a lower rung instead of an off-ladder scale, so it joins that rung's
+    // shared encoder rather than starting one of its own.
+    static void constrain(SenderLimits& limits, int level, const std::vector<VideoLayer>* ladder = nullptr);
+
+private:
+    CpuGovernorConfig config_;
+    std::map<std::string, int> levels_;
+    std::map<std::string, double> last_encode_time_s_;
+    int64_t last_cpu_ns_ = 0;
+    int64_t last_wall_ns_ = 0;
+    int calm_samples_ = 0;
+};
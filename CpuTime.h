@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+
+int64_t currentThreadCpuTimeNs();
+int64_t processCpuTimeNs();
+int64_t steadyTimeNs();
+int64_t wallClockUs(); // microseconds since the Unix epoch
+unsigned logicalCpuCount();
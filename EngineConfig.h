@@ -0,0 +1,35 @@
+#pragma once
+
+#include "CpuGovernor.h"
+#include "PlayoutDelay.h"
+#include "SenderPolicy.h"
+#include "VideoLayers.h"
+
+#include <string>
+#include <vector>
+
+// Runtime knobs for RTCManager and the SharedState loops that drive it. Kept
+// free of WebRTC headers so the networking side can carry it around.
+struct EngineConfig {
+    int shard_count = 0; // 0 = derive from the number of logical cores
+    int stats_interval_ms = 1000;
+    bool broadcast_encoder = false; // share one encoder per (codec, resolution, tier)
+    bool layered_video = true;      // per-viewer rung selection on video_layers
+    std::vector<VideoLayer> video_layers = defaultVideoLayers();
+    std::string start_bitrate_preset = "fast"; // conservative | balanced | fast
+    DegradationMode degradation = DegradationMode::kBalanced;
+    bool cpu_governor = true;
+    CpuGovernorConfig governor;
+
+    int sync_heartbeat_ms = 1000;
+    bool unreliable_sync_channel = false; // unordered, zero-retransmit "sync" channel
+    PlayoutDelayConfig playout;           // room-wide render alignment via the playout-delay extension
+
+    // Open a reliable "control" data channel next to "sync". Once it is up,
+    // signaling and start/stop/seek move onto it and the WebSocket may be parked.
+    bool control_channel = false;
+
+    // How long a peer connection outlives its WebSocket, waiting for the
+    // client to come back with its resume token. 0 closes it immediately.
+    int resume_grace_ms = 15000;
+};
@@ -0,0 +1,264 @@
+#include "FileIO.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+#endif
+
+namespace {
+
+    // Enough to keep a few uploads' disks busy without letting a slow volume
+    // soak up threads.
+    constexpr std::size_t kFileIoThreads = 4;
+
+    thread_local std::string last_error;
+
+}
+
+RandomAccessFile::~RandomAccessFile() {
+    close();
+}
+
+RandomAccessFile::RandomAccessFile(RandomAccessFile&& o) noexcept {
+    *this = std::move(o);
+}
+
+RandomAccessFile& RandomAccessFile::operator=(RandomAccessFile&& o) noexcept {
+    if (this != &o) {
+        close();
+#ifdef _WIN32
+        handle_ = std::exchange(o.handle_, nullptr);
+#else
+        fd_ = std::exchange(o.fd_, -1);
+#endif
+    }
+    return *this;
+}
+
+void RandomAccessFile::captureError() {
+#ifdef _WIN32
+    last_error = "win32 error " + std::to_string(GetLastError());
+#else
+    last_error = std::strerror(errno);
+#endif
+}
+
+std::string RandomAccessFile::lastError() {
+    return last_error;
+}
+
+#ifdef _WIN32
+
+bool RandomAccessFile::open(const std::string& path, Mode mode) {
+    close();
+    const DWORD access = mode == Mode::kRead ? GENERIC_READ : GENERIC_WRITE;
+    const DWORD disposition = mode == Mode::kRead ? OPEN_EXISTING
+        : mode == Mode::kWriteTruncate ? CREATE_ALWAYS : OPEN_ALWAYS;
+    HANDLE h = CreateFileA(path.c_str(), access, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, disposition, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE) {
+        captureError();
+        return false;
+    }
+    handle_ = h;
+    return true;
+}
+
+bool RandomAccessFile::isOpen() const {
+    return handle_ != nullptr;
+}
+
+void RandomAccessFile::close() {
+    if (handle_) CloseHandle(static_cast<HANDLE>(handle_));
+    handle_ = nullptr;
+}
+
+bool RandomAccessFile::preallocate(uint64_t size) {
+    FILE_ALLOCATION_INFO info{};
+    info.AllocationSize.QuadPart = static_cast<LONGLONG>(size);
+    if (!SetFileInformationByHandle(static_cast<HANDLE>(handle_), FileAllocationInfo, &info, sizeof(info))) {
+        captureError();
+        return false;
+    }
+    return true;
+}
+
+bool RandomAccessFile::writeAt(uint64_t offset, const void* data, std::size_t len) {
+    const char* p = static_cast<const char*>(data);
+    while (len > 0) {
+        OVERLAPPED ov{};
+        ov.Offset = static_cast<DWORD>(offset);
+        ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        const DWORD chunk = static_cast<DWORD>(std::min<std::size_t>(len, 1u << 30));
+        DWORD written = 0;
+        if (!WriteFile(static_cast<HANDLE>(handle_), p, chunk, &written, &ov) || written == 0) {
+            captureError();
+            return false;
+        }
+        p += written;
+        offset += written;
+        len -= written;
+    }
+    return true;
+}
+
+int64_t RandomAccessFile::readAt(uint64_t offset, void* data, std::size_t len) {
+    OVERLAPPED ov{};
+    ov.Offset = static_cast<DWORD>(offset);
+    ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD got = 0;
+    const DWORD chunk = static_cast<DWORD>(std::min<std::size_t>(len, 1u << 30));
+    if (!ReadFile(static_cast<HANDLE>(handle_), data, chunk, &got, &ov)) {
+        if (GetLastError() == ERROR_HANDLE_EOF) return 0;
+        captureError();
+        return -1;
+    }
+    return static_cast<int64_t>(got);
+}
+
+bool RandomAccessFile::truncate(uint64_t size) {
+    FILE_END_OF_FILE_INFO info{};
+    info.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+    if (!SetFileInformationByHandle(static_cast<HANDLE>(handle_), FileEndOfFileInfo, &info, sizeof(info))) {
+        captureError();
+        return false;
+    }
+    return true;
+}
+
+int64_t RandomAccessFile::size() const {
+    LARGE_INTEGER v;
+    if (!GetFileSizeEx(static_cast<HANDLE>(handle_), &v)) return -1;
+    return static_cast<int64_t>(v.QuadPart);
+}
+
+
+int64_t RandomAccessFile::sendTo(std::uintptr_t, uint64_t, std::size_t, bool& would_block, bool& unsupported) {
+    would_block = false;
+    unsupported = true;
+    last_error = "sendfile is not supported";
+    return -1;
+}
+#else
+
+bool RandomAccessFile::open(const std::string& path, Mode mode) {
+    close();
+    int flags = O_CLOEXEC;
+    if (mode == Mode::kRead) flags |= O_RDONLY;
+    else flags |= O_WRONLY | O_CREAT | (mode == Mode::kWriteTruncate ? O_TRUNC : 0);
+    const int fd = ::open(path.c_str(), flags, 0644);
+    if (fd < 0) {
+        captureError();
+        return false;
+    }
+    fd_ = fd;
+    return true;
+}
+
+bool RandomAccessFile::isOpen() const {
+    return fd_ >= 0;
+}
+
+void RandomAccessFile::close() {
+    if (fd_ >= 0) ::close(fd_);
+    fd_ = -1;
+}
+
+bool RandomAccessFile::preallocate(uint64_t size) {
+#if defined(__linux__)
+    // KEEP_SIZE: reserve blocks without moving EOF, so readers following
+    // the file (progressive ingest) still see only what has been written.
+    if (::fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size)) == 0) return true;
+    captureError();
+    return false;
+#else
+    (void)size;
+    return false;
+#endif
+}
+
+bool RandomAccessFile::writeAt(uint64_t offset, const void* data, std::size_t len) {
+    const char* p = static_cast<const char*>(data);
+    while (len > 0) {
+        const ssize_t n = ::pwrite(fd_, p, len, static_cast<off_t>(offset));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            captureError();
+            return false;
+        }
+        p += n;
+        offset += static_cast<uint64_t>(n);
+        len -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+int64_t RandomAccessFile::readAt(uint64_t offset, void* data, std::size_t len) {
+    while (true) {
+        const ssize_t n = ::pread(fd_, data, len, static_cast<off_t>(offset));
+        if (n >= 0) return static_cast<int64_t>(n);
+        if (errno == EINTR) continue;
+        captureError();
+        return -1;
+    }
+}
+
+bool RandomAccessFile::truncate(uint64_t size) {
+    if (::ftruncate(fd_, static_cast<off_t>(size)) == 0) return true;
+    captureError();
+    return false;
+}
+
+int64_t RandomAccessFile::size() const {
+    struct stat st {};
+    if (::fstat(fd_, &st) != 0) return -1;
+    return static_cast<int64_t>(st.st_size);
+}
+
+
+int64_t RandomAccessFile::sendTo(std::uintptr_t socket, uint64_t offset, std::size_t len, bool& would_block, bool& unsupported) {
+    would_block = false;
+    unsupported = false;
+#if defined(__linux__)
+    off_t off = static_cast<off_t>(offset);
+    while (true) {
+        const ssize_t n = ::sendfile(static_cast<int>(socket), fd_, &off, len);
+        if (n >= 0) return static_cast<int64_t>(n);
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            would_block = true;
+            return -1;
+        }
+        unsupported = errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP;
+        captureError();
+        return -1;
+    }
+#else
+    (void)socket;
+    (void)offset;
+    (void)len;
+    unsupported = true;
+    last_error = "sendfile is not supported";
+    return -1;
+#endif
+}
+#endif
+
+boost::asio::thread_pool& fileIoPool() {
+    static boost::asio::thread_pool pool(kFileIoThreads);
+    return pool;
+}
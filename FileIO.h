@@ -0,0 +1,64 @@
+#pragma once
+
+#include <boost/asio/thread_pool.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Positional file access for the upload and ingest paths. Writes at explicit
+// offsets (pwrite / overlapped WriteFile), so several writers can fill one
+// file without sharing a cursor, and nothing here touches an io_context.
+class RandomAccessFile {
+public:
+    enum class Mode { kRead, kWrite, kWriteTruncate };
+
+    RandomAccessFile() = default;
+    ~RandomAccessFile();
+
+    RandomAccessFile(RandomAccessFile&& o) noexcept;
+    RandomAccessFile& operator=(RandomAccessFile&& o) noexcept;
+    RandomAccessFile(const RandomAccessFile&) = delete;
+    RandomAccessFile& operator=(const RandomAccessFile&) = delete;
+
+    bool open(const std::string& path, Mode mode);
+    bool isOpen() const;
+    void close();
+
+    // Reserve `size` bytes on disk so later writes neither fragment nor hit
+    // ENOSPC halfway. Best effort: false only means it was not possible.
+    bool preallocate(uint64_t size);
+
+    // Writes all of `len` or fails.
+    bool writeAt(uint64_t offset, const void* data, std::size_t len);
+    // Returns bytes read, 0 at EOF, -1 on error.
+    int64_t readAt(uint64_t offset, void* data, std::size_t len);
+
+    bool truncate(uint64_t size);
+    int64_t size() const;
+
+    // Up to `len` bytes at `offset` straight to a connected socket, without
+    // passing through user space (sendfile). The socket should be
+    // non-blocking: a full send buffer returns -1 with `would_block` set.
+    // Returns bytes sent, -1 on error. `unsupported` is set when the platform
+    // or the file system has no sendfile, so callers keep a read-and-write
+    // path. A closed peer raises SIGPIPE unless the process ignores it.
+    int64_t sendTo(std::uintptr_t socket, uint64_t offset, std::size_t len, bool& would_block, bool& unsupported);
+
+    // Last OS error from any of the above on the calling thread, errno
+    // style, so concurrent writers to one file do not race on it.
+    static std::string lastError();
+
+private:
+    static void captureError();
+
+#ifdef _WIN32
+    void* handle_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
+
+// Blocking file work runs here, never on an io_context thread. Completions
+// are posted back to the caller's executor.
+boost::asio::thread_pool& fileIoPool();
@@ -1,4 +1,12 @@
 ﻿#include "HttpServer.h"
+#include "Metrics.h"
+#include "IoContextPool.h"
+#include "ContentHash.h"
+#include "FileIO.h"
+#include "IngestRegistry.h"
+#include "MediaCatalog.h"
+#include "StaticAssets.h"
+#include "UploadRegistry.h"
 
 #include <boost/beast/version.hpp>
 #include <boost/asio/dispatch.hpp>
@@ -8,46 +16,150 @@
 
 #include <algorithm>
 #include <array>
-#include <chrono>
 #include <cctype>
-#include <filesystem>
-#include <fstream>
+#include <chrono>
+#include <charconv>
+#include <ctime>
 #include <iostream>
-#include <random>
-#include <sstream>
+#include <vector>
 
 
 using json = nlohmann::json;
 
 namespace {
 
-    std::string sanitize_basename(std::string name) {
+    // "/uploads/<id>[/<action>][?offset=N]"
+    bool parse_upload_target(beast::string_view target, std::string& id, std::string& action, uint64_t& offset) {
+        const beast::string_view prefix = "/uploads/";
+        if (target.size() <= prefix.size() || target.substr(0, prefix.size()) != prefix) return false;
+
+        beast::string_view rest = target.substr(prefix.size());
+        beast::string_view query;
+        const auto q = rest.find('?');
+        if (q != beast::string_view::npos) {
+            query = rest.substr(q + 1);
+            rest = rest.substr(0, q);
+        }
 
-        auto pos1 = name.find_last_of('/');
-        auto pos2 = name.find_last_of('\\');
-        auto pos = (pos1 == std::string::npos) ? pos2 : (pos2 == std::string::npos ? pos1 : std::max(pos1, pos2));
-        if (pos != std::string::npos) name = name.substr(pos + 1);
+        const auto slash = rest.find('/');
+        id = std::string(rest.substr(0, slash));
+        action = slash == beast::string_view::npos ? std::string() : std::string(rest.substr(slash + 1));
+        if (id.empty() || id.find_first_not_of("0123456789abcdef") != std::string::npos) return false;
+
+        offset = 0;
+        const auto key = query.find("offset=");
+        if (key != beast::string_view::npos) {
+            const char* first = query.data() + key + 7;
+            const char* last = query.data() + query.size();
+            const auto amp = std::find(first, last, '&');
+            if (std::from_chars(first, amp, offset).ec != std::errc()) return false;
+        }
+        return true;
+    }
 
-     
-        for (char& c : name) {
-            const bool ok = std::isalnum(static_cast<unsigned char>(c)) || c == '.' || c == '_' || c == '-';
-            if (!ok) c = '_';
+    // More ranges than this, or ranges adding up to more than the file, and
+    // the whole file is sent instead: overlapping ranges would let a small
+    // request ask for many times the file.
+    constexpr std::size_t kMaxRanges = 16;
+
+    struct ByteRange {
+        uint64_t first = 0;
+        uint64_t last = 0; // inclusive
+        uint64_t length() const { return last - first + 1; }
+    };
+
+    enum class RangeParse { kIgnore, kSatisfiable, kUnsatisfiable };
+
+    // RFC 9110 14.1.2 byte ranges against a file of `size` bytes. A header
+    // that does not parse is ignored, as the RFC allows.
+    RangeParse parse_ranges(beast::string_view header, uint64_t size, std::vector<ByteRange>& out) {
+        out.clear();
+        const beast::string_view unit = "bytes=";
+        if (header.size() <= unit.size() || !beast::iequals(header.substr(0, unit.size()), unit)) {
+            return RangeParse::kIgnore;
         }
 
+        beast::string_view rest = header.substr(unit.size());
+        std::size_t specs = 0;
+        uint64_t total = 0;
+        while (!rest.empty()) {
+            const auto comma = rest.find(',');
+            beast::string_view spec = rest.substr(0, comma);
+            rest = comma == beast::string_view::npos ? beast::string_view() : rest.substr(comma + 1);
+            while (!spec.empty() && (spec.front() == ' ' || spec.front() == '\t')) spec.remove_prefix(1);
+            while (!spec.empty() && (spec.back() == ' ' || spec.back() == '\t')) spec.remove_suffix(1);
+            if (spec.empty()) continue;
+            if (++specs > kMaxRanges) return RangeParse::kIgnore;
+
+            const auto dash = spec.find('-');
+            if (dash == beast::string_view::npos) return RangeParse::kIgnore;
+            const beast::string_view a = spec.substr(0, dash);
+            const beast::string_view b = spec.substr(dash + 1);
+            uint64_t x = 0;
+            uint64_t y = 0;
+            auto number = [](beast::string_view s, uint64_t& v) {
+                return !s.empty() && std::from_chars(s.data(), s.data() + s.size(), v).ptr == s.data() + s.size();
+            };
 
-        bool any_alnum = false;
-        for (char c : name) if (std::isalnum(static_cast<unsigned char>(c))) { any_alnum = true; break; }
-        if (!any_alnum) name = "upload.bin";
+            ByteRange r;
+            if (a.empty()) {
+                // Suffix: the last `y` bytes.
+                if (!number(b, y)) return RangeParse::kIgnore;
+                if (y == 0 || size == 0) continue;
+                r.first = size - std::min(y, size);
+                r.last = size - 1;
+            }
+            else {
+                if (!number(a, x)) return RangeParse::kIgnore;
+                if (!b.empty() && (!number(b, y) || y < x)) return RangeParse::kIgnore;
+                if (x >= size) continue;
+                r.first = x;
+                r.last = b.empty() ? size - 1 : std::min(y, size - 1);
+            }
+            total += r.length();
+            out.push_back(r);
+        }
+        if (specs == 0) return RangeParse::kIgnore;
+        if (out.empty()) return RangeParse::kUnsatisfiable;
+        if (total > size) {
+            out.clear();
+            return RangeParse::kIgnore;
+        }
+        return RangeParse::kSatisfiable;
+    }
+
+    std::string http_date(std::time_t t) {
+        std::tm tm{};
+#ifdef _WIN32
+        gmtime_s(&tm, &t);
+#else
+        gmtime_r(&t, &tm);
+#endif
+        char buf[64];
+        std::strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        return buf;
+    }
 
-        return name;
+    std::time_t mtime_seconds(const std::filesystem::file_time_type& t) {
+        // file_clock has no portable conversion before C++20; both clocks
+        // tick at the same rate, so shift by their current difference and
+        // round away the microseconds that took.
+        const auto sys = std::chrono::round<std::chrono::seconds>(
+            t - std::filesystem::file_time_type::clock::now() + std::chrono::system_clock::now());
+        return std::chrono::system_clock::to_time_t(sys);
     }
 
-    std::string random_suffix() {
-        static thread_local std::mt19937_64 rng{ std::random_device{}() };
-        std::uniform_int_distribution<uint64_t> dist;
-        std::ostringstream oss;
-        oss << std::hex << dist(rng);
-        return oss.str();
+    const char* media_type(const std::filesystem::path& path) {
+        std::string ext = path.extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+        if (ext == ".mp4" || ext == ".m4v") return "video/mp4";
+        if (ext == ".webm") return "video/webm";
+        if (ext == ".mkv") return "video/x-matroska";
+        if (ext == ".mov") return "video/quicktime";
+        if (ext == ".avi") return "video/x-msvideo";
+        if (ext == ".ts") return "video/mp2t";
+        if (ext == ".jpg" || ext == ".jpeg") return "image/jpeg";
+        return "application/octet-stream";
     }
 
 } 
@@ -61,19 +173,61 @@ class HttpSession : public std::enable_shared_from_this<HttpSession> {
     http::request<http::buffer_body> req_;
     std::shared_ptr<void> res_;
 
-    std::string upload_path_;
-    std::string web_root_;
-
-    std::ofstream upload_file_;
+    std::shared_ptr<UploadRegistry> uploads_;
+    std::shared_ptr<MediaCatalog> catalog_;
+    std::shared_ptr<StaticAssetCache> assets_;
+    HttpServerOptions options_;
+    // Backs the span body of a static response until it is written.
+    std::shared_ptr<const StaticAsset> asset_;
+
+    // GET /media body after its header: literal bytes (multipart framing)
+    // or a file range, sent in order.
+    struct MediaSegment {
+        std::string bytes;
+        uint64_t offset = 0;
+        uint64_t length = 0;
+    };
+    std::shared_ptr<RandomAccessFile> media_file_;
+    std::vector<MediaSegment> media_segments_;
+    std::size_t media_index_{ 0 };
+    bool media_sendfile_{ false };
+    bool media_close_{ false };
+    std::vector<char> media_buf_;
+    net::steady_timer media_timer_;
+
+    // Target of the body being received: the whole file for /upload_raw, or
+    // a range of a chunked upload (chunk_id_ set) starting at chunk_offset_.
+    std::shared_ptr<RandomAccessFile> upload_file_;
+    std::string chunk_id_;
+    uint64_t chunk_offset_{ 0 };
     std::string upload_full_path_;
     std::size_t upload_bytes_written_{ 0 };
-    std::array<char, 64 * 1024> body_buf_{};
+    // /upload_raw only: fed in order by the write jobs, which never overlap.
+    std::shared_ptr<ContentHasher> upload_hasher_;
+
+    // Double buffering: upload_bufs_[filling_] takes socket reads while the
+    // other one may be on the file I/O pool. All of this is touched only on
+    // the session's strand; the pool thread sees a buffer after post().
+    std::array<std::vector<char>, 2> upload_bufs_;
+    int filling_{ 0 };
+    std::size_t fill_{ 0 };
+    uint64_t write_offset_{ 0 };
+    bool write_pending_{ false };
+    bool flush_waiting_{ false };
+    bool upload_finishing_{ false };
+    bool upload_failed_{ false };
+    std::chrono::steady_clock::time_point upload_started_;
+    std::chrono::steady_clock::time_point wait_started_;
 
 public:
-    HttpSession(tcp::socket&& socket, std::string upload_path, std::string web_root)
+    HttpSession(tcp::socket&& socket, std::shared_ptr<UploadRegistry> uploads, std::shared_ptr<MediaCatalog> catalog,
+        std::shared_ptr<StaticAssetCache> assets, HttpServerOptions options)
         : stream_(std::move(socket))
-        , upload_path_(std::move(upload_path))
-        , web_root_(std::move(web_root))
+        , uploads_(std::move(uploads))
+        , catalog_(std::move(catalog))
+        , assets_(std::move(assets))
+        , options_(options)
+        , media_timer_(stream_.get_executor())
     {
     }
 
@@ -86,7 +240,7 @@ private:
     void do_read() {
         parser_ = std::make_unique<http::request_parser<http::buffer_body>>();
  
-        parser_->body_limit(500 * 1024 * 1024);
+        parser_->body_limit(options_.upload_body_limit);
 
         stream_.expires_after(std::chrono::seconds(300));
         buffer_.clear();
@@ -118,6 +272,12 @@ private:
             return begin_streaming_upload();
         }
 
+        std::string upload_id, action;
+        uint64_t offset = 0;
+        if (req_.method() == http::verb::put && parse_upload_target(target, upload_id, action, offset) && action.empty()) {
+            return begin_chunk_upload(upload_id, offset);
+        }
+
 
         handle_request_no_body();
     }
@@ -130,52 +290,76 @@ private:
         std::cout << "[HTTP] Content-Type: " << req_[http::field::content_type] << std::endl;
 
  
-        try {
-            std::filesystem::create_directories(upload_path_);
-        }
-        catch (...) {
-    
-        }
-
-     
         std::string client_name;
         auto it = req_.find("X-Filename");
-        if (it != req_.end()) {
-            client_name = sanitize_basename(std::string(it->value()));
-        }
+        if (it != req_.end()) client_name = std::string(it->value());
 
-    
-        const auto now = std::chrono::system_clock::now().time_since_epoch();
-        const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
-
-        std::string ext = ".bin";
-        if (!client_name.empty()) {
-            auto dot = client_name.find_last_of('.');
-            if (dot != std::string::npos && dot + 1 < client_name.size()) {
-                ext = client_name.substr(dot);
-                if (ext.size() > 16) ext = ".bin";
-            }
+        upload_full_path_ = uploads_->makeFilePath(client_name);
+        chunk_id_.clear();
+        upload_hasher_ = std::make_shared<ContentHasher>(uploads_->store().sha256());
+
+        upload_file_ = std::make_shared<RandomAccessFile>();
+        if (!upload_file_->open(upload_full_path_, RandomAccessFile::Mode::kWriteTruncate)) {
+            std::cerr << "[HTTP] ERROR: Cannot create file: " << upload_full_path_
+                << " (" << RandomAccessFile::lastError() << ")" << std::endl;
+            return send_simple_error(http::status::internal_server_error, "Cannot save file");
         }
 
-        std::string filename = "stream_" + std::to_string(ms) + "_" + random_suffix() + ext;
-        upload_full_path_ = upload_path_ + "/" + filename;
+        const auto length = parser_->content_length();
+        if (options_.preallocate_uploads && length && *length > 0 && !upload_file_->preallocate(*length)) {
+            std::cout << "[HTTP] Preallocation skipped: " << RandomAccessFile::lastError() << std::endl;
+        }
+        IngestRegistry::instance().begin(upload_full_path_, length ? *length : 0);
 
-        upload_file_.open(upload_full_path_, std::ios::binary);
-        upload_bytes_written_ = 0;
+        start_body_transfer(0);
+    }
 
-        if (!upload_file_) {
-            std::cerr << "[HTTP] ERROR: Cannot create file: " << upload_full_path_ << std::endl;
-            return send_simple_error(http::status::internal_server_error, "Cannot save file");
+    void begin_chunk_upload(const std::string& id, uint64_t offset) {
+        const auto length = parser_->content_length();
+        if (!length) return send_simple_error(http::status::length_required, "Content-Length required");
+
+        std::shared_ptr<RandomAccessFile> file;
+        switch (uploads_->beginChunk(id, offset, *length, file)) {
+        case UploadRegistry::ChunkResult::kUnknown:
+            return send_simple_error(http::status::not_found, "Unknown upload");
+        case UploadRegistry::ChunkResult::kComplete:
+            return send_simple_error(http::status::conflict, "Upload already complete");
+        case UploadRegistry::ChunkResult::kOutOfRange:
+            return send_simple_error(http::status::range_not_satisfiable, "Chunk outside upload");
+        default:
+            break;
         }
 
-    
+        parser_->body_limit(*length);
+        upload_file_ = std::move(file);
+        chunk_id_ = id;
+        chunk_offset_ = offset;
+        upload_full_path_.clear();
+        upload_hasher_.reset(); // the registry hashes chunked uploads
+        start_body_transfer(offset);
+    }
+
+    void start_body_transfer(uint64_t offset) {
+        upload_bytes_written_ = 0;
+        for (auto& buf : upload_bufs_) buf.resize(options_.upload_chunk_bytes);
+        filling_ = 0;
+        fill_ = 0;
+        write_offset_ = offset;
+        write_pending_ = false;
+        flush_waiting_ = false;
+        upload_finishing_ = false;
+        upload_failed_ = false;
+        upload_started_ = std::chrono::steady_clock::now();
+
+        if (parser_->is_done()) return flush_upload_buffer(); // empty body
         do_read_upload_body();
     }
 
     void do_read_upload_body() {
-        auto& preq = parser_->get();         
-        preq.body().data = body_buf_.data();
-        preq.body().size = body_buf_.size();
+        auto& preq = parser_->get();
+        auto& buf = upload_bufs_[filling_];
+        preq.body().data = buf.data() + fill_;
+        preq.body().size = buf.size() - fill_;
 
         http::async_read_some(stream_, buffer_, *parser_,
             beast::bind_front_handler(&HttpSession::on_read_upload_body, shared_from_this()));
@@ -184,56 +368,171 @@ private:
     void on_read_upload_body(beast::error_code ec, std::size_t bytes_transferred) {
         boost::ignore_unused(bytes_transferred);
 
-        if (ec == http::error::need_buffer) {
-      
-            return do_read_upload_body();
-        }
+        // need_buffer only means the buffer is full; flush it below.
+        if (ec == http::error::need_buffer) ec = {};
 
         if (ec == http::error::end_of_stream) {
-        
             std::cerr << "[HTTP] Client closed stream during upload" << std::endl;
-            upload_file_.close();
+            abandon_upload();
             return do_close();
         }
 
         if (ec) {
             std::cerr << "[HTTP ERR] Upload read error: " << ec.message() << std::endl;
-            upload_file_.close();
+            abandon_upload();
             return fail(ec, "upload_read");
         }
 
-        auto& preq = parser_->get();
-        const std::size_t remaining = preq.body().size;
-        const std::size_t bytes_in_chunk = body_buf_.size() - remaining;
+        if (upload_failed_) return; // a write failed; the error response closes the connection
 
-        if (bytes_in_chunk > 0) {
-            upload_file_.write(body_buf_.data(), static_cast<std::streamsize>(bytes_in_chunk));
-            upload_bytes_written_ += bytes_in_chunk;
+        fill_ = upload_bufs_[filling_].size() - parser_->get().body().size;
+
+        if (parser_->is_done() || fill_ == upload_bufs_[filling_].size()) {
+            return flush_upload_buffer();
         }
+        do_read_upload_body();
+    }
+
+    void flush_upload_buffer() {
+        if (write_pending_) {
+            // Both buffers are in use; the socket waits for the disk.
+            flush_waiting_ = true;
+            wait_started_ = std::chrono::steady_clock::now();
+            return;
+        }
+
+        if (fill_ > 0) submit_upload_write(filling_, fill_);
+        filling_ ^= 1;
+        fill_ = 0;
 
         if (parser_->is_done()) {
-            upload_file_.close();
+            upload_finishing_ = true;
+            if (!write_pending_) finish_upload();
+            return;
+        }
+        do_read_upload_body();
+    }
+
+    void submit_upload_write(int index, std::size_t len) {
+        write_pending_ = true;
+        const uint64_t offset = write_offset_;
+        write_offset_ += len;
+
+        // The file is captured, not read through the session, so a failed
+        // request can drop upload_file_ while this write is still running.
+        net::post(fileIoPool(), [self = shared_from_this(), file = upload_file_, hasher = upload_hasher_, index, len, offset]() {
+            const auto t0 = std::chrono::steady_clock::now();
+            const bool ok = file->writeAt(offset, self->upload_bufs_[index].data(), len);
+            const std::string error = ok ? std::string() : RandomAccessFile::lastError();
+            const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            // The buffer is still hot in cache; hashing it here is cheaper
+            // than reading the file back later.
+            if (ok && hasher) hasher->update(self->upload_bufs_[index].data(), len);
+            net::post(self->stream_.get_executor(), [self, ok, offset, len, ms, error]() {
+                self->on_upload_written(ok, offset, len, ms, error);
+            });
+        });
+    }
+
+    void on_upload_written(bool ok, uint64_t offset, std::size_t len, double write_ms, const std::string& error) {
+        static auto& write_hist = Metrics::instance().histogram("upload_disk_write_ms", { 1, 2, 5, 10, 25, 50, 100, 250, 1000 });
+        static auto& wait_hist = Metrics::instance().histogram("upload_disk_wait_ms", { 1, 2, 5, 10, 25, 50, 100, 250, 1000 });
+        static auto& bytes_total = Metrics::instance().counter("upload_bytes_total");
+
+        write_pending_ = false;
+        write_hist.observe(write_ms);
+
+        if (ok && !chunk_id_.empty()) uploads_->markReceived(chunk_id_, offset, len);
+        if (upload_failed_) return;
+
+        if (!ok) {
+            std::cerr << "[HTTP] ERROR: Write failed for "
+                << (chunk_id_.empty() ? upload_full_path_ : "upload " + chunk_id_) << ": " << error << std::endl;
+            abandon_upload();
+            return send_simple_error(http::status::internal_server_error, "Cannot save file");
+        }
+        // Writes land in order here, so the end of this one is the committed prefix.
+        if (chunk_id_.empty()) IngestRegistry::instance().commit(upload_full_path_, offset + len);
+
+        upload_bytes_written_ += len;
+        bytes_total.inc(len);
+
+        if (flush_waiting_) {
+            flush_waiting_ = false;
+            wait_hist.observe(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wait_started_).count());
+            return flush_upload_buffer();
+        }
+        if (upload_finishing_) finish_upload();
+    }
+
+    void abandon_upload() {
+        upload_failed_ = true;
+        upload_file_.reset();
+        upload_hasher_.reset();
+        // A chunk leaves its upload open for another attempt; a one-shot
+        // upload is over and anyone playing it must stop waiting.
+        if (chunk_id_.empty()) IngestRegistry::instance().finish(upload_full_path_, false);
+    }
+
+    void finish_upload() {
+        static auto& throughput = Metrics::instance().histogram("upload_throughput_mbps", { 10, 25, 50, 100, 250, 500, 1000, 2500 });
+
+        upload_file_.reset();
+        // Idle keep-alive connections should not sit on two chunk buffers.
+        for (auto& buf : upload_bufs_) std::vector<char>().swap(buf);
+
+        const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - upload_started_).count();
+        if (secs > 0.0) throughput.observe(upload_bytes_written_ * 8.0 / 1e6 / secs);
+
+        if (!upload_hasher_) return send_upload_response(std::string(), false);
+
+        // Linking into the content store touches the filesystem.
+        net::post(fileIoPool(), [self = shared_from_this(), hasher = std::move(upload_hasher_), path = upload_full_path_]() {
+            auto& store = self->uploads_->store();
+            const std::string key = store.keyFor(hasher->finish());
+            const bool duplicate = store.publish(key, path);
+            net::post(self->stream_.get_executor(), [self, key, duplicate]() {
+                self->send_upload_response(key, duplicate);
+            });
+        });
+    }
+
+    void send_upload_response(const std::string& content_key, bool duplicate) {
+        static auto& dedup_hits = Metrics::instance().counter("upload_dedup_total", "via=\"content\"");
+        static auto& dedup_bytes = Metrics::instance().counter("upload_dedup_bytes_total");
+
+        json response_json;
+        response_json["status"] = "ok";
+        response_json["size"] = upload_bytes_written_;
+
+        if (chunk_id_.empty()) {
             std::cout << "[HTTP] SUCCESS File saved: " << upload_full_path_
-                << " (" << upload_bytes_written_ << " bytes)" << std::endl;
+                << " (" << upload_bytes_written_ << " bytes" << (duplicate ? ", duplicate" : "") << ")" << std::endl;
             std::cout << "[HTTP] ======================================" << std::endl;
-
-            json response_json;
-            response_json["status"] = "ok";
+            IngestRegistry::instance().finish(upload_full_path_, true);
+            catalog_->add(upload_full_path_);
             response_json["file_path"] = upload_full_path_;
-            response_json["size"] = upload_bytes_written_;
-
-            auto res = std::make_shared<http::response<http::string_body>>(
-                http::status::ok, req_.version());
-            res->set(http::field::server, BOOST_BEAST_VERSION_STRING);
-            res->set(http::field::content_type, "application/json");
-            res->set(http::field::access_control_allow_origin, "*");
-            res->keep_alive(parser_->get().keep_alive());
-            res->body() = response_json.dump();
-            res->prepare_payload();
-            return send_response(res);
+            response_json["content_hash"] = content_key;
+            response_json["deduplicated"] = duplicate;
+            if (duplicate) {
+                dedup_hits.inc();
+                dedup_bytes.inc(upload_bytes_written_);
+            }
+        }
+        else {
+            response_json["upload_id"] = chunk_id_;
+            response_json["offset"] = chunk_offset_;
         }
 
-        do_read_upload_body();
+        auto res = std::make_shared<http::response<http::string_body>>(
+            http::status::ok, req_.version());
+        res->set(http::field::server, BOOST_BEAST_VERSION_STRING);
+        res->set(http::field::content_type, "application/json");
+        res->set(http::field::access_control_allow_origin, "*");
+        res->keep_alive(parser_->get().keep_alive());
+        res->body() = response_json.dump();
+        res->prepare_payload();
+        return send_response(res);
     }
 
     void handle_request_no_body() {
@@ -254,76 +553,63 @@ private:
                 http::status::ok, req_.version());
             res->set(http::field::server, BOOST_BEAST_VERSION_STRING);
             res->set(http::field::access_control_allow_origin, "*");
-            res->set(http::field::access_control_allow_methods, "GET, PUT, POST, OPTIONS");
-            res->set(http::field::access_control_allow_headers, "Content-Type, X-Filename");
+            res->set(http::field::access_control_allow_methods, "GET, HEAD, PUT, POST, OPTIONS");
+            res->set(http::field::access_control_allow_headers, "Content-Type, X-Filename, X-Upload-Length, X-Content-Hash, Range, If-Range");
             res->keep_alive(req_.keep_alive());
             res->prepare_payload();
             return send_response(res);
         }
 
-        if (req_.method() == http::verb::get && req_.target() == "/favicon.ico") {
+        if (req_.method() == http::verb::get && req_.target() == "/metrics") {
             auto res = std::make_shared<http::response<http::string_body>>(
-                http::status::no_content, req_.version());
+                http::status::ok, req_.version());
             res->set(http::field::server, BOOST_BEAST_VERSION_STRING);
+            res->set(http::field::content_type, "text/plain; version=0.0.4");
             res->set(http::field::access_control_allow_origin, "*");
+            res->set("Cache-Control", "no-store");
             res->keep_alive(req_.keep_alive());
+            res->body() = Metrics::instance().render();
             res->prepare_payload();
             return send_response(res);
         }
 
-        if (req_.method() == http::verb::get && (req_.target() == "/" || req_.target() == "/index.html")) {
-            std::string path = web_root_ + "/index.html";
-            std::ifstream file(path, std::ios::binary);
-            if (!file) {
-                std::cerr << "[HTTP] index.html not found at: " << path << std::endl;
-                return send_response(bad_request("index.html not found"));
-            }
 
-            std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (req_.method() == http::verb::get && req_.target() == "/files") {
+            // Straight from the catalog's cached listing; no file is opened.
+            auto listing = catalog_->listing();
             auto res = std::make_shared<http::response<http::string_body>>(
                 http::status::ok, req_.version());
             res->set(http::field::server, BOOST_BEAST_VERSION_STRING);
-            res->set(http::field::content_type, "text/html; charset=utf-8");
+            res->set(http::field::content_type, "application/json");
             res->set(http::field::access_control_allow_origin, "*");
-            res->set(http::field::access_control_allow_methods, "GET, PUT, OPTIONS");
-            res->set(http::field::access_control_allow_headers, "*");
-            res->set("Content-Security-Policy",
-                "default-src * 'unsafe-inline' 'unsafe-eval' data: blob:; "
-                "script-src * 'unsafe-inline' 'unsafe-eval'; "
-                "connect-src * ws: wss:; "
-                "style-src * 'unsafe-inline';");
-            res->set("X-Content-Type-Options", "nosniff");
-            res->set("X-Frame-Options", "SAMEORIGIN");
+            res->set("Cache-Control", "no-store");
             res->keep_alive(req_.keep_alive());
-            res->body() = content;
+            res->body() = *listing;
             res->prepare_payload();
             return send_response(res);
         }
 
-        if (req_.method() == http::verb::get && req_.target() == "/client.js") {
-            std::string path = web_root_ + "/client.js";
-            std::ifstream file(path, std::ios::binary);
-            if (!file) {
-                std::cerr << "[HTTP] client.js not found at: " << path << std::endl;
-                return send_response(bad_request("client.js not found"));
-            }
+        if ((req_.method() == http::verb::get || req_.method() == http::verb::head) &&
+            req_.target().starts_with("/thumbs/")) {
+            beast::string_view name = req_.target().substr(8);
+            name = name.substr(0, name.find('?'));
+            const std::string path = catalog_->spritePath(std::string(name));
+            if (path.empty()) return send_simple_error(http::status::not_found, "No thumbnail");
+            return serve_media(path);
+        }
 
-            std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-            auto res = std::make_shared<http::response<http::string_body>>(
-                http::status::ok, req_.version());
-            res->set(http::field::server, BOOST_BEAST_VERSION_STRING);
-            res->set(http::field::content_type, "application/javascript; charset=utf-8");
-            res->set(http::field::access_control_allow_origin, "*");
-            res->set(http::field::access_control_allow_methods, "GET, PUT, OPTIONS");
-            res->set(http::field::access_control_allow_headers, "*");
-            res->set("X-Content-Type-Options", "nosniff");
-            res->set("Cache-Control", "no-cache, no-store, must-revalidate");
-            res->keep_alive(req_.keep_alive());
-            res->body() = content;
-            res->prepare_payload();
-            return send_response(res);
+        if (req_.method() == http::verb::post && req_.target() == "/uploads") {
+            return create_upload();
         }
 
+        {
+            std::string upload_id, action;
+            uint64_t offset = 0;
+            if (parse_upload_target(req_.target(), upload_id, action, offset)) {
+                if (req_.method() == http::verb::get && action.empty()) return upload_status(upload_id);
+                if (req_.method() == http::verb::post && action == "complete") return complete_upload(upload_id);
+            }
+        }
 
         if (req_.method() == http::verb::post && req_.target() == "/upload") {
             json j;
@@ -341,17 +627,477 @@ private:
             return send_response(res);
         }
 
+        if ((req_.method() == http::verb::get || req_.method() == http::verb::head) &&
+            req_.target().starts_with("/media/")) {
+            beast::string_view id = req_.target().substr(7);
+            id = id.substr(0, id.find('?'));
+            const std::string path = catalog_->mediaPath(std::string(id));
+            if (path.empty()) return send_simple_error(http::status::not_found, "No such media");
+            return serve_media(path);
+        }
+
+        if (req_.method() == http::verb::get || req_.method() == http::verb::head) {
+            const beast::string_view target = req_.target();
+            if (auto asset = assets_->find(std::string_view(target.data(), target.size()))) return send_static(std::move(asset));
+        }
+
+        if (req_.method() == http::verb::get && req_.target() == "/favicon.ico") {
+            auto res = std::make_shared<http::response<http::string_body>>(
+                http::status::no_content, req_.version());
+            res->set(http::field::server, BOOST_BEAST_VERSION_STRING);
+            res->set(http::field::access_control_allow_origin, "*");
+            res->keep_alive(req_.keep_alive());
+            res->prepare_payload();
+            return send_response(res);
+        }
+
         std::cerr << "[HTTP] Unknown request: " << req_.method_string()
             << " " << req_.target() << std::endl;
         return send_response(bad_request("Unknown request"));
     }
 
+    // POST /uploads with X-Filename and X-Upload-Length; chunks then go to
+    // PUT /uploads/<id>?offset=N in any order and over any connections.
+    // With X-Content-Hash naming content the store already has, the answer
+    // is the finished file right away and no body is sent at all.
+    void create_upload() {
+        uint64_t size = 0;
+        const auto length_header = req_["X-Upload-Length"];
+        if (length_header.empty() ||
+            std::from_chars(length_header.data(), length_header.data() + length_header.size(), size).ec != std::errc()) {
+            return send_simple_error(http::status::bad_request, "X-Upload-Length required");
+        }
+        if (size > options_.max_upload_bytes) {
+            return send_simple_error(http::status::payload_too_large, "Upload too large");
+        }
+
+        std::string client_name;
+        auto it = req_.find("X-Filename");
+        if (it != req_.end()) client_name = std::string(it->value());
+
+        std::string content_key;
+        const auto hash_header = req_["X-Content-Hash"];
+        if (!hash_header.empty()) content_key = uploads_->store().keyFromHeader(std::string_view(hash_header.data(), hash_header.size()), size);
+
+        // Either way this creates a file: a link or a preallocated one.
+        net::post(fileIoPool(), [self = shared_from_this(), client_name, size, content_key]() {
+            auto& uploads = *self->uploads_;
+            std::string linked;
+            std::shared_ptr<UploadRegistry::Upload> upload;
+            if (!content_key.empty()) {
+                const std::string path = uploads.makeFilePath(client_name);
+                if (uploads.store().linkExisting(content_key, size, path)) linked = path;
+            }
+            if (linked.empty()) upload = uploads.create(client_name, size);
+            net::post(self->stream_.get_executor(), [self, size, content_key, linked, upload]() {
+                self->on_upload_created(size, content_key, linked, upload);
+            });
+        });
+    }
+
+    void on_upload_created(uint64_t size, const std::string& content_key, const std::string& linked,
+        const std::shared_ptr<UploadRegistry::Upload>& upload) {
+        static auto& dedup_hits = Metrics::instance().counter("upload_dedup_total", "via=\"hash_hint\"");
+        static auto& dedup_bytes = Metrics::instance().counter("upload_dedup_bytes_total");
+
+        if (!linked.empty()) {
+            std::cout << "[HTTP] Upload skipped, content already stored: " << content_key << " -> " << linked << std::endl;
+            dedup_hits.inc();
+            dedup_bytes.inc(size);
+            catalog_->add(linked);
+
+            json j;
+            j["status"] = "ok";
+            j["file_path"] = linked;
+            j["size"] = size;
+            j["content_hash"] = content_key;
+            j["deduplicated"] = true;
+            return send_json(http::status::ok, j);
+        }
+        if (!upload) return send_simple_error(http::status::internal_server_error, "Cannot save file");
+
+        // The file can be streamed while the chunks are still arriving.
+        json j;
+        j["upload_id"] = upload->id;
+        j["file_path"] = upload->file_path;
+        j["size"] = upload->size;
+        j["chunk_size"] = options_.upload_chunk_hint;
+        send_json(http::status::created, j);
+    }
+
+    void upload_status(const std::string& id) {
+        UploadRegistry::Status st;
+        if (!uploads_->status(id, st)) return send_simple_error(http::status::not_found, "Unknown upload");
+
+        json ranges = json::array();
+        for (const auto& r : st.received) ranges.push_back({ r.first, r.second });
+
+        json j;
+        j["upload_id"] = st.id;
+        j["file_path"] = st.file_path;
+        j["size"] = st.size;
+        j["received_bytes"] = st.received_bytes;
+        j["received"] = ranges;
+        j["complete"] = st.complete;
+        send_json(http::status::ok, j);
+    }
+
+    void complete_upload(const std::string& id) {
+        auto done = [self = shared_from_this()](const UploadRegistry::Status& st) {
+            net::post(self->stream_.get_executor(), [self, st]() { self->on_upload_completed(st); });
+        };
+
+        UploadRegistry::Status st;
+        switch (uploads_->complete(id, done, st)) {
+        case UploadRegistry::CompleteResult::kUnknown:
+            return send_simple_error(http::status::not_found, "Unknown upload");
+        case UploadRegistry::CompleteResult::kIncomplete: {
+            json j;
+            j["status"] = "incomplete";
+            j["received_bytes"] = st.received_bytes;
+            j["size"] = st.size;
+            return send_json(http::status::conflict, j);
+        }
+        case UploadRegistry::CompleteResult::kBusy: {
+            // A chunk is still being written; the client retries shortly.
+            json j;
+            j["status"] = "busy";
+            return send_json(http::status::conflict, j);
+        }
+        default:
+            break; // answered from on_upload_completed
+        }
+    }
+
+    void on_upload_completed(const UploadRegistry::Status& st) {
+        catalog_->add(st.file_path);
+
+        json j;
+        j["status"] = "ok";
+        j["file_path"] = st.file_path;
+        j["size"] = st.size;
+        j["content_hash"] = st.content_key;
+        j["deduplicated"] = st.deduplicated;
+        send_json(http::status::ok, j);
+    }
+
+    // GET/HEAD of a file the catalog resolved: an upload (/media/<id>) or a
+    // thumbnail sprite (/thumbs/<name>). Range (one range or
+    // multipart/byteranges), If-Range and If-None-Match; the body goes out
+    // through sendfile or the file I/O pool, never read on this thread.
+    void serve_media(const std::string& path) {
+        static auto& full = Metrics::instance().counter("http_media_responses_total", "status=\"200\"");
+        static auto& partial = Metrics::instance().counter("http_media_responses_total", "status=\"206\"");
+        static auto& not_modified = Metrics::instance().counter("http_media_responses_total", "status=\"304\"");
+        static auto& unsatisfiable = Metrics::instance().counter("http_media_responses_total", "status=\"416\"");
+
+        auto file = std::make_shared<RandomAccessFile>();
+        std::error_code ec;
+        const auto mtime = std::filesystem::last_write_time(path, ec);
+        if (ec || !file->open(path, RandomAccessFile::Mode::kRead)) {
+            return send_simple_error(http::status::not_found, "No such media");
+        }
+        const int64_t signed_size = file->size();
+        if (signed_size < 0) return send_simple_error(http::status::internal_server_error, "Cannot stat media");
+        const uint64_t size = static_cast<uint64_t>(signed_size);
+
+        // Strong validators: a replaced upload changes size or mtime.
+        const std::string etag = "\"" + toHex(size) + "-" +
+            toHex(static_cast<uint64_t>(mtime.time_since_epoch().count())) + "\"";
+        const std::string last_modified = http_date(mtime_seconds(mtime));
+
+        std::vector<ByteRange> ranges;
+        RangeParse parsed = RangeParse::kIgnore;
+        const auto range_header = req_.find(http::field::range);
+        if (range_header != req_.end()) {
+            parsed = parse_ranges(range_header->value(), size, ranges);
+            const auto if_range = req_.find(http::field::if_range);
+            if (if_range != req_.end()) {
+                // An ETag must match strongly, a date exactly; otherwise the
+                // client's partial copy is stale and gets the whole file.
+                const beast::string_view v = if_range->value();
+                const bool current = !v.empty() && v.front() == '"' ? v == etag : v == last_modified;
+                if (!current) parsed = RangeParse::kIgnore;
+            }
+        }
+
+        auto res = std::make_shared<http::response<http::empty_body>>(http::status::ok, req_.version());
+        res->set(http::field::server, BOOST_BEAST_VERSION_STRING);
+        res->set(http::field::access_control_allow_origin, "*");
+        res->set(http::field::access_control_expose_headers, "Content-Range, Accept-Ranges, ETag, Last-Modified");
+        res->set(http::field::accept_ranges, "bytes");
+        res->set(http::field::etag, etag);
+        res->set(http::field::last_modified, last_modified);
+        res->set(http::field::cache_control, "no-cache");
+        res->keep_alive(req_.keep_alive());
+
+        const beast::string_view if_none_match = req_[http::field::if_none_match];
+        if (StaticAssetCache::notModified(std::string_view(if_none_match.data(), if_none_match.size()), etag)) {
+            not_modified.inc();
+            res->result(http::status::not_modified);
+            return send_response(res);
+        }
+
+        if (parsed == RangeParse::kUnsatisfiable) {
+            unsatisfiable.inc();
+            res->result(http::status::range_not_satisfiable);
+            res->set(http::field::content_range, "bytes */" + std::to_string(size));
+            res->content_length(0);
+            return send_response(res);
+        }
+
+        const char* type = media_type(path);
+        std::vector<MediaSegment> segments;
+        uint64_t length = 0;
+        if (parsed == RangeParse::kIgnore) {
+            full.inc();
+            res->set(http::field::content_type, type);
+            segments.push_back(MediaSegment{ {}, 0, size });
+            length = size;
+        }
+        else if (ranges.size() == 1) {
+            partial.inc();
+            res->result(http::status::partial_content);
+            res->set(http::field::content_type, type);
+            res->set(http::field::content_range, "bytes " + std::to_string(ranges[0].first) + "-" +
+                std::to_string(ranges[0].last) + "/" + std::to_string(size));
+            segments.push_back(MediaSegment{ {}, ranges[0].first, ranges[0].length() });
+            length = ranges[0].length();
+        }
+        else {
+            partial.inc();
+            res->result(http::status::partial_content);
+            const std::string boundary = toHex(Xxh64::hash(etag.data(), etag.size(),
+                static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count())));
+            res->set(http::field::content_type, "multipart/byteranges; boundary=" + boundary);
+            for (const auto& r : ranges) {
+                MediaSegment head;
+                head.bytes = "\r\n--" + boundary + "\r\nContent-Type: " + type + "\r\nContent-Range: bytes " +
+                    std::to_string(r.first) + "-" + std::to_string(r.last) + "/" + std::to_string(size) + "\r\n\r\n";
+                length += head.bytes.size() + r.length();
+                segments.push_back(std::move(head));
+                segments.push_back(MediaSegment{ {}, r.first, r.length() });
+            }
+            segments.push_back(MediaSegment{ "\r\n--" + boundary + "--\r\n", 0, 0 });
+            length += segments.back().bytes.size();
+        }
+        res->content_length(length);
+        if (req_.method() == http::verb::head || length == 0) return send_response(res);
+
+        media_file_ = std::move(file);
+        media_segments_ = std::move(segments);
+        media_index_ = 0;
+        media_sendfile_ = options_.media_sendfile;
+        media_close_ = res->need_eof();
+        res_ = res;
+        stream_.expires_after(std::chrono::seconds(60));
+        http::async_write(stream_, *res, [self = shared_from_this()](beast::error_code ec, std::size_t) {
+            if (ec) return self->fail(ec, "media header");
+            self->send_media();
+            });
+    }
+
+    // Next piece of the media body; each one comes back here when written.
+    void send_media() {
+        while (media_index_ < media_segments_.size()) {
+            MediaSegment& seg = media_segments_[media_index_];
+            if (!seg.bytes.empty()) {
+                stream_.expires_after(std::chrono::seconds(60));
+                net::async_write(stream_, net::buffer(seg.bytes),
+                    [self = shared_from_this()](beast::error_code ec, std::size_t) {
+                        if (ec) return self->fail(ec, "media write");
+                        ++self->media_index_;
+                        self->send_media();
+                    });
+                return;
+            }
+            if (seg.length == 0) {
+                ++media_index_;
+                continue;
+            }
+            return media_sendfile_ ? send_media_file() : read_media_chunk();
+        }
+
+        beast::error_code ec;
+        stream_.socket().native_non_blocking(false, ec);
+        media_file_.reset();
+        media_segments_.clear();
+        on_write(media_close_, {}, 0);
+    }
+
+    // Page cache to socket with sendfile until the socket is full, then
+    // waits for it to drain. Gives the thread up every few chunks so one
+    // fast client does not starve the others on this io_context.
+    void send_media_file() {
+        static auto& sent_bytes = Metrics::instance().counter("http_media_bytes_total", "path=\"sendfile\"");
+        constexpr int kChunksPerTurn = 16;
+
+        beast::error_code ec;
+        stream_.socket().native_non_blocking(true, ec);
+        MediaSegment& seg = media_segments_[media_index_];
+        for (int i = 0; i < kChunksPerTurn && seg.length > 0; ++i) {
+            bool would_block = false;
+            bool unsupported = false;
+            const std::size_t want = static_cast<std::size_t>(
+                std::min<uint64_t>(seg.length, options_.media_chunk_bytes));
+            const int64_t n = media_file_->sendTo(static_cast<std::uintptr_t>(stream_.socket().native_handle()),
+                seg.offset, want, would_block, unsupported);
+            if (would_block) return wait_media_writable();
+            if (n == 0) {
+                std::cerr << "[HTTP] Media file shrank while sending" << std::endl;
+                return do_close();
+            }
+            if (n < 0) {
+                if (!unsupported) {
+                    std::cerr << "[HTTP] Media send failed: " << RandomAccessFile::lastError() << std::endl;
+                    return do_close();
+                }
+                // No sendfile here, or not for this file system: reads from
+                // now on, for the rest of this connection too.
+                std::cerr << "[HTTP] sendfile unavailable (" << RandomAccessFile::lastError()
+                    << "), falling back to buffered reads" << std::endl;
+                media_sendfile_ = false;
+                options_.media_sendfile = false;
+                stream_.socket().native_non_blocking(false, ec);
+                return read_media_chunk();
+            }
+            seg.offset += static_cast<uint64_t>(n);
+            seg.length -= static_cast<uint64_t>(n);
+            sent_bytes.inc(static_cast<uint64_t>(n));
+        }
+        if (seg.length == 0) ++media_index_;
+        net::post(stream_.get_executor(), beast::bind_front_handler(&HttpSession::send_media, shared_from_this()));
+    }
+
+    // The socket wait is not covered by the stream's timeout, so it gets
+    // its own: a client that stops reading is dropped.
+    void wait_media_writable() {
+        media_timer_.expires_after(std::chrono::seconds(60));
+        media_timer_.async_wait([self = shared_from_this()](beast::error_code ec) {
+            if (ec == net::error::operation_aborted) return;
+            std::cerr << "[HTTP] Media client stopped reading" << std::endl;
+            beast::error_code ignored;
+            self->stream_.socket().cancel(ignored);
+            });
+        stream_.socket().async_wait(tcp::socket::wait_write, [self = shared_from_this()](beast::error_code ec) {
+            self->media_timer_.cancel();
+            if (ec) return self->fail(ec, "media wait");
+            self->send_media();
+            });
+    }
+
+    // Buffered path: pread on the file I/O pool, then an ordinary write.
+    void read_media_chunk() {
+        const MediaSegment& seg = media_segments_[media_index_];
+        const std::size_t len = static_cast<std::size_t>(std::min<uint64_t>(seg.length, options_.media_chunk_bytes));
+        media_buf_.resize(options_.media_chunk_bytes);
+        // media_buf_ is only touched by the pool job until it posts back.
+        net::post(fileIoPool(), [self = shared_from_this(), file = media_file_, offset = seg.offset, len]() {
+            const int64_t n = file->readAt(offset, self->media_buf_.data(), len);
+            const std::string error = n < 0 ? RandomAccessFile::lastError() : std::string();
+            net::post(self->stream_.get_executor(), [self, n, error]() {
+                static auto& sent_bytes = Metrics::instance().counter("http_media_bytes_total", "path=\"buffered\"");
+                if (n <= 0) {
+                    std::cerr << "[HTTP] Media read failed: " << (n < 0 ? error : "unexpected EOF") << std::endl;
+                    return self->do_close();
+                }
+                self->stream_.expires_after(std::chrono::seconds(60));
+                net::async_write(self->stream_, net::buffer(self->media_buf_.data(), static_cast<std::size_t>(n)),
+                    [self, n](beast::error_code ec, std::size_t) {
+                        if (ec) return self->fail(ec, "media write");
+                        MediaSegment& seg = self->media_segments_[self->media_index_];
+                        seg.offset += static_cast<uint64_t>(n);
+                        seg.length -= static_cast<uint64_t>(n);
+                        sent_bytes.inc(static_cast<uint64_t>(n));
+                        if (seg.length == 0) ++self->media_index_;
+                        self->send_media();
+                    });
+                });
+            });
+    }
+
+    // A web root file from the cache: the encoding the client accepts, 304
+    // when its ETag is current. Nothing is read from disk or compressed here.
+    void send_static(std::shared_ptr<const StaticAsset> asset) {
+        static auto& ok = Metrics::instance().counter("http_static_responses_total", "status=\"200\"");
+        static auto& not_modified = Metrics::instance().counter("http_static_responses_total", "status=\"304\"");
+        static auto& identity_bytes = Metrics::instance().counter("http_static_bytes_total", "encoding=\"identity\"");
+        static auto& gzip_bytes = Metrics::instance().counter("http_static_bytes_total", "encoding=\"gzip\"");
+        static auto& br_bytes = Metrics::instance().counter("http_static_bytes_total", "encoding=\"br\"");
+
+        const beast::string_view accept = req_[http::field::accept_encoding];
+        const beast::string_view if_none_match = req_[http::field::if_none_match];
+        const auto encoding = StaticAssetCache::negotiate(*asset, std::string_view(accept.data(), accept.size()));
+        const auto& variant = asset->variant(encoding);
+        const bool fresh = StaticAssetCache::notModified(
+            std::string_view(if_none_match.data(), if_none_match.size()), variant.etag);
+
+        auto headers = [&](auto& res) {
+            res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+            res.set(http::field::etag, variant.etag);
+            // Unversioned URLs: always revalidate, which costs a 304.
+            res.set(http::field::cache_control, "no-cache");
+            if (!asset->gzip.body.empty() || !asset->brotli.body.empty()) {
+                res.set(http::field::vary, "Accept-Encoding");
+            }
+            res.set(http::field::access_control_allow_origin, "*");
+            res.keep_alive(req_.keep_alive());
+            if (fresh) return;
+
+            res.set(http::field::content_type, asset->content_type);
+            if (encoding == StaticAsset::Encoding::kGzip) res.set(http::field::content_encoding, "gzip");
+            if (encoding == StaticAsset::Encoding::kBrotli) res.set(http::field::content_encoding, "br");
+            res.set("X-Content-Type-Options", "nosniff");
+            if (asset->html) {
+                res.set("Content-Security-Policy",
+                    "default-src * 'unsafe-inline' 'unsafe-eval' data: blob:; "
+                    "script-src * 'unsafe-inline' 'unsafe-eval'; "
+                    "connect-src * ws: wss:; "
+                    "style-src * 'unsafe-inline';");
+                res.set("X-Frame-Options", "SAMEORIGIN");
+            }
+            };
+
+        if (fresh || req_.method() == http::verb::head) {
+            auto res = std::make_shared<http::response<http::empty_body>>(
+                fresh ? http::status::not_modified : http::status::ok, req_.version());
+            headers(*res);
+            if (!fresh) res->content_length(variant.body.size());
+            (fresh ? not_modified : ok).inc();
+            return send_response(res);
+        }
+
+        auto res = std::make_shared<http::response<http::span_body<const char>>>(
+            http::status::ok, req_.version());
+        headers(*res);
+        res->body() = http::span_body<const char>::value_type(variant.body.data(), variant.body.size());
+        res->prepare_payload();
+        ok.inc();
+        (encoding == StaticAsset::Encoding::kGzip ? gzip_bytes
+            : encoding == StaticAsset::Encoding::kBrotli ? br_bytes : identity_bytes).inc(variant.body.size());
+        asset_ = std::move(asset);
+        send_response(res);
+    }
+
+    void send_json(http::status st, const json& j) {
+        auto res = std::make_shared<http::response<http::string_body>>(st, req_.version());
+        res->set(http::field::server, BOOST_BEAST_VERSION_STRING);
+        res->set(http::field::content_type, "application/json");
+        res->set(http::field::access_control_allow_origin, "*");
+        res->set("Cache-Control", "no-store");
+        res->keep_alive(req_.keep_alive() && parser_->is_done());
+        res->body() = j.dump();
+        res->prepare_payload();
+        send_response(res);
+    }
+
     void send_simple_error(http::status st, std::string msg) {
         auto res = std::make_shared<http::response<http::string_body>>(st, req_.version());
         res->set(http::field::server, BOOST_BEAST_VERSION_STRING);
         res->set(http::field::content_type, "text/plain");
         res->set(http::field::access_control_allow_origin, "*");
-        res->keep_alive(req_.keep_alive());
+        // An unread request body would be parsed as the next request.
+        res->keep_alive(req_.keep_alive() && parser_->is_done());
         res->body() = std::move(msg);
         res->prepare_payload();
         send_response(res);
@@ -377,6 +1123,7 @@ private:
         }
 
         res_ = nullptr;
+        asset_ = nullptr;
         do_read();
     }
 
@@ -392,10 +1139,13 @@ private:
 };
 
 HttpServer::HttpServer(net::io_context& ioc, tcp::endpoint endpoint,
-    std::string upload_path, std::string web_root)
+    std::shared_ptr<UploadRegistry> uploads, std::shared_ptr<MediaCatalog> catalog,
+    std::shared_ptr<StaticAssetCache> assets, bool reuse_port, HttpServerOptions options)
     : acceptor_(net::make_strand(ioc))
-    , upload_path_(std::move(upload_path))
-    , web_root_(std::move(web_root))
+    , uploads_(std::move(uploads))
+    , catalog_(std::move(catalog))
+    , assets_(std::move(assets))
+    , options_(options)
 {
     beast::error_code ec;
 
@@ -410,6 +1160,14 @@ HttpServer::HttpServer(net::io_context& ioc, tcp::endpoint endpoint,
         std::cerr << "[HTTP] Set option error: " << ec.message() << std::endl;
     }
 
+    if (reuse_port) {
+        setReusePort(acceptor_, ec);
+        if (ec) {
+            std::cerr << "[HTTP] SO_REUSEPORT error: " << ec.message() << std::endl;
+            return;
+        }
+    }
+
     acceptor_.bind(endpoint, ec);
     if (ec) {
         std::cerr << "[HTTP] Bind error: " << ec.message() << std::endl;
@@ -441,7 +1199,7 @@ void HttpServer::on_accept(beast::error_code ec, tcp::socket socket) {
     }
     else {
         std::cout << "[HTTP] New connection accepted" << std::endl;
-        std::make_shared<HttpSession>(std::move(socket), upload_path_, web_root_)->run();
+        std::make_shared<HttpSession>(std::move(socket), uploads_, catalog_, assets_, options_)->run();
     }
 
     do_accept();
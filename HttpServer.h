@@ -3,6 +3,7 @@
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/asio.hpp>
+#include <cstdint>
 #include <string>
 #include <memory>
 #include <filesystem>
@@ -12,17 +13,39 @@ namespace http = beast::http;
 namespace net = boost::asio;
 using tcp = net::ip::tcp;
 
+struct HttpServerOptions {
+    // Upload body is read into two buffers of this size: one fills from the
+    // socket while the other is written out on the file I/O pool.
+    std::size_t upload_chunk_bytes = 1024 * 1024;
+    uint64_t upload_body_limit = 500ull * 1024 * 1024; // one-shot PUT /upload_raw
+    uint64_t max_upload_bytes = 64ull * 1024 * 1024 * 1024; // chunked uploads
+    std::size_t upload_chunk_hint = 8 * 1024 * 1024;    // suggested to chunked clients
+    bool preallocate_uploads = true; // from Content-Length
+    // GET /media/<id> bodies: sendfile where the platform has it; false
+    // reads through the file I/O pool instead, e.g. to compare the two.
+    bool media_sendfile = true;
+    std::size_t media_chunk_bytes = 256 * 1024; // per read, or per sendfile call
+};
+
+class UploadRegistry;
+class MediaCatalog;
+class StaticAssetCache;
+
 class HttpServer : public std::enable_shared_from_this<HttpServer> {
     tcp::acceptor acceptor_;
-    std::string upload_path_;
-    std::string web_root_; 
+    std::shared_ptr<UploadRegistry> uploads_;
+    std::shared_ptr<MediaCatalog> catalog_;
+    std::shared_ptr<StaticAssetCache> assets_;
+    HttpServerOptions options_;
 
     void do_accept();
     void on_accept(beast::error_code ec, tcp::socket socket);
 
 public:
     HttpServer(net::io_context& ioc, tcp::endpoint endpoint,
-        std::string upload_path, std::string web_root = "./web");
+        std::shared_ptr<UploadRegistry> uploads, std::shared_ptr<MediaCatalog> catalog,
+        std::shared_ptr<StaticAssetCache> assets, bool reuse_port = false,
+        HttpServerOptions options = HttpServerOptions());
 
     void run();
 };
\ No newline at end of file
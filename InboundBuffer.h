@@ -0,0 +1,119 @@
+#pragma once
+
+#include <boost/beast/core/flat_buffer.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Per-session pool of read buffers. A WebSocket frame is read straight into a
+// pooled flat_buffer and handed to the dispatcher as an InboundRef; when the
+// last ref goes away the buffer is emptied (capacity kept) and goes back on
+// the free list. Steady state reuses the same one or two buffers forever.
+class InboundBufferPool : public std::enable_shared_from_this<InboundBufferPool> {
+public:
+    class Ref;
+
+    class Buffer {
+    public:
+        boost::beast::flat_buffer& storage() { return storage_; }
+
+        std::string_view view() const {
+            const auto data = storage_.data();
+            return std::string_view(static_cast<const char*>(data.data()), data.size());
+        }
+
+    private:
+        friend class InboundBufferPool;
+        friend class Ref;
+
+        boost::beast::flat_buffer storage_;
+        std::atomic<uint32_t> refs_{ 0 };
+        // Held only while the buffer is out, so a session torn down with a
+        // message still in flight cannot strand it; free buffers hold nothing
+        // and the pool has no cycle.
+        std::shared_ptr<InboundBufferPool> owner_;
+    };
+
+    class Ref {
+    public:
+        Ref() = default;
+        explicit Ref(Buffer* b) : buf_(b) { if (buf_) buf_->refs_.fetch_add(1, std::memory_order_relaxed); }
+        Ref(const Ref& o) : Ref(o.buf_) {}
+        Ref(Ref&& o) noexcept : buf_(std::exchange(o.buf_, nullptr)) {}
+        Ref& operator=(Ref o) noexcept { std::swap(buf_, o.buf_); return *this; }
+        ~Ref() { reset(); }
+
+        void reset() {
+            Buffer* b = std::exchange(buf_, nullptr);
+            if (b && b->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                auto owner = std::move(b->owner_);
+                owner->release(b);
+            }
+        }
+
+        Buffer* get() const { return buf_; }
+        Buffer* operator->() const { return buf_; }
+        explicit operator bool() const { return buf_ != nullptr; }
+        std::string_view view() const { return buf_ ? buf_->view() : std::string_view(); }
+
+    private:
+        Buffer* buf_ = nullptr;
+    };
+
+    explicit InboundBufferPool(std::size_t max_free) : max_free_(max_free) {
+        free_.reserve(max_free_);
+    }
+
+    ~InboundBufferPool() {
+        for (Buffer* b : free_) delete b;
+    }
+
+    InboundBufferPool(const InboundBufferPool&) = delete;
+    InboundBufferPool& operator=(const InboundBufferPool&) = delete;
+
+    // `fresh` reports a pool miss, i.e. a buffer that had to be created.
+    Ref acquire(bool* fresh = nullptr) {
+        Buffer* b = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!free_.empty()) {
+                b = free_.back();
+                free_.pop_back();
+            }
+            ++outstanding_;
+        }
+        if (fresh) *fresh = (b == nullptr);
+        if (!b) b = new Buffer();
+        b->owner_ = shared_from_this();
+        return Ref(b);
+    }
+
+    std::size_t outstanding() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return outstanding_;
+    }
+
+private:
+    void release(Buffer* b) {
+        b->storage_.consume(b->storage_.size());
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --outstanding_;
+            if (free_.size() < max_free_) {
+                free_.push_back(b);
+                return;
+            }
+        }
+        delete b;
+    }
+
+    const std::size_t max_free_;
+    mutable std::mutex mutex_;
+    std::vector<Buffer*> free_;
+    std::size_t outstanding_ = 0;
+};
@@ -0,0 +1,66 @@
+#include "IngestRegistry.h"
+#include "Metrics.h"
+
+IngestFile::Progress IngestFile::progress() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return progress_;
+}
+
+IngestFile::Progress IngestFile::waitBeyond(uint64_t offset, std::chrono::milliseconds timeout) const {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait_for(lock, timeout, [&] { return progress_.committed > offset || progress_.finished; });
+    return progress_;
+}
+
+IngestRegistry& IngestRegistry::instance() {
+    static IngestRegistry registry;
+    return registry;
+}
+
+void IngestRegistry::begin(const std::string& path, uint64_t expected) {
+    static auto& active = Metrics::instance().gauge("ingest_files_active");
+
+    auto file = std::make_shared<IngestFile>();
+    file->progress_.expected = expected;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    files_[path] = std::move(file);
+    active.set(static_cast<double>(files_.size()));
+}
+
+void IngestRegistry::commit(const std::string& path, uint64_t committed) {
+    std::shared_ptr<IngestFile> file = find(path);
+    if (!file) return;
+    {
+        std::lock_guard<std::mutex> lock(file->mutex_);
+        if (committed <= file->progress_.committed) return;
+        file->progress_.committed = committed;
+    }
+    file->cv_.notify_all();
+}
+
+void IngestRegistry::finish(const std::string& path, bool ok) {
+    static auto& active = Metrics::instance().gauge("ingest_files_active");
+
+    std::shared_ptr<IngestFile> file;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = files_.find(path);
+        if (it == files_.end()) return;
+        file = std::move(it->second);
+        files_.erase(it);
+        active.set(static_cast<double>(files_.size()));
+    }
+    {
+        std::lock_guard<std::mutex> lock(file->mutex_);
+        file->progress_.finished = true;
+        file->progress_.failed = !ok;
+    }
+    file->cv_.notify_all();
+}
+
+std::shared_ptr<IngestFile> IngestRegistry::find(const std::string& path) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = files_.find(path);
+    return it == files_.end() ? nullptr : it->second;
+}
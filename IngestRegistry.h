@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// One file that is still being written. The writer advances `committed` -
+// every byte before it is on disk - and readers wait on it instead of
+// treating the current end of the file as EOF.
+class IngestFile {
+public:
+    struct Progress {
+        uint64_t committed = 0;
+        uint64_t expected = 0; // final size, 0 if unknown
+        bool finished = false; // no more bytes will come
+        bool failed = false;   // ...because the upload was abandoned
+    };
+
+    Progress progress() const;
+
+    // Blocks until more than `offset` bytes are committed, the writer
+    // finishes, or `timeout` passes; returns the state at that point.
+    Progress waitBeyond(uint64_t offset, std::chrono::milliseconds timeout) const;
+
+private:
+    friend class IngestRegistry;
+
+    mutable std::mutex mutex_;
+    mutable std::condition_variable cv_;
+    Progress progress_;
+};
+
+// Growing upload files by path, so playback can start on a file before its
+// upload finishes. Writers publish their committed prefix; FileVideoTrackSource
+// looks the path up and reads through a blocking AVIO reader if it is here.
+// Thread-safe.
+class IngestRegistry {
+public:
+    static IngestRegistry& instance();
+
+    void begin(const std::string& path, uint64_t expected);
+    // Never moves backwards.
+    void commit(const std::string& path, uint64_t committed);
+    // Wakes every reader and forgets the path; readers that already hold the
+    // IngestFile see `finished`.
+    void finish(const std::string& path, bool ok);
+
+    // nullptr when `path` is not being ingested (anymore).
+    std::shared_ptr<IngestFile> find(const std::string& path) const;
+
+private:
+    mutable std::mutex mutex_;
+    std::map<std::string, std::shared_ptr<IngestFile>> files_;
+};
@@ -0,0 +1,132 @@
+#include "IoContextPool.h"
+#include "Metrics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#elif defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+namespace {
+
+    bool pinCurrentThread(std::size_t cpu) {
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(static_cast<int>(cpu), &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+        if (cpu >= sizeof(DWORD_PTR) * 8) return false;
+        return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+#else
+        (void)cpu;
+        return false;
+#endif
+    }
+
+}
+
+struct IoContextPool::LagProbe : std::enable_shared_from_this<LagProbe> {
+    static constexpr std::chrono::milliseconds kInterval{ 100 };
+
+    LagProbe(net::io_context& ioc, Metrics::Histogram& lag) : timer(ioc), lag(lag) {}
+
+    void arm() {
+        due = std::chrono::steady_clock::now() + kInterval;
+        timer.expires_at(due);
+        timer.async_wait([self = shared_from_this()](boost::system::error_code ec) {
+            if (ec) return;
+            self->lag.observe(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - self->due).count());
+            self->arm();
+        });
+    }
+
+    net::steady_timer timer;
+    Metrics::Histogram& lag;
+    std::chrono::steady_clock::time_point due;
+};
+
+IoContextPool::IoContextPool(Mode mode, std::size_t threads, bool pin_threads)
+    : mode_(mode)
+    , threads_(threads)
+    , pin_threads_(pin_threads)
+{
+    if (threads_ == 0) threads_ = std::max(1u, std::thread::hardware_concurrency());
+
+    if (mode_ == Mode::kPerCore && !reusePortSupported()) {
+        std::cout << "[POOL] SO_REUSEPORT unavailable, using one shared io_context" << std::endl;
+        mode_ = Mode::kShared;
+    }
+
+    if (mode_ == Mode::kPerCore) {
+        contexts_.reserve(threads_);
+        // Concurrency hint 1: each context is only ever run by its own thread.
+        for (std::size_t i = 0; i < threads_; ++i) contexts_.push_back(std::make_unique<net::io_context>(1));
+    }
+    else {
+        contexts_.push_back(std::make_unique<net::io_context>(static_cast<int>(threads_)));
+    }
+
+    std::cout << "[POOL] " << contexts_.size() << " io_context(s), " << threads_ << " thread(s)"
+        << (pin_threads_ ? ", pinned" : "") << std::endl;
+}
+
+void IoContextPool::run() {
+    const std::size_t hw = std::max(1u, std::thread::hardware_concurrency());
+
+    auto serve = [this, hw](std::size_t index) {
+        if (pin_threads_ && !pinCurrentThread(index % hw)) {
+            std::cerr << "[POOL] Could not pin thread " << index << std::endl;
+        }
+        auto& ioc = mode_ == Mode::kPerCore ? *contexts_[index] : *contexts_[0];
+        ioc.run();
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads_ - 1);
+    for (std::size_t i = 1; i < threads_; ++i) workers.emplace_back(serve, i);
+
+    serve(0);
+
+    for (auto& t : workers) t.join();
+}
+
+void IoContextPool::startLagProbes() {
+    for (std::size_t i = 0; i < contexts_.size(); ++i) {
+        auto& lag = Metrics::instance().histogram("io_loop_lag_ms", { 1, 2, 5, 10, 25, 50, 100, 250, 1000 },
+            "context=\"" + std::to_string(i) + "\"");
+        probes_.push_back(std::make_shared<LagProbe>(*contexts_[i], lag));
+        probes_.back()->arm();
+    }
+}
+
+void IoContextPool::stop() {
+    for (auto& ioc : contexts_) ioc->stop();
+}
+
+bool IoContextPool::reusePortSupported() {
+#if defined(__linux__) && defined(SO_REUSEPORT)
+    return true;
+#else
+    return false;
+#endif
+}
+
+void setReusePort(tcp::acceptor& acceptor, boost::system::error_code& ec) {
+#if defined(__linux__) && defined(SO_REUSEPORT)
+    acceptor.set_option(net::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true), ec);
+#else
+    (void)acceptor;
+    ec = net::error::operation_not_supported;
+#endif
+}
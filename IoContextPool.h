@@ -0,0 +1,56 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace net = boost::asio;
+using tcp = net::ip::tcp;
+
+// Either one io_context served by N threads (shared), or N io_contexts with
+// one thread each (per-core). In per-core mode every context gets its own
+// SO_REUSEPORT acceptors and the kernel spreads connections across them, so
+// a connection's handlers never leave the thread that accepted it.
+class IoContextPool {
+public:
+    enum class Mode { kShared, kPerCore };
+
+    // threads == 0 means one per logical core.
+    IoContextPool(Mode mode, std::size_t threads, bool pin_threads);
+
+    IoContextPool(const IoContextPool&) = delete;
+    IoContextPool& operator=(const IoContextPool&) = delete;
+
+    Mode mode() const { return mode_; }
+    std::size_t size() const { return contexts_.size(); }
+    net::io_context& at(std::size_t i) { return *contexts_[i]; }
+
+    // Blocks until every context has stopped; the calling thread serves
+    // context 0.
+    void run();
+    void stop();
+
+    // How late a 100 ms timer fires on each context, as io_loop_lag_ms -
+    // i.e. how long some handler held the thread. Call before run().
+    void startLagProbes();
+
+    // SO_REUSEPORT exists with load-balancing semantics only on Linux; other
+    // platforms fall back to kShared.
+    static bool reusePortSupported();
+
+private:
+    Mode mode_;
+    std::size_t threads_;
+    bool pin_threads_;
+    std::vector<std::unique_ptr<net::io_context>> contexts_;
+
+    struct LagProbe;
+    std::vector<std::shared_ptr<LagProbe>> probes_;
+};
+
+// Call between open() and bind(). Fails with operation_not_supported where
+// reusePortSupported() is false.
+void setReusePort(tcp::acceptor& acceptor, boost::system::error_code& ec);
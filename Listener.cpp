@@ -1,6 +1,7 @@
 #include "Listener.h"
 #include "WebSocketSession.h"
 #include "SharedState.h"
+#include "IoContextPool.h"
 
 #include <boost/beast/websocket.hpp>
 #include <iostream>
@@ -9,10 +10,16 @@ namespace websocket = boost::beast::websocket;
 
 Listener::Listener(net::io_context& ioc,
     tcp::endpoint endpoint,
-    std::shared_ptr<SharedState> state)
+    std::shared_ptr<SharedState> state,
+    WebSocketOptions options,
+    bool reuse_port,
+    std::shared_ptr<AdmissionController> admission)
     : ioc_(ioc)
     , acceptor_(net::make_strand(ioc))
     , state_(std::move(state))
+    , options_(options)
+    , admission_(std::move(admission))
+    , backoff_(acceptor_.get_executor())
 {
     beast::error_code ec;
 
@@ -22,11 +29,18 @@ Listener::Listener(net::io_context& ioc,
     acceptor_.set_option(net::socket_base::reuse_address(true), ec);
     if (ec) throw beast::system_error(ec);
 
+    if (reuse_port) {
+        setReusePort(acceptor_, ec);
+        if (ec) throw beast::system_error(ec);
+    }
+
     acceptor_.bind(endpoint, ec);
     if (ec) throw beast::system_error(ec);
 
     acceptor_.listen(net::socket_base::max_listen_connections, ec);
     if (ec) throw beast::system_error(ec);
+
+    if (admission_) options_.handshake_timeout_ms = admission_->config().handshake_timeout_ms;
 }
 
 void Listener::run() {
@@ -43,55 +57,94 @@ void Listener::do_accept() {
 void Listener::on_accept(beast::error_code ec, tcp::socket socket) {
     if (ec) {
         std::cerr << "[WS] accept error: " << ec.message() << "\n";
+        AdmissionController::countRejection("accept_error");
+        if (ec == net::error::no_descriptors || ec == net::error::no_buffer_space || ec == net::error::no_memory) {
+            // Out of fds: retrying at once just spins. Give closing
+            // connections a moment to hand theirs back.
+            const int backoff_ms = admission_ ? admission_->config().accept_backoff_ms : 100;
+            backoff_.expires_after(std::chrono::milliseconds(backoff_ms));
+            backoff_.async_wait([self = shared_from_this()](beast::error_code) { self->do_accept(); });
+            return;
+        }
         do_accept();
         return;
     }
 
-
     do_accept();
 
+    AdmissionController::Ticket ticket;
+    if (admission_) {
+        beast::error_code ep_ec;
+        const auto remote = socket.remote_endpoint(ep_ec);
+        if (ep_ec) return; // already gone; the socket closes on scope exit
+
+        AdmissionController::Verdict verdict;
+        ticket = admission_->admit(remote.address(), verdict);
+        if (!ticket) {
+            // Nothing has been read or allocated yet; drop it here.
+            beast::error_code ignore;
+            socket.shutdown(tcp::socket::shutdown_both, ignore);
+            socket.close(ignore);
+            return;
+        }
+    }
+
+    start_handshake(std::move(socket), std::move(ticket));
+}
 
-    auto sp_socket = std::make_shared<tcp::socket>(std::move(socket));
+void Listener::start_handshake(tcp::socket socket, AdmissionController::Ticket ticket) {
+    // The upgrade request is read under a deadline and a small size cap, so
+    // a silent or dribbling client cannot hold its slot open.
+    auto stream = std::make_shared<beast::tcp_stream>(std::move(socket));
     auto buffer = std::make_shared<beast::flat_buffer>();
-    auto req = std::make_shared<http::request<http::string_body>>();
+    auto parser = std::make_shared<http::request_parser<http::string_body>>();
+    parser->header_limit(8 * 1024);
+    parser->body_limit(4 * 1024);
+
+    stream->expires_after(std::chrono::milliseconds(options_.handshake_timeout_ms));
 
     http::async_read(
-        *sp_socket,
+        *stream,
         *buffer,
-        *req,
-        [this, sp_socket, buffer, req](beast::error_code read_ec, std::size_t) mutable {
+        *parser,
+        [self = shared_from_this(), stream, buffer, parser, ticket = std::move(ticket)](beast::error_code read_ec, std::size_t) mutable {
             if (read_ec) {
+                if (read_ec == beast::error::timeout) AdmissionController::countRejection("handshake_timeout");
                 std::cerr << "[WS] http read error: " << read_ec.message() << "\n";
                 beast::error_code ignore;
-                sp_socket->shutdown(tcp::socket::shutdown_both, ignore);
-                sp_socket->close(ignore);
+                stream->socket().shutdown(tcp::socket::shutdown_both, ignore);
+                stream->socket().close(ignore);
                 return;
             }
 
-            if (!websocket::is_upgrade(*req)) {
-     
-                http::response<http::string_body> res{ http::status::upgrade_required, req->version() };
-                res.set(http::field::server, "RTCServer");
-                res.set(http::field::content_type, "text/plain; charset=utf-8");
-                res.keep_alive(false);
-                res.body() = "Upgrade Required: use WebSocket endpoint.";
-                res.prepare_payload();
+            auto req = parser->release();
+
+            if (!websocket::is_upgrade(req)) {
+                AdmissionController::countRejection("not_upgrade");
+                auto res = std::make_shared<http::response<http::string_body>>(http::status::upgrade_required, req.version());
+                res->set(http::field::server, "RTCServer");
+                res->set(http::field::content_type, "text/plain; charset=utf-8");
+                res->keep_alive(false);
+                res->body() = "Upgrade Required: use WebSocket endpoint.";
+                res->prepare_payload();
 
                 http::async_write(
-                    *sp_socket,
-                    res,
-                    [sp_socket](beast::error_code, std::size_t) {
+                    *stream,
+                    *res,
+                    [stream, res](beast::error_code, std::size_t) {
                         beast::error_code ignore;
-                        sp_socket->shutdown(tcp::socket::shutdown_both, ignore);
-                        sp_socket->close(ignore);
+                        stream->socket().shutdown(tcp::socket::shutdown_both, ignore);
+                        stream->socket().close(ignore);
                     }
                 );
                 return;
             }
 
-   
-            auto session = std::make_shared<WebSocketSession>(std::move(*sp_socket), state_, ioc_);
-            session->run(std::move(*req));
+            // The WebSocket handshake runs under its own handshake_timeout.
+            stream->expires_never();
+            auto session = std::make_shared<WebSocketSession>(
+                stream->release_socket(), self->state_, self->ioc_, self->options_, std::move(ticket));
+            session->run(std::move(req));
         }
     );
 }
@@ -6,6 +6,9 @@
 
 #include <memory>
 
+#include "AdmissionController.h"
+#include "WebSocketSession.h"
+
 class SharedState;
 
 namespace net = boost::asio;
@@ -18,16 +21,23 @@ class Listener : public std::enable_shared_from_this<Listener> {
 public:
     Listener(net::io_context& ioc,
         tcp::endpoint endpoint,
-        std::shared_ptr<SharedState> state);
+        std::shared_ptr<SharedState> state,
+        WebSocketOptions options = WebSocketOptions(),
+        bool reuse_port = false,
+        std::shared_ptr<AdmissionController> admission = nullptr);
 
     void run();
 
 private:
     void do_accept();
     void on_accept(beast::error_code ec, tcp::socket socket);
+    void start_handshake(tcp::socket socket, AdmissionController::Ticket ticket);
 
 private:
     net::io_context& ioc_;
     tcp::acceptor acceptor_;
     std::shared_ptr<SharedState> state_;
+    WebSocketOptions options_;
+    std::shared_ptr<AdmissionController> admission_;
+    net::steady_timer backoff_;
 };
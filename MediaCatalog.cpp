@@ -0,0 +1,486 @@
+#include "MediaCatalog.h"
+#include "Metrics.h"
+
+#include <boost/asio/post.hpp>
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+}
+
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+namespace {
+
+    constexpr int kSpriteTiles = 10;
+    constexpr int kSpriteColumns = 5;
+    constexpr int kTileWidth = 160;
+    // Bounds the packets read looking for one decodable frame after a seek.
+    constexpr int kMaxPacketsPerTile = 512;
+
+    const char* state_name(MediaInfo::State s) {
+        switch (s) {
+        case MediaInfo::State::kReady: return "ready";
+        case MediaInfo::State::kFailed: return "failed";
+        default: return "pending";
+        }
+    }
+
+    MediaInfo::State state_from_name(const std::string& s) {
+        if (s == "ready") return MediaInfo::State::kReady;
+        if (s == "failed") return MediaInfo::State::kFailed;
+        return MediaInfo::State::kPending;
+    }
+
+    int64_t mtime_of(const std::string& path, std::error_code& ec) {
+        const auto t = fs::last_write_time(path, ec);
+        if (ec) return 0;
+        // Only compared with itself, so the clock's epoch does not matter.
+        return std::chrono::duration_cast<std::chrono::seconds>(t.time_since_epoch()).count();
+    }
+
+    bool is_media_candidate(const fs::directory_entry& e) {
+        std::error_code ec;
+        if (!e.is_regular_file(ec)) return false;
+        const std::string name = e.path().filename().string();
+        const std::string ext = e.path().extension().string();
+        return name != "catalog.json" && ext != ".tmp" && ext != ".dedup";
+    }
+
+    json to_json(const MediaInfo& m, bool listing) {
+        json j;
+        j["file_path"] = m.file_path;
+        j["name"] = m.name;
+        j["size"] = m.size;
+        j[listing ? "modified" : "mtime"] = m.mtime;
+        j["status"] = state_name(m.state);
+        if (m.state == MediaInfo::State::kReady) {
+            j["duration"] = m.duration_s;
+            j["codec"] = m.codec;
+            j["width"] = m.width;
+            j["height"] = m.height;
+            j["fps"] = m.fps;
+            j["keyframes"] = m.keyframes;
+        }
+        if (!m.sprite.empty()) {
+            json s;
+            s[listing ? "url" : "file"] = listing ? "/thumbs/" + m.sprite : m.sprite;
+            s["tiles"] = m.sprite_tiles;
+            s["columns"] = m.sprite_columns;
+            s["tile_width"] = m.tile_width;
+            s["tile_height"] = m.tile_height;
+            s["interval"] = m.sprite_interval_s;
+            j["sprite"] = s;
+        }
+        return j;
+    }
+
+    MediaInfo from_json(const json& j) {
+        MediaInfo m;
+        m.file_path = j.value("file_path", "");
+        m.name = j.value("name", "");
+        m.size = j.value("size", uint64_t{ 0 });
+        m.mtime = j.value("mtime", int64_t{ 0 });
+        m.state = state_from_name(j.value("status", ""));
+        m.duration_s = j.value("duration", 0.0);
+        m.codec = j.value("codec", "");
+        m.width = j.value("width", 0);
+        m.height = j.value("height", 0);
+        m.fps = j.value("fps", 0.0);
+        m.keyframes = j.value("keyframes", int64_t{ 0 });
+        if (j.contains("sprite") && j["sprite"].is_object()) {
+            const auto& s = j["sprite"];
+            m.sprite = s.value("file", "");
+            m.sprite_tiles = s.value("tiles", 0);
+            m.sprite_columns = s.value("columns", 0);
+            m.tile_width = s.value("tile_width", 0);
+            m.tile_height = s.value("tile_height", 0);
+            m.sprite_interval_s = s.value("interval", 0.0);
+        }
+        return m;
+    }
+
+    // Everything one probe opens, released on every exit.
+    struct ProbeContext {
+        AVFormatContext* format = nullptr;
+        AVCodecContext* decoder = nullptr;
+        AVCodecContext* encoder = nullptr;
+        AVFrame* frame = nullptr;
+        AVFrame* sprite = nullptr;
+        AVPacket* packet = nullptr;
+        SwsContext* sws = nullptr;
+
+        ~ProbeContext() {
+            sws_freeContext(sws);
+            av_packet_free(&packet);
+            av_frame_free(&sprite);
+            av_frame_free(&frame);
+            avcodec_free_context(&encoder);
+            avcodec_free_context(&decoder);
+            avformat_close_input(&format);
+        }
+    };
+
+    // First frame the decoder produces from where the last seek left the demuxer.
+    bool decode_next_frame(ProbeContext& c, int stream) {
+        for (int n = 0; n < kMaxPacketsPerTile; ++n) {
+            int ret = avcodec_receive_frame(c.decoder, c.frame);
+            if (ret == 0) return true;
+            if (ret != AVERROR(EAGAIN)) return false;
+
+            ret = av_read_frame(c.format, c.packet);
+            if (ret < 0) {
+                avcodec_send_packet(c.decoder, nullptr); // drain what is buffered
+                return avcodec_receive_frame(c.decoder, c.frame) == 0;
+            }
+            if (c.packet->stream_index == stream) avcodec_send_packet(c.decoder, c.packet);
+            av_packet_unref(c.packet);
+        }
+        return false;
+    }
+
+    // A grid of frames spread over the duration, as one JPEG.
+    bool write_sprite(ProbeContext& c, int stream, MediaInfo& info, const std::string& out_path,
+        const std::atomic<bool>& stopping) {
+        AVStream* vs = c.format->streams[stream];
+        const AVCodecParameters* par = vs->codecpar;
+
+        const AVCodec* dec = avcodec_find_decoder(par->codec_id);
+        if (!dec) return false;
+        c.decoder = avcodec_alloc_context3(dec);
+        avcodec_parameters_to_context(c.decoder, par);
+        c.decoder->thread_count = 1; // the probe pool is the parallelism
+        if (avcodec_open2(c.decoder, dec, nullptr) < 0) return false;
+
+        const int tile_w = kTileWidth;
+        int tile_h = par->width > 0 ? (kTileWidth * par->height / par->width) & ~1 : 90;
+        if (tile_h < 2) tile_h = 2;
+        const int tiles = info.duration_s > 0.0 ? kSpriteTiles : 1;
+        const int cols = std::min(tiles, kSpriteColumns);
+        const int rows = (tiles + cols - 1) / cols;
+
+        c.sprite = av_frame_alloc();
+        c.sprite->format = AV_PIX_FMT_YUVJ420P;
+        c.sprite->width = cols * tile_w;
+        c.sprite->height = rows * tile_h;
+        if (av_frame_get_buffer(c.sprite, 0) < 0) return false;
+        for (int plane = 0; plane < 3; ++plane) {
+            const int h = plane == 0 ? c.sprite->height : c.sprite->height / 2;
+            std::memset(c.sprite->data[plane], plane == 0 ? 0 : 128, static_cast<std::size_t>(c.sprite->linesize[plane]) * h);
+        }
+
+        c.frame = av_frame_alloc();
+        const double interval = tiles > 1 ? info.duration_s / tiles : 0.0;
+        const int64_t start = vs->start_time != AV_NOPTS_VALUE ? vs->start_time : 0;
+        int placed = 0;
+
+        for (int i = 0; i < tiles && !stopping; ++i) {
+            const double t = (i + 0.5) * interval;
+            const int64_t ts = start + static_cast<int64_t>(t / av_q2d(vs->time_base));
+            if (av_seek_frame(c.format, stream, ts, AVSEEK_FLAG_BACKWARD) < 0) continue;
+            avcodec_flush_buffers(c.decoder);
+            if (!decode_next_frame(c, stream)) continue;
+
+            c.sws = sws_getCachedContext(c.sws, c.frame->width, c.frame->height,
+                static_cast<AVPixelFormat>(c.frame->format), tile_w, tile_h, AV_PIX_FMT_YUVJ420P,
+                SWS_BILINEAR, nullptr, nullptr, nullptr);
+            if (!c.sws) return false;
+
+            const int x = (i % cols) * tile_w;
+            const int y = (i / cols) * tile_h;
+            uint8_t* dst[4] = {
+                c.sprite->data[0] + y * c.sprite->linesize[0] + x,
+                c.sprite->data[1] + (y / 2) * c.sprite->linesize[1] + x / 2,
+                c.sprite->data[2] + (y / 2) * c.sprite->linesize[2] + x / 2,
+                nullptr,
+            };
+            const int dst_stride[4] = { c.sprite->linesize[0], c.sprite->linesize[1], c.sprite->linesize[2], 0 };
+            sws_scale(c.sws, c.frame->data, c.frame->linesize, 0, c.frame->height, dst, dst_stride);
+            av_frame_unref(c.frame);
+            ++placed;
+        }
+        if (placed == 0) return false;
+
+        const AVCodec* jpeg = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+        if (!jpeg) return false;
+        c.encoder = avcodec_alloc_context3(jpeg);
+        c.encoder->width = c.sprite->width;
+        c.encoder->height = c.sprite->height;
+        c.encoder->pix_fmt = AV_PIX_FMT_YUVJ420P;
+        c.encoder->time_base = AVRational{ 1, 1 };
+        c.encoder->flags |= AV_CODEC_FLAG_QSCALE;
+        c.encoder->global_quality = FF_QP2LAMBDA * 5;
+        if (avcodec_open2(c.encoder, jpeg, nullptr) < 0) return false;
+
+        c.sprite->pts = 0;
+        c.sprite->quality = c.encoder->global_quality;
+        if (avcodec_send_frame(c.encoder, c.sprite) < 0) return false;
+        if (avcodec_receive_packet(c.encoder, c.packet) < 0) return false;
+
+        const std::string tmp = out_path + ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(c.packet->data), c.packet->size);
+            if (!out) return false;
+        }
+        av_packet_unref(c.packet);
+        std::error_code ec;
+        fs::rename(tmp, out_path, ec);
+        if (ec) return false;
+
+        info.sprite = fs::path(out_path).filename().string();
+        info.sprite_tiles = tiles;
+        info.sprite_columns = cols;
+        info.tile_width = tile_w;
+        info.tile_height = tile_h;
+        info.sprite_interval_s = interval;
+        return true;
+    }
+
+}
+
+MediaCatalog::MediaCatalog(std::string directory, std::size_t probe_threads)
+    : directory_(std::move(directory))
+    , thumbs_dir_(directory_ + "/thumbs")
+    , index_path_(directory_ + "/catalog.json")
+    , listing_(std::make_shared<const std::string>("[]"))
+    , pool_(probe_threads)
+{
+}
+
+MediaCatalog::~MediaCatalog() {
+    stopping_ = true;
+    pool_.join();
+}
+
+void MediaCatalog::setListener(std::function<void(const MediaInfo&)> listener) {
+    listener_ = std::move(listener);
+}
+
+void MediaCatalog::load() {
+    std::map<std::string, MediaInfo> indexed;
+    {
+        std::ifstream in(index_path_, std::ios::binary);
+        if (in) {
+            try {
+                const json j = json::parse(in);
+                for (const auto& e : j) {
+                    MediaInfo m = from_json(e);
+                    if (!m.file_path.empty()) indexed[m.file_path] = std::move(m);
+                }
+            }
+            catch (const std::exception& e) {
+                std::cerr << "[CATALOG] Ignoring unreadable " << index_path_ << ": " << e.what() << std::endl;
+            }
+        }
+    }
+
+    // Directory metadata only; media files are opened by the probes.
+    std::error_code ec;
+    std::size_t reused = 0;
+    std::vector<MediaInfo> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (fs::directory_iterator it(directory_, ec), end; !ec && it != end; it.increment(ec)) {
+            if (!is_media_candidate(*it)) continue;
+            const std::string path = directory_ + "/" + it->path().filename().string();
+
+            std::error_code stat_ec;
+            const uint64_t size = it->file_size(stat_ec);
+            const int64_t mtime = mtime_of(path, stat_ec);
+
+            auto known = indexed.find(path);
+            if (known != indexed.end() && known->second.state != MediaInfo::State::kPending &&
+                known->second.size == size && known->second.mtime == mtime) {
+                if (listener_ && known->second.state == MediaInfo::State::kReady) ready.push_back(known->second);
+                entries_[path] = std::move(known->second);
+                ++reused;
+                continue;
+            }
+
+            MediaInfo m;
+            m.file_path = path;
+            m.name = it->path().filename().string();
+            m.size = size;
+            m.mtime = mtime;
+            entries_[path] = std::move(m);
+            enqueueLocked(path);
+        }
+
+        std::cout << "[CATALOG] " << entries_.size() << " file(s), " << reused << " from index, "
+            << queued_.size() << " to probe" << std::endl;
+        rebuildListingLocked();
+    }
+    for (const MediaInfo& m : ready) listener_(m);
+}
+
+void MediaCatalog::add(const std::string& file_path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& m = entries_[file_path];
+    m.file_path = file_path;
+    m.name = fs::path(file_path).filename().string();
+    m.state = MediaInfo::State::kPending;
+    enqueueLocked(file_path);
+    rebuildListingLocked();
+}
+
+std::shared_ptr<const std::string> MediaCatalog::listing() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return listing_;
+}
+
+std::string MediaCatalog::spritePath(const std::string& name) const {
+    if (name.empty() || name.find_first_not_of(
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789._-") != std::string::npos ||
+        name.find("..") != std::string::npos) {
+        return {};
+    }
+    return thumbs_dir_ + "/" + name;
+}
+
+std::string MediaCatalog::mediaPath(const std::string& name) const {
+    if (name.empty() || name.find_first_of("/\\") != std::string::npos || name.find("..") != std::string::npos) {
+        return {};
+    }
+    const std::string path = directory_ + "/" + name;
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.count(path) ? path : std::string();
+}
+
+void MediaCatalog::enqueueLocked(const std::string& file_path) {
+    if (!queued_.insert(file_path).second) return;
+    boost::asio::post(pool_, [this, file_path]() { probe(file_path); });
+}
+
+void MediaCatalog::probe(const std::string& file_path) {
+    static auto& probe_ms = Metrics::instance().histogram("catalog_probe_ms", { 10, 50, 100, 250, 1000, 5000, 30000 });
+    static auto& failures = Metrics::instance().counter("catalog_probe_failures_total");
+
+    if (stopping_) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queued_.erase(file_path);
+    }
+
+    MediaInfo info;
+    info.file_path = file_path;
+    info.name = fs::path(file_path).filename().string();
+
+    std::error_code ec;
+    info.size = fs::file_size(file_path, ec);
+    if (!ec) info.mtime = mtime_of(file_path, ec);
+    if (ec) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.erase(file_path);
+        rebuildListingLocked();
+    }
+    else {
+        const auto t0 = std::chrono::steady_clock::now();
+        const bool ok = probeFile(info);
+        if (stopping_) return;
+        probe_ms.observe(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+        info.state = ok ? MediaInfo::State::kReady : MediaInfo::State::kFailed;
+        if (!ok) failures.inc();
+
+        std::cout << "[CATALOG] " << info.name << ": " << state_name(info.state);
+        if (ok) {
+            std::cout << ", " << info.codec << " " << info.width << "x" << info.height << " @ " << info.fps
+                << " fps, " << info.duration_s << " s, " << info.keyframes << " keyframes";
+        }
+        std::cout << std::endl;
+
+        if (ok && listener_) listener_(info);
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_[file_path] = std::move(info);
+        rebuildListingLocked();
+    }
+    save();
+}
+
+bool MediaCatalog::probeFile(MediaInfo& info) {
+    ProbeContext c;
+    if (avformat_open_input(&c.format, info.file_path.c_str(), nullptr, nullptr) < 0) return false;
+    if (avformat_find_stream_info(c.format, nullptr) < 0) return false;
+
+    const int stream = av_find_best_stream(c.format, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (stream < 0) return false;
+    AVStream* vs = c.format->streams[stream];
+    const AVCodecParameters* par = vs->codecpar;
+
+    info.codec = avcodec_get_name(par->codec_id);
+    info.width = par->width;
+    info.height = par->height;
+    info.fps = av_q2d(vs->avg_frame_rate);
+    if (info.fps <= 0.0) info.fps = av_q2d(vs->r_frame_rate);
+    if (c.format->duration != AV_NOPTS_VALUE) info.duration_s = c.format->duration / static_cast<double>(AV_TIME_BASE);
+    else if (vs->duration != AV_NOPTS_VALUE) info.duration_s = vs->duration * av_q2d(vs->time_base);
+
+    // Keyframes: one pass over the packets, nothing decoded.
+    c.packet = av_packet_alloc();
+    int64_t keyframes = 0;
+    while (!stopping_ && av_read_frame(c.format, c.packet) >= 0) {
+        if (c.packet->stream_index == stream && (c.packet->flags & AV_PKT_FLAG_KEY)) ++keyframes;
+        av_packet_unref(c.packet);
+    }
+    if (stopping_) return false;
+    info.keyframes = keyframes;
+
+    std::error_code ec;
+    fs::create_directories(thumbs_dir_, ec);
+    if (!write_sprite(c, stream, info, thumbs_dir_ + "/" + info.name + ".jpg", stopping_)) {
+        std::cerr << "[CATALOG] No thumbnails for " << info.name << std::endl;
+    }
+    return true;
+}
+
+void MediaCatalog::rebuildListingLocked() {
+    static auto& files = Metrics::instance().gauge("catalog_files");
+
+    std::vector<const MediaInfo*> sorted;
+    sorted.reserve(entries_.size());
+    for (const auto& e : entries_) sorted.push_back(&e.second);
+    std::sort(sorted.begin(), sorted.end(), [](const MediaInfo* a, const MediaInfo* b) {
+        return a->mtime != b->mtime ? a->mtime > b->mtime : a->name < b->name;
+    });
+
+    json j = json::array();
+    for (const MediaInfo* m : sorted) j.push_back(to_json(*m, true));
+    listing_ = std::make_shared<const std::string>(j.dump());
+    files.set(static_cast<double>(entries_.size()));
+}
+
+void MediaCatalog::save() {
+    // Snapshot under save_mutex_, so a slower writer never replaces a newer index.
+    std::lock_guard<std::mutex> save_lock(save_mutex_);
+    json j = json::array();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& e : entries_) j.push_back(to_json(e.second, false));
+    }
+
+    const std::string tmp = index_path_ + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out << j.dump();
+        if (!out) {
+            std::cerr << "[CATALOG] Cannot write " << tmp << std::endl;
+            return;
+        }
+    }
+    std::error_code ec;
+    fs::rename(tmp, index_path_, ec);
+    if (ec) std::cerr << "[CATALOG] Cannot replace " << index_path_ << ": " << ec.message() << std::endl;
+}
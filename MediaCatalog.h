@@ -0,0 +1,96 @@
+#pragma once
+
+#include <boost/asio/thread_pool.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+
+// What is known about one file in the uploads directory.
+struct MediaInfo {
+    enum class State { kPending, kReady, kFailed };
+
+    std::string file_path;
+    std::string name;     // basename
+    uint64_t size = 0;
+    int64_t mtime = 0;    // seconds since epoch, to notice replaced files
+    State state = State::kPending;
+
+    double duration_s = 0.0;
+    std::string codec;
+    int width = 0;
+    int height = 0;
+    double fps = 0.0;
+    int64_t keyframes = 0;
+
+    // Thumbnail sprite: `sprite_tiles` frames spaced `sprite_interval_s`
+    // apart, laid out row by row, `sprite_columns` per row. Empty if none.
+    std::string sprite;   // file name under thumbs/
+    int sprite_tiles = 0;
+    int sprite_columns = 0;
+    int tile_width = 0;
+    int tile_height = 0;
+    double sprite_interval_s = 0.0;
+};
+
+// The media library: every file in the uploads directory with its probe
+// results. Probing (FFmpeg: stream info, a keyframe scan, a thumbnail sprite)
+// runs on a small pool of its own so a long scan never holds up uploads or
+// playback. Results live in memory and in <directory>/catalog.json, loaded at
+// startup, so listing never opens a media file. Thread-safe.
+class MediaCatalog {
+public:
+    explicit MediaCatalog(std::string directory, std::size_t probe_threads = 2);
+    ~MediaCatalog();
+
+    MediaCatalog(const MediaCatalog&) = delete;
+    MediaCatalog& operator=(const MediaCatalog&) = delete;
+
+    // Called for every file known to be readable media: after each successful
+    // probe (on a probe thread), and from load() for entries the index
+    // already had. Set before load().
+    void setListener(std::function<void(const MediaInfo&)> listener);
+
+    // Reads the index and reconciles it with the directory listing: entries
+    // whose file is gone are dropped, new or changed files are probed.
+    void load();
+
+    // A finished upload (or any file that changed); probed in the background.
+    void add(const std::string& file_path);
+
+    // The GET /files body, rebuilt whenever an entry changes.
+    std::shared_ptr<const std::string> listing() const;
+
+    // Path of a sprite by the file name the listing gives, or empty.
+    std::string spritePath(const std::string& name) const;
+
+    // Path of a catalogued file by its listing name, or empty; nothing
+    // outside the catalog (the index, partial uploads) is ever named.
+    std::string mediaPath(const std::string& name) const;
+
+private:
+    void enqueueLocked(const std::string& file_path);
+    void probe(const std::string& file_path);
+    bool probeFile(MediaInfo& info);
+    void rebuildListingLocked();
+    void save();
+
+    const std::string directory_;
+    const std::string thumbs_dir_;
+    const std::string index_path_;
+
+    mutable std::mutex mutex_;
+    std::map<std::string, MediaInfo> entries_; // by file_path
+    std::set<std::string> queued_;
+    std::shared_ptr<const std::string> listing_;
+
+    std::function<void(const MediaInfo&)> listener_;
+    std::mutex save_mutex_;
+    std::atomic<bool> stopping_{ false };
+    boost::asio::thread_pool pool_;
+};
@@ -0,0 +1,112 @@
+#include "Metrics.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace {
+
+    std::string series_name(const std::string& name, const std::string& labels, const char* suffix = "") {
+        std::string out = name + suffix;
+        if (!labels.empty()) out += "{" + labels + "}";
+        return out;
+    }
+
+    std::string join_labels(const std::string& labels, const std::string& extra) {
+        if (labels.empty()) return extra;
+        return labels + "," + extra;
+    }
+
+}
+
+Metrics::Histogram::Histogram(std::vector<double> bounds)
+    : bounds_(std::move(bounds))
+    , buckets_(new std::atomic<uint64_t>[bounds_.size() + 1])
+{
+    std::sort(bounds_.begin(), bounds_.end());
+    for (std::size_t i = 0; i <= bounds_.size(); ++i) buckets_[i].store(0);
+}
+
+void Metrics::Histogram::observe(double v) {
+    const auto it = std::lower_bound(bounds_.begin(), bounds_.end(), v);
+    buckets_[static_cast<std::size_t>(it - bounds_.begin())].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+
+    double cur = sum_.load(std::memory_order_relaxed);
+    while (!sum_.compare_exchange_weak(cur, cur + v, std::memory_order_relaxed)) {
+    }
+}
+
+Metrics& Metrics::instance() {
+    static Metrics metrics;
+    return metrics;
+}
+
+Metrics::Counter& Metrics::counter(const std::string& name, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& slot = counters_[name][labels];
+    if (!slot) slot = std::make_unique<Counter>();
+    return *slot;
+}
+
+Metrics::Gauge& Metrics::gauge(const std::string& name, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& slot = gauges_[name][labels];
+    if (!slot) slot = std::make_unique<Gauge>();
+    return *slot;
+}
+
+Metrics::Histogram& Metrics::histogram(const std::string& name, const std::vector<double>& bounds,
+    const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& slot = histograms_[name][labels];
+    if (!slot) slot = std::make_unique<Histogram>(bounds);
+    return *slot;
+}
+
+void Metrics::remove(const std::string& name, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (auto it = gauges_.find(name); it != gauges_.end()) it->second.erase(labels);
+    if (auto it = counters_.find(name); it != counters_.end()) it->second.erase(labels);
+    if (auto it = histograms_.find(name); it != histograms_.end()) it->second.erase(labels);
+}
+
+std::string Metrics::render() const {
+    std::ostringstream out;
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (const auto& [name, series] : counters_) {
+        if (series.empty()) continue;
+        out << "# TYPE " << name << " counter\n";
+        for (const auto& [labels, c] : series) {
+            out << series_name(name, labels) << " " << c->value() << "\n";
+        }
+    }
+
+    for (const auto& [name, series] : gauges_) {
+        if (series.empty()) continue;
+        out << "# TYPE " << name << " gauge\n";
+        for (const auto& [labels, g] : series) {
+            out << series_name(name, labels) << " " << g->value() << "\n";
+        }
+    }
+
+    for (const auto& [name, series] : histograms_) {
+        if (series.empty()) continue;
+        out << "# TYPE " << name << " histogram\n";
+        for (const auto& [labels, h] : series) {
+            uint64_t cumulative = 0;
+            for (std::size_t i = 0; i < h->bounds().size(); ++i) {
+                cumulative += h->bucketCount(i);
+                std::ostringstream le;
+                le << "le=\"" << h->bounds()[i] << "\"";
+                out << series_name(name, join_labels(labels, le.str()), "_bucket") << " " << cumulative << "\n";
+            }
+            cumulative += h->bucketCount(h->bounds().size());
+            out << series_name(name, join_labels(labels, "le=\"+Inf\""), "_bucket") << " " << cumulative << "\n";
+            out << series_name(name, labels, "_sum") << " " << h->sum() << "\n";
+            out << series_name(name, labels, "_count") << " " << h->count() << "\n";
+        }
+    }
+
+    return out.str();
+}
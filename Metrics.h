@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class Metrics {
+public:
+    class Counter {
+    public:
+        void inc(uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+        uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<uint64_t> value_{ 0 };
+    };
+
+    class Gauge {
+    public:
+        void set(double v) { value_.store(v, std::memory_order_relaxed); }
+        double value() const { return value_.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<double> value_{ 0.0 };
+    };
+
+    class Histogram {
+    public:
+        explicit Histogram(std::vector<double> bounds);
+
+        void observe(double v);
+
+        const std::vector<double>& bounds() const { return bounds_; }
+        uint64_t bucketCount(std::size_t i) const { return buckets_[i].load(std::memory_order_relaxed); }
+        uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+        double sum() const { return sum_.load(std::memory_order_relaxed); }
+
+    private:
+        std::vector<double> bounds_;
+        std::unique_ptr<std::atomic<uint64_t>[]> buckets_;
+        std::atomic<uint64_t> count_{ 0 };
+        std::atomic<double> sum_{ 0.0 };
+    };
+
+    static Metrics& instance();
+
+    // Series are created on first use and never move, so callers on hot paths
+    // should look them up once and keep the reference.
+    Counter& counter(const std::string& name, const std::string& labels = std::string());
+    Gauge& gauge(const std::string& name, const std::string& labels = std::string());
+    Histogram& histogram(const std::string& name, const std::vector<double>& bounds,
+        const std::string& labels = std::string());
+
+    void remove(const std::string& name, const std::string& labels);
+
+    std::string render() const;
+
+private:
+    Metrics() = default;
+
+    mutable std::mutex mutex_;
+    std::map<std::string, std::map<std::string, std::unique_ptr<Counter>>> counters_;
+    std::map<std::string, std::map<std::string, std::unique_ptr<Gauge>>> gauges_;
+    std::map<std::string, std::map<std::string, std::unique_ptr<Histogram>>> histograms_;
+};
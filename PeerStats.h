@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+// Snapshot of one viewer's sender-side WebRTC stats, refreshed by the
+// RTCManager stats loop from PeerConnection::GetStats, plus the viewer's own
+// telemetry as last reported.
+struct PeerStats {
+    int64_t updated_ms = 0;
+
+    double available_outgoing_bitrate_bps = 0.0;
+    double rtt_ms = 0.0;
+    double fraction_lost = 0.0;
+    double jitter_ms = 0.0;
+
+    uint64_t bytes_sent = 0;
+    double send_bitrate_bps = 0.0;
+
+    double total_encode_time_s = 0.0;
+    uint64_t frames_encoded = 0;
+    double frames_per_second = 0.0;
+    int frame_width = 0;
+    int frame_height = 0;
+
+    // What the viewer itself reports over the data channel (0 = no report yet).
+    double viewer_fps = 0.0;
+    double viewer_drop_ratio = 0.0;
+    uint32_t viewer_stalls = 0; // stalls in the viewer's last report interval
+};
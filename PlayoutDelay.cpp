@@ -0,0 +1,61 @@
+#include "PlayoutDelay.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+    // The extension carries 10 ms units and tops out at 4095 of them.
+    constexpr int kGranularityMs = 10;
+    constexpr int kExtensionMaxMs = 4095 * kGranularityMs;
+
+    int roundUp(double ms) {
+        return static_cast<int>(std::ceil(ms / kGranularityMs)) * kGranularityMs;
+    }
+
+}
+
+PlayoutDelayPlanner::PlayoutDelayPlanner(PlayoutDelayConfig config)
+    : config_(config) {
+}
+
+const PlayoutDelayPlanner::Plan& PlayoutDelayPlanner::update(const std::vector<PeerStats>& viewers) {
+    double need_ms = 0.0;
+    double min_one_way = -1.0;
+    double max_one_way = 0.0;
+    for (const auto& st : viewers) {
+        if (st.updated_ms <= 0 || st.rtt_ms <= 0.0) continue;
+        const double one_way = st.rtt_ms / 2.0;
+        // Three jitter deviations cover nearly all arrivals for that viewer.
+        need_ms = std::max(need_ms, one_way + 3.0 * st.jitter_ms + config_.margin_ms);
+        min_one_way = min_one_way < 0.0 ? one_way : std::min(min_one_way, one_way);
+        max_one_way = std::max(max_one_way, one_way);
+    }
+
+    if (!config_.enabled || min_one_way < 0.0) {
+        plan_ = Plan{};
+        calm_samples_ = 0;
+        return plan_;
+    }
+
+    const int wanted = std::clamp(roundUp(need_ms), config_.floor_ms, std::min(config_.ceiling_ms, kExtensionMaxMs));
+
+    if (plan_.target_ms == 0 || wanted > plan_.target_ms) {
+        plan_.target_ms = wanted;
+        calm_samples_ = 0;
+    }
+    else if (wanted < plan_.target_ms - config_.window_ms) {
+        if (++calm_samples_ >= config_.hold_samples) {
+            plan_.target_ms = wanted;
+            calm_samples_ = 0;
+        }
+    }
+    else {
+        calm_samples_ = 0;
+    }
+
+    plan_.min_delay_ms = std::max(0, plan_.target_ms - roundUp(max_one_way) - kGranularityMs);
+    plan_.max_delay_ms = std::min(kExtensionMaxMs,
+        plan_.target_ms - static_cast<int>(min_one_way) / kGranularityMs * kGranularityMs + config_.window_ms);
+    return plan_;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "PeerStats.h"
+
+#include <vector>
+
+struct PlayoutDelayConfig {
+    bool enabled = true;
+    int floor_ms = 100;    // never ask any viewer to render sooner than this
+    int ceiling_ms = 1500; // ...or later than this
+    int margin_ms = 40;    // roughly one frame interval on top of the network need
+    int window_ms = 40;    // width of the render window the room is held to
+    int hold_samples = 5;  // ticks a lower target must persist before we drop to it
+};
+
+// Room-wide playout target. Every viewer should present a frame T ms after it
+// was captured; a viewer with one-way delay d therefore needs a jitter buffer
+// of T - d. T follows the slowest viewer up immediately and comes back down
+// only after hold_samples calmer ticks.
+class PlayoutDelayPlanner {
+public:
+    struct Plan {
+        int target_ms = 0;  // capture-to-render target for the room; 0 = not synchronised
+        int min_delay_ms = 0;  // playout-delay extension bounds covering every viewer's
+        int max_delay_ms = 0;  // jitter buffer (T - max one-way .. T - min one-way + window)
+    };
+
+    explicit PlayoutDelayPlanner(PlayoutDelayConfig config);
+
+    const PlayoutDelayConfig& config() const { return config_; }
+    const Plan& plan() const { return plan_; }
+
+    const Plan& update(const std::vector<PeerStats>& viewers);
+
+private:
+    PlayoutDelayConfig config_;
+    Plan plan_;
+    int calm_samples_ = 0;
+};
@@ -0,0 +1,311 @@
+#include "PreEncodedVideo.h"
+#include "Metrics.h"
+
+#include <api/units/time_delta.h>
+#include <api/video/i420_buffer.h>
+#include <api/video/video_frame.h>
+#include <modules/video_coding/codecs/interface/common_constants.h>
+#include <modules/video_coding/include/video_codec_interface.h>
+#include <modules/video_coding/include/video_error_codes.h>
+#include <rtc_base/ref_counted_object.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+    constexpr std::size_t kIvfHeaderBytes = 32;
+    constexpr std::size_t kIvfFrameHeaderBytes = 12;
+    // A rung is picked when its average bitrate is within this much of the
+    // viewer's target; the rungs are encoded CBR, so the average is close.
+    constexpr double kRungHeadroom = 1.1;
+
+    uint16_t le16(const uint8_t* p) { return static_cast<uint16_t>(p[0] | (p[1] << 8)); }
+    uint32_t le32(const uint8_t* p) {
+        return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+            (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    class PreEncodedVideoEncoder : public webrtc::VideoEncoder {
+    public:
+        PreEncodedVideoEncoder(std::unique_ptr<webrtc::VideoEncoder> inner, std::shared_ptr<BroadcastEncoderHub> hub)
+            : inner_(std::move(inner)), hub_(std::move(hub)) {
+        }
+
+        // The real encoder is initialised as usual; it costs memory, but no
+        // CPU until a decoded frame actually arrives.
+        int InitEncode(const webrtc::VideoCodec* codec_settings,
+            const webrtc::VideoEncoder::Settings& settings) override {
+            rung_ = -1;
+            return inner_->InitEncode(codec_settings, settings);
+        }
+
+        int32_t RegisterEncodeCompleteCallback(webrtc::EncodedImageCallback* callback) override {
+            callback_ = callback;
+            return inner_->RegisterEncodeCompleteCallback(callback);
+        }
+
+        int32_t Release() override {
+            return inner_->Release();
+        }
+
+        int32_t Encode(const webrtc::VideoFrame& frame,
+            const std::vector<webrtc::VideoFrameType>* frame_types) override {
+            static auto& forwarded = Metrics::instance().counter("rtc_ladder_frames_total");
+            static auto& switches = Metrics::instance().counter("rtc_ladder_switches_total");
+            static auto& waits = Metrics::instance().counter("rtc_ladder_keyframe_waits_total");
+
+            const auto buffer = frame.video_frame_buffer();
+            if (buffer->type() != webrtc::VideoFrameBuffer::Type::kNative) {
+                passthrough_ = false;
+                return inner_->Encode(frame, frame_types);
+            }
+            passthrough_ = true;
+            if (!callback_) return WEBRTC_VIDEO_CODEC_UNINITIALIZED;
+
+            // Keyframes cannot be made on request; a viewer that asks for one
+            // gets the next one on the GOP grid.
+            const auto* ladder = static_cast<const PreEncodedFrameBuffer*>(buffer.get());
+            const auto& rungs = ladder->rungs();
+            // A delta frame whose predecessor never went out (dropped by
+            // the frame rate limit, or a pause) would not decode either.
+            if (!ladder->key() && ladder->index() != last_index_ + 1) rung_ = -1;
+            last_index_ = ladder->index();
+            if (ladder->key()) {
+                const int want = pickRung(rungs);
+                if (rung_ >= 0 && want != rung_) switches.inc();
+                rung_ = want;
+            }
+            if (rung_ < 0 || rung_ >= static_cast<int>(rungs.size())) {
+                waits.inc();
+                callback_->OnDroppedFrame(webrtc::EncodedImageCallback::DropReason::kDroppedByEncoder);
+                return WEBRTC_VIDEO_CODEC_OK;
+            }
+
+            const auto& rung = rungs[rung_];
+            webrtc::EncodedImage image;
+            image.SetEncodedData(rung.data);
+            image._encodedWidth = rung.width;
+            image._encodedHeight = rung.height;
+            image._frameType = ladder->key() ? webrtc::VideoFrameType::kVideoFrameKey
+                : webrtc::VideoFrameType::kVideoFrameDelta;
+            image.SetRtpTimestamp(frame.rtp_timestamp());
+            image.capture_time_ms_ = frame.render_time_ms();
+            image.rotation_ = webrtc::kVideoRotation_0;
+            int min_ms = 0;
+            int max_ms = 0;
+            if (hub_->playoutDelay(min_ms, max_ms)) {
+                image.SetPlayoutDelay(webrtc::VideoPlayoutDelay(
+                    webrtc::TimeDelta::Millis(min_ms), webrtc::TimeDelta::Millis(max_ms)));
+            }
+
+            webrtc::CodecSpecificInfo info;
+            info.codecType = webrtc::kVideoCodecVP8;
+            info.codecSpecific.VP8.nonReference = false;
+            info.codecSpecific.VP8.temporalIdx = webrtc::kNoTemporalIdx;
+            info.codecSpecific.VP8.layerSync = false;
+            info.codecSpecific.VP8.keyIdx = webrtc::kNoKeyIdx;
+
+            callback_->OnEncodedImage(image, &info);
+            forwarded.inc();
+            return WEBRTC_VIDEO_CODEC_OK;
+        }
+
+        void SetRates(const RateControlParameters& parameters) override {
+            target_bps_ = parameters.bitrate.get_sum_bps();
+            inner_->SetRates(parameters);
+        }
+
+        void OnPacketLossRateUpdate(float packet_loss_rate) override {
+            inner_->OnPacketLossRateUpdate(packet_loss_rate);
+        }
+
+        void OnRttUpdate(int64_t rtt_ms) override {
+            inner_->OnRttUpdate(rtt_ms);
+        }
+
+        EncoderInfo GetEncoderInfo() const override {
+            EncoderInfo info = inner_->GetEncoderInfo();
+            info.supports_native_handle = true;
+            if (passthrough_) {
+                // Frame sizes are whatever the rung has; there is no rate
+                // controller to second-guess and no resolution to scale.
+                info.implementation_name = "PreEncoded";
+                info.has_trusted_rate_controller = true;
+                info.scaling_settings = ScalingSettings(ScalingSettings::kOff);
+            }
+            return info;
+        }
+
+    private:
+        // Highest rung the viewer's target rate carries; the lowest when none does.
+        int pickRung(const std::vector<PreEncodedFrameBuffer::Rung>& rungs) const {
+            int best = 0;
+            for (std::size_t i = 0; i < rungs.size(); ++i) {
+                if (rungs[i].bitrate_bps <= target_bps_ * kRungHeadroom) best = static_cast<int>(i);
+            }
+            return best;
+        }
+
+        std::unique_ptr<webrtc::VideoEncoder> inner_;
+        std::shared_ptr<BroadcastEncoderHub> hub_;
+        webrtc::EncodedImageCallback* callback_ = nullptr;
+        uint32_t target_bps_ = 0;
+        int rung_ = -1;
+        int64_t last_index_ = -1;
+        bool passthrough_ = false;
+    };
+
+}
+
+PreEncodedFrameBuffer::PreEncodedFrameBuffer(std::vector<Rung> rungs, bool key, int64_t index)
+    : rungs_(std::move(rungs)), key_(key), index_(index) {
+}
+
+int PreEncodedFrameBuffer::width() const {
+    return rungs_.empty() ? 0 : rungs_.back().width;
+}
+
+int PreEncodedFrameBuffer::height() const {
+    return rungs_.empty() ? 0 : rungs_.back().height;
+}
+
+webrtc::scoped_refptr<webrtc::I420BufferInterface> PreEncodedFrameBuffer::ToI420() {
+    static auto& black = Metrics::instance().counter("rtc_ladder_black_frames_total");
+    black.inc();
+    auto buffer = webrtc::I420Buffer::Create(std::max(width(), 2), std::max(height(), 2));
+    webrtc::I420Buffer::SetBlack(buffer.get());
+    return buffer;
+}
+
+bool PreEncodedLadder::open(const std::vector<std::string>& rung_paths) {
+    rungs_.clear();
+    keys_.clear();
+    fps_ = 0.0;
+    frame_count_ = 0;
+    if (rung_paths.empty()) return false;
+
+    for (const auto& path : rung_paths) {
+        RungFile rung;
+        rung.path = path;
+        if (!rung.file.open(path, RandomAccessFile::Mode::kRead)) {
+            std::cerr << "[LADDER] Cannot open " << path << ": " << RandomAccessFile::lastError() << std::endl;
+            return false;
+        }
+
+        std::vector<bool> keys;
+        double fps = 0.0;
+        if (!index(rung, keys, fps)) return false;
+
+        if (rungs_.empty()) {
+            keys_ = std::move(keys);
+            fps_ = fps;
+            frame_count_ = static_cast<int64_t>(keys_.size());
+        }
+        else if (keys != keys_ || fps != fps_) {
+            // Switching is only seamless when every rung has its keyframes
+            // on the same frames.
+            std::cerr << "[LADDER] " << path << " is not aligned with " << rungs_.front().path << std::endl;
+            return false;
+        }
+        rungs_.push_back(std::move(rung));
+    }
+    return frame_count_ > 0 && !keys_.empty() && keys_.front();
+}
+
+int PreEncodedLadder::width() const {
+    return rungs_.empty() ? 0 : rungs_.back().width;
+}
+
+int PreEncodedLadder::height() const {
+    return rungs_.empty() ? 0 : rungs_.back().height;
+}
+
+int64_t PreEncodedLadder::keyframeAtOrBefore(int64_t frame) const {
+    frame = std::clamp<int64_t>(frame, 0, frame_count_ - 1);
+    while (frame > 0 && !keys_[frame]) --frame;
+    return frame;
+}
+
+webrtc::scoped_refptr<PreEncodedFrameBuffer> PreEncodedLadder::frame(int64_t index) {
+    if (index < 0 || index >= frame_count_) return nullptr;
+
+    std::vector<PreEncodedFrameBuffer::Rung> out;
+    out.reserve(rungs_.size());
+    for (auto& rung : rungs_) {
+        const FrameEntry& e = rung.frames[index];
+        auto data = webrtc::EncodedImageBuffer::Create(e.size);
+        if (rung.file.readAt(e.offset, data->data(), e.size) != static_cast<int64_t>(e.size)) {
+            std::cerr << "[LADDER] Short read in " << rung.path << " at frame " << index << std::endl;
+            return nullptr;
+        }
+        PreEncodedFrameBuffer::Rung r;
+        r.data = std::move(data);
+        r.width = rung.width;
+        r.height = rung.height;
+        r.bitrate_bps = rung.bitrate_bps;
+        out.push_back(std::move(r));
+    }
+    return webrtc::scoped_refptr<PreEncodedFrameBuffer>(
+        new webrtc::RefCountedObject<PreEncodedFrameBuffer>(std::move(out), keys_[index], index));
+}
+
+bool PreEncodedLadder::index(RungFile& rung, std::vector<bool>& keys, double& fps) {
+    uint8_t header[kIvfHeaderBytes];
+    if (rung.file.readAt(0, header, sizeof(header)) != static_cast<int64_t>(sizeof(header)) ||
+        std::memcmp(header, "DKIF", 4) != 0 || std::memcmp(header + 8, "VP80", 4) != 0) {
+        std::cerr << "[LADDER] " << rung.path << " is not a VP8 IVF file" << std::endl;
+        return false;
+    }
+    rung.width = le16(header + 12);
+    rung.height = le16(header + 14);
+    const uint32_t rate = le32(header + 16);
+    const uint32_t scale = le32(header + 20);
+    if (rate == 0 || scale == 0) return false;
+    fps = static_cast<double>(rate) / scale;
+
+    // Frame headers only, plus the first payload byte: bit 0 clear marks a
+    // VP8 keyframe.
+    const int64_t file_size = rung.file.size();
+    uint64_t offset = le16(header + 6);
+    uint64_t total_bytes = 0;
+    uint8_t fh[kIvfFrameHeaderBytes + 1];
+    while (offset + kIvfFrameHeaderBytes < static_cast<uint64_t>(file_size)) {
+        if (rung.file.readAt(offset, fh, sizeof(fh)) != static_cast<int64_t>(sizeof(fh))) return false;
+        const uint32_t size = le32(fh);
+        if (size == 0 || offset + kIvfFrameHeaderBytes + size > static_cast<uint64_t>(file_size)) {
+            std::cerr << "[LADDER] " << rung.path << " is truncated" << std::endl;
+            return false;
+        }
+        rung.frames.push_back({ offset + kIvfFrameHeaderBytes, size });
+        keys.push_back((fh[kIvfFrameHeaderBytes] & 1) == 0);
+        total_bytes += size;
+        offset += kIvfFrameHeaderBytes + size;
+    }
+    if (rung.frames.empty()) return false;
+    rung.bitrate_bps = static_cast<int64_t>(total_bytes * 8 * fps / rung.frames.size());
+    return true;
+}
+
+PreEncodedVideoEncoderFactory::PreEncodedVideoEncoderFactory(std::unique_ptr<webrtc::VideoEncoderFactory> inner,
+    std::shared_ptr<BroadcastEncoderHub> hub)
+    : inner_(std::move(inner)), hub_(std::move(hub)) {
+}
+
+std::vector<webrtc::SdpVideoFormat> PreEncodedVideoEncoderFactory::GetSupportedFormats() const {
+    return inner_->GetSupportedFormats();
+}
+
+webrtc::VideoEncoderFactory::CodecSupport PreEncodedVideoEncoderFactory::QueryCodecSupport(
+    const webrtc::SdpVideoFormat& format,
+    std::optional<std::string> scalability_mode) const {
+    return inner_->QueryCodecSupport(format, std::move(scalability_mode));
+}
+
+std::unique_ptr<webrtc::VideoEncoder> PreEncodedVideoEncoderFactory::Create(const webrtc::Environment& env,
+    const webrtc::SdpVideoFormat& format) {
+    auto inner = inner_->Create(env, format);
+    if (!inner || format.name != "VP8") return inner;
+    return std::make_unique<PreEncodedVideoEncoder>(std::move(inner), hub_);
+}
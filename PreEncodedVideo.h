@@ -0,0 +1,115 @@
+#pragma once
+
+#include "BroadcastVideoEncoder.h"
+#include "FileIO.h"
+
+#include <api/scoped_refptr.h>
+#include <api/video/encoded_image.h>
+#include <api/video/video_frame_buffer.h>
+#include <api/video_codecs/sdp_video_format.h>
+#include <api/video_codecs/video_encoder.h>
+#include <api/video_codecs/video_encoder_factory.h>
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Playback of the offline VP8 ladder the Transcoder writes next to each
+// upload: one IVF file per rung, same frame rate, same frame count and
+// keyframes on the same frames. The capture loop hands every tick to the
+// senders as a PreEncodedFrameBuffer holding that frame of every rung, and
+// each viewer's PreEncodedVideoEncoder forwards the rung that fits its
+// target rate instead of encoding anything.
+
+// One frame of every rung. A kNative buffer: the only native frames this
+// process produces, which is how the encoder recognises them without RTTI.
+class PreEncodedFrameBuffer : public webrtc::VideoFrameBuffer {
+public:
+    struct Rung {
+        webrtc::scoped_refptr<webrtc::EncodedImageBuffer> data;
+        int width = 0;
+        int height = 0;
+        int64_t bitrate_bps = 0; // the rung's average over the whole file
+    };
+
+    PreEncodedFrameBuffer(std::vector<Rung> rungs, bool key, int64_t index);
+
+    Type type() const override { return Type::kNative; }
+    // The top rung's size, which is what the senders are configured for.
+    int width() const override;
+    int height() const override;
+    // Only reached by a consumer that cannot pass through (a viewer that
+    // negotiated something other than VP8): there are no pixels, so black.
+    webrtc::scoped_refptr<webrtc::I420BufferInterface> ToI420() override;
+
+    const std::vector<Rung>& rungs() const { return rungs_; }
+    bool key() const { return key_; }
+    // Frame number in the files; a delta frame only decodes after index - 1.
+    int64_t index() const { return index_; }
+
+private:
+    std::vector<Rung> rungs_; // lowest bitrate first
+    bool key_;
+    int64_t index_;
+};
+
+// Reads a ladder frame by frame. Not thread-safe; the capture thread owns it.
+class PreEncodedLadder {
+public:
+    // False unless every rung is a VP8 IVF file and all of them agree on
+    // frame rate, frame count and keyframe positions.
+    bool open(const std::vector<std::string>& rung_paths);
+
+    double fps() const { return fps_; }
+    int64_t frameCount() const { return frame_count_; }
+    int width() const;
+    int height() const;
+
+    // The keyframe a seek to `frame` starts from.
+    int64_t keyframeAtOrBefore(int64_t frame) const;
+
+    // nullptr on a read error.
+    webrtc::scoped_refptr<PreEncodedFrameBuffer> frame(int64_t index);
+
+private:
+    struct FrameEntry {
+        uint64_t offset = 0;
+        uint32_t size = 0;
+    };
+    struct RungFile {
+        std::string path;
+        RandomAccessFile file;
+        int width = 0;
+        int height = 0;
+        int64_t bitrate_bps = 0;
+        std::vector<FrameEntry> frames;
+    };
+
+    bool index(RungFile& rung, std::vector<bool>& keys, double& fps);
+
+    std::vector<RungFile> rungs_;
+    std::vector<bool> keys_;
+    double fps_ = 0.0;
+    int64_t frame_count_ = 0;
+};
+
+// Wraps the real factory. VP8 encoders come back as pass-through encoders
+// that still own a real one for ordinary decoded frames; other codecs are
+// returned unchanged.
+class PreEncodedVideoEncoderFactory : public webrtc::VideoEncoderFactory {
+public:
+    PreEncodedVideoEncoderFactory(std::unique_ptr<webrtc::VideoEncoderFactory> inner,
+        std::shared_ptr<BroadcastEncoderHub> hub);
+
+    std::vector<webrtc::SdpVideoFormat> GetSupportedFormats() const override;
+    CodecSupport QueryCodecSupport(const webrtc::SdpVideoFormat& format,
+        std::optional<std::string> scalability_mode) const override;
+    std::unique_ptr<webrtc::VideoEncoder> Create(const webrtc::Environment& env,
+        const webrtc::SdpVideoFormat& format) override;
+
+private:
+    std::unique_ptr<webrtc::VideoEncoderFactory> inner_;
+    std::shared_ptr<BroadcastEncoderHub> hub_;
+};
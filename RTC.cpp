@@ -1,58 +1,104 @@
 ﻿#include "Listener.h"
 #include "HttpServer.h"
 #include "SharedState.h"
+#include "IoContextPool.h"
+#include "MediaCatalog.h"
+#include "SignalingMessage.h"
+#include "StaticAssets.h"
+#include "Transcoder.h"
+#include "UploadRegistry.h"
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/signal_set.hpp>
+#include <csignal>
 #include <iostream>
-#include <vector>
-#include <thread>
 #include <filesystem>
 
 namespace net = boost::asio;
 using tcp = net::ip::tcp;
 
 int main() {
+#ifndef _WIN32
+    // sendfile (GET /media) has no MSG_NOSIGNAL: a viewer closing the tab
+    // mid-download must be an EPIPE, not the end of the process.
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
     try {
         const auto address = net::ip::make_address("0.0.0.0");
         const unsigned short ws_port = 8080;  
         const unsigned short http_port = 8081; 
-        const int threads = 4;
 
- 
+        // kShared: one io_context run by `threads` threads.
+        // kPerCore: one io_context per thread, each with its own SO_REUSEPORT
+        // acceptors for both ports (Linux; elsewhere falls back to kShared).
+        const auto mode = IoContextPool::Mode::kShared;
+        const std::size_t threads = 4; // 0 = one per logical core
+        const bool pin_threads = false;
 
         std::cout << "WebSocket (signaling): ws://" << address << ":" << ws_port << "\n";
         std::cout << "HTTP (UI & upload):    http://" << address << ":" << http_port << "\n";
 
 
-        net::io_context ioc{ threads };
-        auto state = std::make_shared<SharedState>();
+        IoContextPool pool(mode, threads, pin_threads);
+        const bool reuse_port = pool.mode() == IoContextPool::Mode::kPerCore;
 
-        std::make_shared<Listener>(ioc, tcp::endpoint{ address, ws_port }, state)->run();
+        EngineConfig engine;
+        engine.control_channel = false; // true: move signaling onto a data channel once connected
+        auto state = std::make_shared<SharedState>(engine);
 
+        // Connection caps and the handshake deadline apply across every
+        // Listener, whatever the threading mode.
+        auto admission = std::make_shared<AdmissionController>(AdmissionConfig());
 
         std::filesystem::create_directories("./uploads");
-        std::make_shared<HttpServer>(ioc, tcp::endpoint{ address, http_port }, "./uploads", "./web")->run();
+        auto uploads = std::make_shared<UploadRegistry>("./uploads");
+        auto catalog = std::make_shared<MediaCatalog>("./uploads");
 
-
-        net::signal_set signals(ioc, SIGINT, SIGTERM);
-        signals.async_wait([&ioc](boost::system::error_code const&, int) {
-            std::cout << "\nStopping server..." << std::endl;
-            ioc.stop();
+        // Every readable upload gets a normalized rendition in
+        // ./uploads/mezzanine, plus a VP8 rung per viewer layer for
+        // pass-through playback; progress goes out to every viewer.
+        TranscoderConfig transcode;
+        transcode.ladder = engine.video_layers;
+        auto transcoder = std::make_shared<Transcoder>("./uploads", transcode);
+        std::weak_ptr<SharedState> weak_state = state;
+        transcoder->setProgressListener([weak_state](const TranscodeProgress& p) {
+            auto s = weak_state.lock();
+            if (!s) return;
+            const char* name = transcodeStateName(p.state);
+            if (p.state == TranscodeProgress::State::kQueued || p.state == TranscodeProgress::State::kRunning) {
+                s->broadcast(SignalingMessage::transcodeProgress(p.file_path, name,
+                    static_cast<int>(p.progress * 100.0), static_cast<int>(p.fps + 0.5)));
+            }
+            else {
+                s->broadcast(SignalingMessage::transcodeDone(p.file_path, name, p.rendition, p.rungs));
+            }
+            });
+        transcoder->start();
+        state->setTranscoder(transcoder, catalog);
+        catalog->setListener([transcoder](const MediaInfo& m) {
+            transcoder->enqueue(m.file_path, TranscodePriority::kNormal);
             });
+        catalog->load();
 
-        std::vector<std::thread> workers;
-        workers.reserve(threads - 1);
-        for (int i = threads - 1; i > 0; --i) {
-            workers.emplace_back([&ioc]() {
-                ioc.run();
-                });
+        // The UI, read once and shared by every HttpServer.
+        auto assets = std::make_shared<StaticAssetCache>("./web");
+        assets->load();
+
+        for (std::size_t i = 0; i < pool.size(); ++i) {
+            auto& ioc = pool.at(i);
+            std::make_shared<Listener>(ioc, tcp::endpoint{ address, ws_port }, state, WebSocketOptions(), reuse_port, admission)->run();
+            std::make_shared<HttpServer>(ioc, tcp::endpoint{ address, http_port }, uploads, catalog, assets, reuse_port)->run();
         }
 
-        ioc.run();
 
-        for (auto& t : workers) {
-            t.join();
-        }
+        pool.startLagProbes();
+
+        net::signal_set signals(pool.at(0), SIGINT, SIGTERM);
+        signals.async_wait([&pool](boost::system::error_code const&, int) {
+            std::cout << "\nStopping server..." << std::endl;
+            pool.stop();
+            });
+
+        pool.run();
 
         std::cout << "Server stopped cleanly." << std::endl;
     }
@@ -61,4 +107,4 @@ int main() {
         return EXIT_FAILURE;
     }
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -3,6 +3,11 @@
 #pragma warning(disable: 4566)
 
 #include "RTCManager.h"
+#include "CpuTime.h"
+#include "FileIO.h"
+#include "IngestRegistry.h"
+#include "Metrics.h"
+#include "PreEncodedVideo.h"
 #include <rtc_base/ref_counted_object.h>
 #include <rtc_base/ref_count.h>
 #include <rtc_base/ssl_adapter.h>
@@ -11,10 +16,14 @@
 #include <api/rtc_event_log/rtc_event_log_factory.h>
 #include <api/task_queue/default_task_queue_factory.h>
 #include <api/jsep.h>
+#include <api/stats/rtc_stats_collector_callback.h>
+#include <api/stats/rtcstats_objects.h>
+#include <api/rtp_parameters.h>
+#include <api/rtp_transceiver_interface.h>
 #include <iostream>
-#include <nlohmann/json.hpp>
 #include <thread>
 #include <chrono>
+#include <algorithm>
 #include <api/video/i420_buffer.h>
 #include <media/base/adapted_video_track_source.h>
 
@@ -26,10 +35,95 @@ extern "C" {
 #include <libavutil/error.h>
 }
 
-using json = nlohmann::json;
-
 static const std::string STREAM_ID = "video_stream_0";
 
+// AVIO over a file that is still being uploaded: reads past the committed
+// prefix wait for the writer instead of returning EOF, so the demuxer sees a
+// slow file rather than a truncated one. Works whenever the container can be
+// read front to back (fragmented MP4, WebM, faststart MP4); a trailing moov
+// simply means the open waits for the whole upload.
+class ProgressiveInput {
+public:
+    static constexpr int kBufferBytes = 256 * 1024;
+    static constexpr std::chrono::milliseconds kPollInterval{ 100 }; // for Stop()
+
+    ProgressiveInput(std::shared_ptr<IngestFile> ingest, const std::atomic<bool>* running)
+        : ingest_(std::move(ingest)), running_(running) {
+    }
+
+    bool open(const std::string& path) {
+        return file_.open(path, RandomAccessFile::Mode::kRead);
+    }
+
+    static int read(void* opaque, uint8_t* buf, int size) {
+        static auto& stalls = Metrics::instance().counter("ingest_read_stalls_total");
+        auto* in = static_cast<ProgressiveInput*>(opaque);
+
+        bool stalled = false;
+        while (true) {
+            const auto p = in->ingest_->waitBeyond(in->pos_, kPollInterval);
+            uint64_t end = p.committed;
+            if (p.finished && !p.failed) {
+                const int64_t size_now = in->file_.size();
+                if (size_now > 0) end = std::max<uint64_t>(end, static_cast<uint64_t>(size_now));
+            }
+
+            if (end > in->pos_) {
+                const std::size_t want = static_cast<std::size_t>(std::min<uint64_t>(static_cast<uint64_t>(size), end - in->pos_));
+                const int64_t n = in->file_.readAt(in->pos_, buf, want);
+                if (n < 0) return AVERROR(EIO);
+                if (n == 0) return AVERROR_EOF;
+                in->pos_ += static_cast<uint64_t>(n);
+                return static_cast<int>(n);
+            }
+            // Abandoned uploads end in an error, not EOF, so looping does not
+            // replay a truncated file.
+            if (p.finished) return p.failed ? AVERROR(EIO) : AVERROR_EOF;
+            if (!in->running_->load()) return AVERROR_EXIT;
+
+            if (!stalled) {
+                stalled = true;
+                stalls.inc();
+            }
+        }
+    }
+
+    static int64_t seek(void* opaque, int64_t offset, int whence) {
+        auto* in = static_cast<ProgressiveInput*>(opaque);
+        whence &= ~AVSEEK_FORCE;
+
+        int64_t size = -1;
+        const auto p = in->ingest_->progress();
+        if (p.expected > 0) size = static_cast<int64_t>(p.expected);
+        else if (p.finished) size = in->file_.size();
+
+        switch (whence) {
+        case AVSEEK_SIZE:
+            return size >= 0 ? size : AVERROR(ENOSYS);
+        case SEEK_SET:
+            break;
+        case SEEK_CUR:
+            offset += static_cast<int64_t>(in->pos_);
+            break;
+        case SEEK_END:
+            if (size < 0) return AVERROR(ENOSYS);
+            offset += size;
+            break;
+        default:
+            return AVERROR(EINVAL);
+        }
+        if (offset < 0) return AVERROR(EINVAL);
+        in->pos_ = static_cast<uint64_t>(offset);
+        return offset;
+    }
+
+private:
+    std::shared_ptr<IngestFile> ingest_;
+    const std::atomic<bool>* running_;
+    RandomAccessFile file_;
+    uint64_t pos_ = 0;
+};
+
 class LocalSetSessionDescriptionObserver : public webrtc::SetLocalDescriptionObserverInterface {
 public:
     static webrtc::scoped_refptr<webrtc::SetLocalDescriptionObserverInterface> Create() {
@@ -60,15 +154,71 @@ public:
 
 class RTCManager::DataChannelObserver : public webrtc::DataChannelObserver {
 public:
-    explicit DataChannelObserver(const std::string& id) : client_id_(id) {}
+    DataChannelObserver(RTCManager* manager, const std::string& id, webrtc::DataChannelInterface* channel)
+        : manager_(manager), client_id_(id), channel_(channel) {}
     void OnStateChange() override {
         std::cout << "[DC] State changed for " << client_id_ << std::endl;
+        // A freshly opened channel has missed every broadcast so far; ask for
+        // one right away instead of waiting for the next heartbeat.
+        if (channel_->state() == webrtc::DataChannelInterface::kOpen && manager_->sync_request_handler_) {
+            manager_->sync_request_handler_();
+        }
     }
     void OnMessage(const webrtc::DataBuffer& buffer) override {
+        if (buffer.binary) {
+            const int64_t t1 = wallClockUs();
+            PingFrame ping;
+            if (decodePingFrame(buffer.data.cdata(), buffer.size(), ping)) {
+                PongFrame pong;
+                pong.seq = ping.seq;
+                pong.t0_us = ping.t0_us;
+                pong.t1_us = t1;
+                uint8_t bytes[kPongFrameSize];
+                pong.t2_us = wallClockUs();
+                encodePongFrame(pong, bytes);
+                channel_->SendAsync(webrtc::DataBuffer(webrtc::CopyOnWriteBuffer(bytes, kPongFrameSize), true), nullptr);
+
+                if (ping.rtt_us > 0) manager_->onClockReport(client_id_, ping);
+                return;
+            }
+            TelemetryFrame telemetry;
+            if (decodeTelemetryFrame(buffer.data.cdata(), buffer.size(), telemetry)) {
+                manager_->onTelemetry(client_id_, telemetry);
+                return;
+            }
+        }
         std::cout << "[DC] Message received from " << client_id_ << std::endl;
     }
 private:
+    RTCManager* manager_;
+    std::string client_id_;
+    webrtc::DataChannelInterface* channel_;
+};
+
+// Text JSON in both directions, same messages as the WebSocket carries.
+class RTCManager::ControlChannelObserver : public webrtc::DataChannelObserver {
+public:
+    ControlChannelObserver(RTCManager* manager, const std::string& id, webrtc::DataChannelInterface* channel)
+        : manager_(manager), client_id_(id), channel_(channel) {}
+    void OnStateChange() override {
+        const auto state = channel_->state();
+        if (state == webrtc::DataChannelInterface::kOpen) {
+            std::cout << "[CTRL] Control channel open for " << client_id_ << std::endl;
+        }
+        else if (state == webrtc::DataChannelInterface::kClosed) {
+            std::cout << "[CTRL] Control channel closed for " << client_id_ << std::endl;
+            manager_->onControlClosed(client_id_);
+        }
+    }
+    void OnMessage(const webrtc::DataBuffer& buffer) override {
+        if (buffer.binary) return;
+        manager_->onControlMessage(client_id_,
+            std::string(reinterpret_cast<const char*>(buffer.data.cdata()), buffer.size()));
+    }
+private:
+    RTCManager* manager_;
     std::string client_id_;
+    webrtc::DataChannelInterface* channel_;
 };
 
 class RTCManager::PeerConnectionObserver : public webrtc::PeerConnectionObserver, public webrtc::RefCountInterface {
@@ -111,14 +261,7 @@ public:
         std::cout << "[ICE] → Sending to client" << std::endl;
         std::cout << "[ICE] ========================================\n" << std::endl;
 
-        json msg = {
-            {"type", "ice_candidate"},
-            {"candidate", sdp},
-            {"sdpMid", candidate->sdp_mid()},
-            {"sdpMLineIndex", candidate->sdp_mline_index()}
-        };
-
-        callback_(msg.dump());
+        callback_(SignalingMessage::iceCandidate(sdp, candidate->sdp_mid(), candidate->sdp_mline_index()));
     }
 
     void OnDataChannel(webrtc::scoped_refptr<webrtc::DataChannelInterface> channel) override {
@@ -228,12 +371,8 @@ public:
         std::cout << "[RTC] Sending " << type_str
             << " to " << client_id_ << std::endl;
 
-        json msg = {
-            {"type", type_str},
-            {"sdp", sdp}
-        };
-
-        callback_(msg.dump());
+        callback_(SignalingMessage::description(
+            sdp_type == webrtc::SdpType::kOffer ? SignalType::kOffer : SignalType::kAnswer, sdp));
     }
 
     void OnFailure(webrtc::RTCError error) override {
@@ -247,10 +386,31 @@ private:
     webrtc::PeerConnectionInterface* pc_;
 };
 
+class RTCManager::StatsObserver : public webrtc::RTCStatsCollectorCallback {
+public:
+    StatsObserver(RTCManager* mgr, std::string clientId)
+        : mgr_(mgr), clientId_(std::move(clientId)) {
+    }
+
+    void OnStatsDelivered(const webrtc::scoped_refptr<const webrtc::RTCStatsReport>& report) override {
+        mgr_->onStatsDelivered(clientId_, report);
+    }
+
+private:
+    RTCManager* mgr_;
+    std::string clientId_;
+};
+
 RTCManager::RTCManager() {}
 
 RTCManager::~RTCManager() {
- 
+
+    // Control handlers call back into this object; let the one in flight finish.
+    if (control_thread_) control_thread_->Stop();
+
+    stats_running_ = false;
+    if (stats_thread_.joinable()) stats_thread_.join();
+
     stopGlobalStream();
 
 
@@ -267,11 +427,14 @@ RTCManager::~RTCManager() {
         closePeerConnection(id);
     }
 
-    peer_connection_factory_ = nullptr;
-
-    if (signaling_thread_) signaling_thread_->Stop();
-    if (worker_thread_) worker_thread_->Stop();
-    if (network_thread_) network_thread_->Stop();
+    for (auto& shard : shards_) {
+        shard->factory = nullptr;
+        if (shard->signaling_thread) shard->signaling_thread->Stop();
+        if (shard->worker_thread) shard->worker_thread->Stop();
+        if (shard->network_thread) shard->network_thread->Stop();
+    }
+    shards_.clear();
+    encoder_hub_.reset();
 }
 
 class RTCManager::RemoteDescriptionObserver
@@ -298,43 +461,107 @@ private:
 };
 
 void RTCManager::initialize() {
+    initialize(EngineConfig{});
+}
+
+void RTCManager::initialize(const EngineConfig& config) {
     std::cout << "[RTC] Initializing WebRTC..." << std::endl;
     webrtc::InitializeSSL();
 
-    network_thread_ = webrtc::Thread::CreateWithSocketServer();
-    network_thread_->SetName("NetworkThread", nullptr);
-    network_thread_->Start();
-
-
-    signaling_thread_ = webrtc::Thread::Create();
-    signaling_thread_->SetName("SignalingThread", nullptr);
-    signaling_thread_->Start();
-
-    worker_thread_ = webrtc::Thread::Create();
-    worker_thread_->SetName("WorkerThread", nullptr);
-    worker_thread_->Start();
-
-    peer_connection_factory_ = webrtc::CreatePeerConnectionFactory(
-        network_thread_.get(),
-        worker_thread_.get(),
-        signaling_thread_.get(),
-        nullptr,  
-        webrtc::CreateBuiltinAudioEncoderFactory(),
-        webrtc::CreateBuiltinAudioDecoderFactory(),
-        webrtc::CreateBuiltinVideoEncoderFactory(),
-        webrtc::CreateBuiltinVideoDecoderFactory(),
-        nullptr,  
-        nullptr   
-    );
+    engine_config_ = config;
+
+    int shard_count = config.shard_count;
+    if (shard_count <= 0) {
+        shard_count = static_cast<int>(std::max(1u, logicalCpuCount() / 3));
+    }
+
+    std::cout << "[RTC] Factory shards: " << shard_count << std::endl;
+    std::cout << "[RTC] Broadcast encoder: " << (config.broadcast_encoder ? "ENABLED" : "disabled") << std::endl;
+
+    sender_policy_ = std::make_unique<SenderPolicy>(config.video_layers, config.layered_video,
+        startBitratePreset(config.start_bitrate_preset), config.degradation);
+
+    std::cout << "[RTC] Start bitrate preset: " << sender_policy_->preset().name
+        << " (" << sender_policy_->preset().start_bitrate_bps / 1000 << " kbps)" << std::endl;
+    std::cout << "[RTC] Layer ladder" << (config.layered_video ? "" : " (fixed)") << ":";
+    for (const auto& l : sender_policy_->layers()) {
+        std::cout << " " << l.name << "(/" << l.scale_resolution_down_by << ", "
+            << l.max_bitrate_bps / 1000 << " kbps)";
+    }
+    std::cout << std::endl;
+
+    if (config.cpu_governor) {
+        cpu_governor_ = std::make_unique<CpuGovernor>(config.governor);
+        std::cout << "[RTC] CPU governor budget: " << config.governor.budget_percent << "%" << std::endl;
+    }
+
+    encoder_hub_ = std::make_shared<BroadcastEncoderHub>(
+        webrtc::CreateBuiltinVideoEncoderFactory(), config.broadcast_encoder);
+
+    playout_planner_ = std::make_unique<PlayoutDelayPlanner>(config.playout);
+
+    if (config.control_channel) {
+        control_thread_ = webrtc::Thread::Create();
+        control_thread_->SetName("ControlThread", nullptr);
+        control_thread_->Start();
+        std::cout << "[RTC] Control data channel enabled" << std::endl;
+    }
+    telemetry_ = std::make_unique<TelemetryAggregator>(sender_policy_->layers());
+
+    for (int i = 0; i < shard_count; ++i) {
+        auto shard = std::make_unique<FactoryShard>();
+        shard->index = i;
+        const std::string suffix = std::to_string(i);
+
+        shard->network_thread = webrtc::Thread::CreateWithSocketServer();
+        shard->network_thread->SetName("NetworkThread" + suffix, nullptr);
+        shard->network_thread->Start();
+
+
+        shard->signaling_thread = webrtc::Thread::Create();
+        shard->signaling_thread->SetName("SignalingThread" + suffix, nullptr);
+        shard->signaling_thread->Start();
+
+        shard->worker_thread = webrtc::Thread::Create();
+        shard->worker_thread->SetName("WorkerThread" + suffix, nullptr);
+        shard->worker_thread->Start();
+
+        shard->factory = webrtc::CreatePeerConnectionFactory(
+            shard->network_thread.get(),
+            shard->worker_thread.get(),
+            shard->signaling_thread.get(),
+            nullptr,  
+            webrtc::CreateBuiltinAudioEncoderFactory(),
+            webrtc::CreateBuiltinAudioDecoderFactory(),
+            std::make_unique<PreEncodedVideoEncoderFactory>(
+                std::make_unique<BroadcastVideoEncoderFactory>(encoder_hub_), encoder_hub_),
+            webrtc::CreateBuiltinVideoDecoderFactory(),
+            nullptr,  
+            nullptr   
+        );
+
+        if (!shard->factory) {
+            throw std::runtime_error("Failed to create PC Factory for shard " + suffix);
+        }
 
-    if (!peer_connection_factory_) {
-        throw std::runtime_error("Failed to create PC Factory");
+        shards_.push_back(std::move(shard));
     }
 
+    stats_running_ = true;
+    stats_thread_ = std::thread(&RTCManager::statsLoop, this);
+
     std::cout << "[RTC] WebRTC initialized successfully" << std::endl;
 }
 
 void RTCManager::createPeerConnection(const std::string& clientId, OnMessageCallback callback) {
+    if (control_thread_) {
+        // Every observer below sends through this wrapper, so once the control
+        // channel is open nothing else needs to know the WebSocket exists.
+        callback = [this, clientId, ws = std::move(callback)](const SignalingMessage& msg) {
+            routeSignaling(clientId, ws, msg);
+        };
+    }
+
     std::cout << "\n[RTC] ========================================" << std::endl;
     std::cout << "[RTC] Creating PeerConnection for " << clientId << std::endl;
     std::cout << "[RTC] ========================================" << std::endl;
@@ -390,27 +617,50 @@ void RTCManager::createPeerConnection(const std::string& clientId, OnMessageCall
     std::cout << "[ICE] Continual gathering: ENABLED" << std::endl;
     std::cout << "[RTC] ========================================\n" << std::endl;
 
+    const int shard_index = reserveShard();
+    FactoryShard& shard = *shards_[shard_index];
+
     auto observer = new webrtc::RefCountedObject<PeerConnectionObserver>(clientId, callback);
     webrtc::PeerConnectionDependencies deps(observer);
 
-    auto result = peer_connection_factory_->CreatePeerConnectionOrError(config, std::move(deps));
+    auto result = shard.factory->CreatePeerConnectionOrError(config, std::move(deps));
     if (!result.ok()) {
         std::cerr << "[ERR] ✗ CreatePeerConnection failed: " << result.error().message() << std::endl;
+        shard.peer_count--;
         return;
     }
 
+    std::cout << "[RTC] " << clientId << " assigned to shard " << shard_index
+        << " (peers: " << shard.peer_count.load() << ")" << std::endl;
+
+    const auto& preset = sender_policy_->preset();
+    webrtc::BitrateSettings bitrate;
+    bitrate.min_bitrate_bps = preset.min_bitrate_bps;
+    bitrate.start_bitrate_bps = preset.start_bitrate_bps;
+    bitrate.max_bitrate_bps = preset.max_bitrate_bps;
+    auto bitrate_err = result.value()->SetBitrate(bitrate);
+    if (!bitrate_err.ok()) {
+        std::cerr << "[RTC] SetBitrate failed for " << clientId << ": " << bitrate_err.message() << std::endl;
+    }
+
     PeerConnectionContext context;
     context.peer_connection = result.value();
     context.observer = observer;
     context.callback = callback;
+    context.shard = shard_index;
 
     webrtc::DataChannelInit dc_config;
     dc_config.ordered = true;
+    if (engine_config_.unreliable_sync_channel) {
+        // Every frame carries the full state, so a late one is worthless.
+        dc_config.ordered = false;
+        dc_config.maxRetransmits = 0;
+    }
 
     auto dc = context.peer_connection->CreateDataChannel("sync", &dc_config);
     if (dc) {
         context.data_channel = dc;
-        context.data_channel_observer = new DataChannelObserver(clientId);
+        context.data_channel_observer = new DataChannelObserver(this, clientId, dc.get());
         dc->RegisterObserver(context.data_channel_observer);
         std::cout << "[DC]  DataChannel 'sync' created for " << clientId << std::endl;
     }
@@ -420,6 +670,20 @@ void RTCManager::createPeerConnection(const std::string& clientId, OnMessageCall
         std::cerr << "[DC]  CreateDataChannel returned null for " << clientId << std::endl;
     }
 
+    if (control_thread_) {
+        webrtc::DataChannelInit control_config;
+        control_config.ordered = true;
+        auto control = context.peer_connection->CreateDataChannel("control", &control_config);
+        if (control) {
+            context.control_channel = control;
+            context.control_channel_observer = new ControlChannelObserver(this, clientId, control.get());
+            control->RegisterObserver(context.control_channel_observer);
+        }
+        else {
+            std::cerr << "[CTRL] CreateDataChannel('control') returned null for " << clientId << std::endl;
+        }
+    }
+
  
     {
         std::lock_guard<std::mutex> lock(pc_mutex_);
@@ -456,21 +720,10 @@ void RTCManager::createPeerConnection(const std::string& clientId, OnMessageCall
         }
 
 
-        auto video_track = peer_connection_factory_->CreateVideoTrack(global_video_source_, "video_label");
-        auto add_res = pc_ref->AddTrack(video_track, { STREAM_ID });
-        if (!add_res.ok()) {
-            std::cerr << "[ERR] ✗ AddTrack failed for " << clientId << ": " << add_res.error().message() << std::endl;
+        if (!attachVideoTrack(clientId, pc_ref)) {
             return;
         }
 
-        {
-            std::lock_guard<std::mutex> lk(pc_mutex_);
-            auto pit = peer_connections_.find(clientId);
-            if (pit != peer_connections_.end()) {
-                pit->second.video_track = video_track;
-            }
-        }
-
         std::cout << "[RTC] ✓ Track added, creating offer for " << clientId << std::endl;
 
         webrtc::PeerConnectionInterface::RTCOfferAnswerOptions options;
@@ -500,26 +753,532 @@ bool RTCManager::isStreaming() const {
     return global_video_source_ && global_video_source_->isPlaying();
 }
 
+int RTCManager::reserveShard() {
+    std::lock_guard<std::mutex> lock(shard_mutex_);
+    int best = 0;
+    for (int i = 1; i < static_cast<int>(shards_.size()); ++i) {
+        const auto& cand = *shards_[i];
+        const auto& cur = *shards_[best];
+        const int cand_peers = cand.peer_count.load();
+        const int cur_peers = cur.peer_count.load();
+        if (cand_peers < cur_peers ||
+            (cand_peers == cur_peers &&
+                cand.worker_probe.cpu_percent.load() < cur.worker_probe.cpu_percent.load())) {
+            best = i;
+        }
+    }
+    shards_[best]->peer_count++;
+    return best;
+}
+
+bool RTCManager::attachVideoTrack(const std::string& clientId,
+    const webrtc::scoped_refptr<webrtc::PeerConnectionInterface>& pc) {
+    if (!global_video_source_ || !pc) return false;
+
+    int shard_index = 0;
+    {
+        std::lock_guard<std::mutex> lock(pc_mutex_);
+        auto it = peer_connections_.find(clientId);
+        if (it == peer_connections_.end()) return false;
+        shard_index = it->second.shard;
+    }
+
+    auto video_track = shards_[shard_index]->factory->CreateVideoTrack(global_video_source_, "video_label");
+    auto sender_res = pc->AddTrack(video_track, { STREAM_ID });
+    if (!sender_res.ok()) {
+        std::cerr << "[ERR] ✗ AddTrack failed for " << clientId << ": " << sender_res.error().message() << std::endl;
+        return false;
+    }
+
+    if (engine_config_.playout.enabled) negotiatePlayoutDelay(clientId, pc, sender_res.value());
+
+    SenderOverrides overrides;
+    {
+        std::lock_guard<std::mutex> lock(pc_mutex_);
+        auto it = peer_connections_.find(clientId);
+        if (it != peer_connections_.end()) overrides = it->second.overrides;
+    }
+
+    int layer = -1;
+    int up_votes = 0;
+    const SenderLimits limits = sender_policy_->decide(PeerStats{}, overrides, layer, up_votes);
+    const bool applied = applySenderLimits(clientId, sender_res.value(), limits);
+
+    std::lock_guard<std::mutex> lock(pc_mutex_);
+    auto it = peer_connections_.find(clientId);
+    if (it != peer_connections_.end() && !it->second.video_track) {
+        it->second.video_track = video_track;
+        it->second.video_sender = sender_res.value();
+        it->second.layer = layer;
+        it->second.layer_up_votes = 0;
+        it->second.applied_limits = limits;
+        it->second.limits_applied = applied;
+    }
+    return true;
+}
+
+void RTCManager::negotiatePlayoutDelay(const std::string& clientId,
+    const webrtc::scoped_refptr<webrtc::PeerConnectionInterface>& pc,
+    const webrtc::scoped_refptr<webrtc::RtpSenderInterface>& sender) {
+    for (const auto& transceiver : pc->GetTransceivers()) {
+        if (transceiver->sender() != sender) continue;
+
+        auto extensions = transceiver->GetHeaderExtensionsToNegotiate();
+        bool found = false;
+        for (auto& ext : extensions) {
+            if (ext.uri != webrtc::RtpExtension::kPlayoutDelayUri) continue;
+            ext.direction = webrtc::RtpTransceiverDirection::kSendRecv;
+            found = true;
+        }
+        if (!found) {
+            std::cerr << "[SYNC] Playout-delay extension not offered by the engine for " << clientId << std::endl;
+            return;
+        }
+
+        auto err = transceiver->SetHeaderExtensionsToNegotiate(extensions);
+        if (!err.ok()) {
+            std::cerr << "[SYNC] Cannot negotiate playout-delay for " << clientId << ": " << err.message() << std::endl;
+        }
+        return;
+    }
+}
+
+void RTCManager::updatePlayoutDelay(const std::vector<PeerStats>& viewers) {
+    if (!playout_planner_) return;
+
+    const auto previous = playout_planner_->plan();
+    const auto& plan = playout_planner_->update(viewers);
+
+    if (plan.target_ms != previous.target_ms || plan.min_delay_ms != previous.min_delay_ms ||
+        plan.max_delay_ms != previous.max_delay_ms) {
+        if (encoder_hub_) encoder_hub_->setPlayoutDelay(plan.target_ms > 0 ? plan.min_delay_ms : -1, plan.max_delay_ms);
+        if (plan.target_ms != previous.target_ms) {
+            std::cout << "[SYNC] Room playout target " << previous.target_ms << " -> " << plan.target_ms
+                << " ms (jitter buffers " << plan.min_delay_ms << ".." << plan.max_delay_ms << " ms)" << std::endl;
+        }
+    }
+    playout_target_ms_ = plan.target_ms;
+
+    auto& metrics = Metrics::instance();
+    metrics.gauge("rtc_playout_target_ms").set(plan.target_ms);
+    metrics.gauge("rtc_playout_min_delay_ms").set(plan.min_delay_ms);
+    metrics.gauge("rtc_playout_max_delay_ms").set(plan.max_delay_ms);
+
+    // Spread of reported send-to-render offsets: how tight the room actually is.
+    double lo = -1.0, hi = 0.0;
+    {
+        std::lock_guard<std::mutex> lock(pc_mutex_);
+        for (const auto& [id, ctx] : peer_connections_) {
+            (void)id;
+            if (ctx.clock.render_offset_ms <= 0.0) continue;
+            lo = lo < 0.0 ? ctx.clock.render_offset_ms : std::min(lo, ctx.clock.render_offset_ms);
+            hi = std::max(hi, ctx.clock.render_offset_ms);
+        }
+    }
+    metrics.gauge("rtc_render_offset_spread_ms").set(lo < 0.0 ? 0.0 : hi - lo);
+}
+
+std::map<std::string, PeerStats> RTCManager::getPeerStats() {
+    std::map<std::string, PeerStats> out;
+    std::lock_guard<std::mutex> lock(pc_mutex_);
+    for (const auto& [id, ctx] : peer_connections_) out[id] = ctx.stats;
+    return out;
+}
+
+void RTCManager::setSenderOverrides(const std::string& clientId, const SenderOverrides& overrides) {
+    std::lock_guard<std::mutex> lock(pc_mutex_);
+    auto it = peer_connections_.find(clientId);
+    if (it == peer_connections_.end()) return;
+    it->second.overrides = overrides;
+    // Picked up and applied by the next stats tick.
+    it->second.limits_applied = false;
+}
+
+bool RTCManager::getSenderLimits(const std::string& clientId, SenderLimits& out) {
+    std::lock_guard<std::mutex> lock(pc_mutex_);
+    auto it = peer_connections_.find(clientId);
+    if (it == peer_connections_.end() || !it->second.limits_applied) return false;
+    out = it->second.applied_limits;
+    return true;
+}
+
+std::vector<RTCManager::ShardStats> RTCManager::getShardStats() const {
+    std::vector<ShardStats> out;
+    out.reserve(shards_.size());
+    for (const auto& shard : shards_) {
+        ShardStats st;
+        st.index = shard->index;
+        st.peers = shard->peer_count.load();
+        st.network_cpu_percent = shard->network_probe.cpu_percent.load();
+        st.worker_cpu_percent = shard->worker_probe.cpu_percent.load();
+        st.signaling_cpu_percent = shard->signaling_probe.cpu_percent.load();
+        st.network_queue_delay_ms = shard->network_probe.queue_delay_ms.load();
+        st.worker_queue_delay_ms = shard->worker_probe.queue_delay_ms.load();
+        st.signaling_queue_delay_ms = shard->signaling_probe.queue_delay_ms.load();
+        out.push_back(st);
+    }
+    return out;
+}
+
+void RTCManager::statsLoop() {
+    std::cout << "[RTC] Stats loop started" << std::endl;
+
+    const auto interval = std::chrono::milliseconds(std::max(100, engine_config_.stats_interval_ms));
+    auto next = std::chrono::steady_clock::now() + interval;
+
+    while (stats_running_) {
+        std::this_thread::sleep_until(next);
+        next += interval;
+        if (!stats_running_) break;
+
+        sampleShards();
+        exportEncoderStats();
+        pollPeers();
+    }
+
+    std::cout << "[RTC] Stats loop stopped" << std::endl;
+}
+
+void RTCManager::sampleShards() {
+    auto& metrics = Metrics::instance();
+
+    for (const auto& shard : shards_) {
+        probeThread(shard->network_thread.get(), &shard->network_probe);
+        probeThread(shard->worker_thread.get(), &shard->worker_probe);
+        probeThread(shard->signaling_thread.get(), &shard->signaling_probe);
+    }
+
+    // Probes posted above land on the next tick; exporting the previous results
+    // keeps this loop from ever blocking on a busy shard.
+    for (const auto& st : getShardStats()) {
+        const std::string shard = "shard=\"" + std::to_string(st.index) + "\"";
+        metrics.gauge("rtc_shard_peers", shard).set(st.peers);
+        metrics.gauge("rtc_shard_cpu_percent", shard + ",thread=\"network\"").set(st.network_cpu_percent);
+        metrics.gauge("rtc_shard_cpu_percent", shard + ",thread=\"worker\"").set(st.worker_cpu_percent);
+        metrics.gauge("rtc_shard_cpu_percent", shard + ",thread=\"signaling\"").set(st.signaling_cpu_percent);
+        metrics.gauge("rtc_shard_queue_delay_ms", shard + ",thread=\"network\"").set(st.network_queue_delay_ms);
+        metrics.gauge("rtc_shard_queue_delay_ms", shard + ",thread=\"worker\"").set(st.worker_queue_delay_ms);
+        metrics.gauge("rtc_shard_queue_delay_ms", shard + ",thread=\"signaling\"").set(st.signaling_queue_delay_ms);
+    }
+}
+
+void RTCManager::exportEncoderStats() {
+    if (!encoder_hub_) return;
+
+    auto& metrics = Metrics::instance();
+    static auto& frames_encoded = metrics.counter("rtc_encoder_frames_encoded_total");
+    static auto& frames_deduplicated = metrics.counter("rtc_encoder_frames_deduplicated_total");
+    static auto& frames_late = metrics.counter("rtc_encoder_frames_late_total");
+    static auto& timeline_restarts = metrics.counter("rtc_encoder_timeline_restarts_total");
+    static auto& frames_fanned_out = metrics.counter("rtc_encoder_frames_fanned_out_total");
+    static auto& keyframe_requests = metrics.counter("rtc_encoder_keyframe_requests_total");
+    static auto& keyframes_forced = metrics.counter("rtc_encoder_keyframes_forced_total");
+
+    const auto st = encoder_hub_->stats();
+    auto& last = exported_encoder_stats_;
+    metrics.gauge("rtc_encoder_groups").set(st.groups);
+    metrics.gauge("rtc_encoder_members").set(st.members);
+    // The hub keeps running totals; the counters get what accrued since the
+    // last export.
+    frames_encoded.inc(st.frames_encoded - last.frames_encoded);
+    frames_deduplicated.inc(st.frames_deduplicated - last.frames_deduplicated);
+    frames_late.inc(st.frames_late - last.frames_late);
+    timeline_restarts.inc(st.timeline_restarts - last.timeline_restarts);
+    frames_fanned_out.inc(st.frames_fanned_out - last.frames_fanned_out);
+    keyframe_requests.inc(st.keyframe_requests - last.keyframe_requests);
+    keyframes_forced.inc(st.keyframes_forced - last.keyframes_forced);
+    last = st;
+}
+
+void RTCManager::pollPeers() {
+    struct Target {
+        std::string clientId;
+        webrtc::scoped_refptr<webrtc::PeerConnectionInterface> pc;
+        webrtc::scoped_refptr<webrtc::RtpSenderInterface> sender;
+        PeerStats stats;
+        SenderOverrides overrides;
+        SenderLimits applied;
+        bool limits_applied = false;
+        int layer = -1;
+        int up_votes = 0;
+    };
+
+    std::vector<Target> targets;
+    {
+        std::lock_guard<std::mutex> lock(pc_mutex_);
+        targets.reserve(peer_connections_.size());
+        for (auto& [id, ctx] : peer_connections_) {
+            if (!ctx.peer_connection) continue;
+            Target t;
+            t.clientId = id;
+            t.pc = ctx.peer_connection;
+            t.sender = ctx.video_sender;
+            t.stats = ctx.stats;
+            t.stats.viewer_fps = ctx.telemetry.fps;
+            t.stats.viewer_drop_ratio = ctx.telemetry.drop_ratio;
+            // A stall report should move the viewer down once, not on every
+            // tick until the next report arrives.
+            if (ctx.telemetry.reports != ctx.telemetry_reports_seen) {
+                t.stats.viewer_stalls = ctx.telemetry.stalls;
+                ctx.telemetry_reports_seen = ctx.telemetry.reports;
+            }
+            t.overrides = ctx.overrides;
+            t.applied = ctx.applied_limits;
+            t.limits_applied = ctx.limits_applied;
+            t.layer = ctx.layer;
+            t.up_votes = ctx.layer_up_votes;
+            targets.push_back(std::move(t));
+        }
+    }
+
+    std::map<std::string, double> encode_time_s;
+    for (const auto& t : targets) {
+        if (t.sender) encode_time_s[t.clientId] = t.stats.total_encode_time_s;
+    }
+    runGovernor(encode_time_s);
+
+    const auto& ladder = sender_policy_->layers();
+    std::vector<int> per_layer(ladder.size(), 0);
+
+    for (auto& t : targets) {
+        if (t.sender) {
+            const int prev_layer = t.layer;
+            SenderLimits limits = sender_policy_->decide(t.stats, t.overrides, t.layer, t.up_votes);
+            if (cpu_governor_) {
+                CpuGovernor::constrain(limits, cpu_governor_->level(t.clientId),
+                    encoder_hub_ && encoder_hub_->shared() ? &ladder : nullptr);
+            }
+
+            if ((!t.limits_applied || limits != t.applied) && applySenderLimits(t.clientId, t.sender, limits)) {
+                if (limits.layer != prev_layer && limits.layer >= 0) {
+                    std::cout << "[LAYER] " << t.clientId << ": "
+                        << (prev_layer >= 0 ? ladder[prev_layer].name : "-") << " -> "
+                        << ladder[limits.layer].name
+                        << " (available " << static_cast<int>(t.stats.available_outgoing_bitrate_bps / 1000)
+                        << " kbps, loss " << t.stats.fraction_lost << ")" << std::endl;
+                    Metrics::instance().counter("rtc_layer_switches_total").inc();
+                }
+                t.applied = limits;
+                t.limits_applied = true;
+            }
+            else if (t.limits_applied) {
+                t.layer = t.applied.layer;
+            }
+
+            std::lock_guard<std::mutex> lock(pc_mutex_);
+            auto it = peer_connections_.find(t.clientId);
+            if (it != peer_connections_.end() && it->second.video_sender == t.sender) {
+                it->second.layer = t.layer;
+                it->second.layer_up_votes = t.up_votes;
+                it->second.applied_limits = t.applied;
+                it->second.limits_applied = t.limits_applied;
+            }
+        }
+
+        if (t.layer >= 0 && t.layer < static_cast<int>(per_layer.size())) {
+            per_layer[t.layer]++;
+            // Per-client series are removed under pc_mutex_ on close; set
+            // them under it too, and only while the peer is still there.
+            std::lock_guard<std::mutex> lock(pc_mutex_);
+            if (peer_connections_.count(t.clientId)) {
+                Metrics::instance().gauge("rtc_viewer_layer", "client=\"" + t.clientId + "\"").set(t.layer);
+            }
+        }
+
+        t.pc->GetStats(webrtc::make_ref_counted<StatsObserver>(this, t.clientId).get());
+    }
+
+    for (std::size_t i = 0; i < per_layer.size(); ++i) {
+        Metrics::instance().gauge("rtc_layer_viewers",
+            "layer=\"" + ladder[i].name + "\"").set(per_layer[i]);
+    }
+
+    std::vector<PeerStats> viewers;
+    viewers.reserve(targets.size());
+    for (const auto& t : targets) {
+        if (t.sender) viewers.push_back(t.stats);
+    }
+    updatePlayoutDelay(viewers);
+}
+
+void RTCManager::onStatsDelivered(const std::string& clientId,
+    const webrtc::scoped_refptr<const webrtc::RTCStatsReport>& report) {
+    if (!report) return;
+
+    PeerStats st;
+    st.updated_ms = webrtc::TimeMillis();
+
+    for (const auto* pair : report->GetStatsOfType<webrtc::RTCIceCandidatePairStats>()) {
+        if (!pair->nominated.value_or(false)) continue;
+        if (pair->state.value_or("") != "succeeded") continue;
+        if (pair->available_outgoing_bitrate) st.available_outgoing_bitrate_bps = *pair->available_outgoing_bitrate;
+        if (pair->current_round_trip_time) st.rtt_ms = *pair->current_round_trip_time * 1000.0;
+    }
+
+    for (const auto* out : report->GetStatsOfType<webrtc::RTCOutboundRtpStreamStats>()) {
+        if (out->kind.value_or("") != "video") continue;
+        st.bytes_sent += out->bytes_sent.value_or(0);
+        st.frames_encoded += out->frames_encoded.value_or(0);
+        st.total_encode_time_s += out->total_encode_time.value_or(0.0);
+        st.frames_per_second = std::max(st.frames_per_second, out->frames_per_second.value_or(0.0));
+        st.frame_width = std::max(st.frame_width, static_cast<int>(out->frame_width.value_or(0)));
+        st.frame_height = std::max(st.frame_height, static_cast<int>(out->frame_height.value_or(0)));
+    }
+
+    for (const auto* rin : report->GetStatsOfType<webrtc::RTCRemoteInboundRtpStreamStats>()) {
+        if (rin->kind.value_or("") != "video") continue;
+        st.fraction_lost = std::max(st.fraction_lost, rin->fraction_lost.value_or(0.0));
+        st.jitter_ms = std::max(st.jitter_ms, rin->jitter.value_or(0.0) * 1000.0);
+        if (st.rtt_ms <= 0.0 && rin->round_trip_time) st.rtt_ms = *rin->round_trip_time * 1000.0;
+    }
+
+    std::lock_guard<std::mutex> lock(pc_mutex_);
+    auto it = peer_connections_.find(clientId);
+    if (it == peer_connections_.end()) return;
+
+    const PeerStats& prev = it->second.stats;
+    if (prev.updated_ms > 0 && st.updated_ms > prev.updated_ms && st.bytes_sent >= prev.bytes_sent) {
+        st.send_bitrate_bps = 8000.0 * static_cast<double>(st.bytes_sent - prev.bytes_sent) /
+            static_cast<double>(st.updated_ms - prev.updated_ms);
+    }
+    it->second.stats = st;
+}
+
+void RTCManager::runGovernor(const std::map<std::string, double>& encode_time_s) {
+    if (!cpu_governor_) return;
+
+    auto& metrics = Metrics::instance();
+    const auto d = cpu_governor_->update(encode_time_s);
+
+    metrics.gauge("rtc_governor_cpu_percent").set(d.cpu_percent);
+    metrics.gauge("rtc_governor_encode_cpu_percent").set(d.encode_percent);
+    metrics.gauge("rtc_governor_budget_percent").set(cpu_governor_->config().budget_percent);
+    if (d.stepped_down) metrics.counter("rtc_governor_steps_down_total").inc(d.stepped_down);
+    if (d.stepped_up) metrics.counter("rtc_governor_steps_up_total").inc(d.stepped_up);
+
+    int degraded = 0;
+    {
+        std::lock_guard<std::mutex> lock(pc_mutex_);
+        for (const auto& [id, level] : cpu_governor_->levels()) {
+            if (peer_connections_.count(id)) {
+                metrics.gauge("rtc_governor_level", "client=\"" + id + "\"").set(level);
+            }
+            if (level > 0) degraded++;
+        }
+    }
+    metrics.gauge("rtc_governor_degraded_senders").set(degraded);
+
+    if (d.stepped_down || d.stepped_up) {
+        std::cout << "[GOV] CPU " << static_cast<int>(d.cpu_percent) << "% (encode "
+            << static_cast<int>(d.encode_percent) << "%), budget "
+            << cpu_governor_->config().budget_percent << "%: "
+            << d.stepped_down << " down, " << d.stepped_up << " up, "
+            << degraded << " sender(s) degraded" << std::endl;
+    }
+
+    const auto complexity = cpu_governor_->preferFastEncoding()
+        ? webrtc::VideoCodecComplexity::kComplexityLow
+        : webrtc::VideoCodecComplexity::kComplexityNormal;
+    if (encoder_hub_ && encoder_hub_->complexity() != complexity) {
+        encoder_hub_->setComplexity(complexity);
+        metrics.gauge("rtc_governor_fast_encoding").set(complexity == webrtc::VideoCodecComplexity::kComplexityLow);
+        std::cout << "[GOV] Encoder speed preset: "
+            << (complexity == webrtc::VideoCodecComplexity::kComplexityLow ? "fast" : "normal") << std::endl;
+    }
+}
+
+bool RTCManager::applySenderLimits(const std::string& clientId,
+    const webrtc::scoped_refptr<webrtc::RtpSenderInterface>& sender, const SenderLimits& limits) {
+    if (!sender) return false;
+
+    webrtc::RtpParameters params = sender->GetParameters();
+    if (params.encodings.empty()) return false;
+
+    auto& enc = params.encodings[0];
+    enc.max_bitrate_bps = limits.max_bitrate_bps > 0 ? std::optional<int>(limits.max_bitrate_bps) : std::nullopt;
+    if (pre_encoded_) {
+        // Ladder frames are forwarded, not encoded: a scaled or thinned
+        // native frame would cost a black I420 frame or a broken reference
+        // chain. The bitrate cap alone picks the rung.
+        enc.scale_resolution_down_by = 1.0;
+        enc.max_framerate = std::nullopt;
+        params.degradation_preference = webrtc::DegradationPreference::DISABLED;
+    }
+    else {
+        enc.scale_resolution_down_by = limits.scale_resolution_down_by;
+        enc.max_framerate = limits.max_framerate > 0.0 ? std::optional<double>(limits.max_framerate) : std::nullopt;
+
+        switch (limits.degradation) {
+        case DegradationMode::kMaintainFramerate:
+            params.degradation_preference = webrtc::DegradationPreference::MAINTAIN_FRAMERATE;
+            break;
+        case DegradationMode::kMaintainResolution:
+            params.degradation_preference = webrtc::DegradationPreference::MAINTAIN_RESOLUTION;
+            break;
+        default:
+            params.degradation_preference = webrtc::DegradationPreference::BALANCED;
+            break;
+        }
+    }
+
+    auto err = sender->SetParameters(params);
+    if (!err.ok()) {
+        std::cerr << "[SENDER] SetParameters failed for " << clientId << ": " << err.message() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void RTCManager::probeThread(webrtc::Thread* thread, ThreadProbe* probe) {
+    if (!thread) return;
+
+    const int64_t posted_ns = steadyTimeNs();
+    thread->PostTask([probe, posted_ns]() {
+        const int64_t now_ns = steadyTimeNs();
+        const int64_t cpu_ns = currentThreadCpuTimeNs();
+
+        probe->queue_delay_ms = static_cast<double>(now_ns - posted_ns) / 1e6;
+
+        const int64_t last_wall = probe->last_wall_ns.exchange(now_ns);
+        const int64_t last_cpu = probe->last_cpu_ns.exchange(cpu_ns);
+        if (last_wall > 0 && now_ns > last_wall) {
+            probe->cpu_percent = 100.0 * static_cast<double>(cpu_ns - last_cpu) /
+                static_cast<double>(now_ns - last_wall);
+        }
+    });
+}
+
 void RTCManager::stopGlobalStream() {
     std::cout << "[STREAM] Stopping global stream..." << std::endl;
 
+    pre_encoded_ = false;
     if (global_video_source_) {
         global_video_source_->Stop();
         global_video_source_ = nullptr;
         std::cout << "[STREAM] Video source stopped" << std::endl;
     }
 
-    std::lock_guard<std::mutex> lock(pc_mutex_);
-    for (auto& [id, ctx] : peer_connections_) {
-        if (ctx.video_track) {
-            auto senders = ctx.peer_connection->GetSenders();
-            for (const auto& sender : senders) {
-                if (sender->track() && sender->track()->kind() == "video") {
-                    ctx.peer_connection->RemoveTrackOrError(sender);
-                    std::cout << "[STREAM] Track removed from " << id << std::endl;
-                }
-            }
+    std::vector<std::pair<std::string, webrtc::scoped_refptr<webrtc::PeerConnectionInterface>>> targets;
+    {
+        std::lock_guard<std::mutex> lock(pc_mutex_);
+        for (auto& [id, ctx] : peer_connections_) {
+            if (!ctx.video_track) continue;
+            targets.emplace_back(id, ctx.peer_connection);
             ctx.video_track = nullptr;
+            ctx.video_sender = nullptr;
+            ctx.layer = -1;
+        }
+    }
+
+    // PeerConnection calls block on the signaling thread, which itself takes
+    // pc_mutex_ from observers, so they must run without the lock held.
+    for (const auto& [id, pc] : targets) {
+        if (!pc) continue;
+        for (const auto& sender : pc->GetSenders()) {
+            if (sender->track() && sender->track()->kind() == "video") {
+                pc->RemoveTrackOrError(sender);
+                std::cout << "[STREAM] Track removed from " << id << std::endl;
+            }
         }
     }
 
@@ -553,30 +1312,18 @@ void RTCManager::handleOffer(const std::string& clientId, const std::string& sdp
 
         pc_ref = it->second.peer_connection;
         has_video_track = (it->second.video_track != nullptr);
-
-        auto current_state = pc_ref->signaling_state();
-        std::cout << "[RTC] Current signaling state: " << static_cast<int>(current_state) << std::endl;
     }
 
+    // Blocks on the signaling thread, which takes pc_mutex_ itself.
+    auto current_state = pc_ref->signaling_state();
+    std::cout << "[RTC] Current signaling state: " << static_cast<int>(current_state) << std::endl;
+
 
     if (global_video_source_ && !has_video_track) {
         std::cout << "[RTC] Adding video track BEFORE setting remote description..." << std::endl;
 
-        auto video_track = peer_connection_factory_->CreateVideoTrack(global_video_source_, "video_label");
-        auto sender_res = pc_ref->AddTrack(video_track, { STREAM_ID });
-
-        if (sender_res.ok()) {
+        if (attachVideoTrack(clientId, pc_ref)) {
             std::cout << "[RTC] ✓ Video track added successfully" << std::endl;
-
-          
-            std::lock_guard<std::mutex> lock(pc_mutex_);
-            auto it = peer_connections_.find(clientId);
-            if (it != peer_connections_.end() && !it->second.video_track) {
-                it->second.video_track = video_track;
-            }
-        }
-        else {
-            std::cerr << "[ERR] ✗ Failed to add track: " << sender_res.error().message() << std::endl;
         }
     }
     else if (!global_video_source_) {
@@ -639,12 +1386,15 @@ void RTCManager::startGlobalStream(const StreamingConfig& config) {
 
     global_video_source_ = new webrtc::RefCountedObject<RTCManager::FileVideoTrackSource>(
         config.video_file_path,
-        config.loop
+        config.loop,
+        config.ladder
     );
     global_video_source_->Start();
 
     std::cout << "[RTC] Waiting for video source to initialize..." << std::endl;
     std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    pre_encoded_ = global_video_source_->preEncoded();
+    if (pre_encoded_) std::cout << "[RTC] Forwarding the pre-encoded ladder" << std::endl;
 
     struct Target {
         std::string clientId;
@@ -688,25 +1438,8 @@ void RTCManager::startGlobalStream(const StreamingConfig& config) {
             continue;
         }
 
-        if (!t.has_track) {
-            auto video_track =
-                peer_connection_factory_->CreateVideoTrack(global_video_source_, "video_label");
-
-            auto sender_res = t.pc->AddTrack(video_track, { STREAM_ID });
-            if (!sender_res.ok()) {
-                std::cerr << "[RTC] AddTrack failed for " << t.clientId
-                    << ": " << sender_res.error().message() << std::endl;
-                continue;
-            }
-
-
-            {
-                std::lock_guard<std::mutex> lock(pc_mutex_);
-                auto it = peer_connections_.find(t.clientId);
-                if (it != peer_connections_.end() && !it->second.video_track) {
-                    it->second.video_track = video_track;
-                }
-            }
+        if (!t.has_track && !attachVideoTrack(t.clientId, t.pc)) {
+            continue;
         }
 
         webrtc::PeerConnectionInterface::RTCOfferAnswerOptions options;
@@ -766,14 +1499,73 @@ void RTCManager::handleIceCandidate(const std::string& clientId,
 }
 
 
+bool RTCManager::hasPeerConnection(const std::string& clientId) {
+    std::lock_guard<std::mutex> lock(pc_mutex_);
+    auto it = peer_connections_.find(clientId);
+    return it != peer_connections_.end() && it->second.peer_connection;
+}
+
+bool RTCManager::restartIce(const std::string& clientId, bool force) {
+    webrtc::scoped_refptr<webrtc::PeerConnectionInterface> pc;
+    OnMessageCallback cb;
+    {
+        std::lock_guard<std::mutex> lock(pc_mutex_);
+        auto it = peer_connections_.find(clientId);
+        if (it == peer_connections_.end() || !it->second.peer_connection) return false;
+        pc = it->second.peer_connection;
+        cb = it->second.callback;
+    }
+
+    const auto ice = pc->ice_connection_state();
+    if (!force &&
+        ice != webrtc::PeerConnectionInterface::kIceConnectionDisconnected &&
+        ice != webrtc::PeerConnectionInterface::kIceConnectionFailed) {
+        return false;
+    }
+
+    if (pc->signaling_state() != webrtc::PeerConnectionInterface::SignalingState::kStable) {
+        std::cout << "[ICE] Not stable, ICE restart postponed for " << clientId << std::endl;
+        return false;
+    }
+
+    std::cout << "[ICE] Restarting ICE for " << clientId << std::endl;
+    pc->RestartIce();
+
+    webrtc::PeerConnectionInterface::RTCOfferAnswerOptions options;
+    options.offer_to_receive_audio = false;
+    options.offer_to_receive_video = false;
+    pc->CreateOffer(
+        new webrtc::RefCountedObject<CreateSessionDescriptionObserver>(clientId, cb, pc.get()),
+        options
+    );
+
+    Metrics::instance().counter("rtc_ice_restarts_total").inc();
+    return true;
+}
+
 void RTCManager::closePeerConnection(const std::string& clientId) {
     std::cout << "[RTC] Closing PeerConnection for " << clientId << std::endl;
 
-    std::lock_guard<std::mutex> lock(pc_mutex_);
-    auto it = peer_connections_.find(clientId);
-    if (it == peer_connections_.end()) return;
+    PeerConnectionContext ctx;
+    {
+        std::lock_guard<std::mutex> lock(pc_mutex_);
+        auto it = peer_connections_.find(clientId);
+        if (it == peer_connections_.end()) return;
 
-    auto& ctx = it->second;
+        ctx = std::move(it->second);
+        peer_connections_.erase(it);
+
+        // Under pc_mutex_, as every update of these checks the peer is
+        // still here while holding it: nothing can recreate them later.
+        auto& metrics = Metrics::instance();
+        const std::string label = "client=\"" + clientId + "\"";
+        metrics.remove("rtc_viewer_layer", label);
+        metrics.remove("rtc_governor_level", label);
+        metrics.remove("rtc_clock_offset_ms", label);
+        metrics.remove("rtc_clock_rtt_ms", label);
+        metrics.remove("rtc_sync_error_ms", label);
+        metrics.remove("rtc_render_offset_ms", label);
+    }
 
     if (ctx.data_channel) {
         if (ctx.data_channel_observer) {
@@ -792,6 +1584,14 @@ void RTCManager::closePeerConnection(const std::string& clientId) {
         }
     }
 
+    if (ctx.control_channel) {
+        if (ctx.control_channel_observer) ctx.control_channel->UnregisterObserver();
+        ctx.control_channel->Close();
+        ctx.control_channel = nullptr;
+    }
+    delete ctx.control_channel_observer;
+    ctx.control_channel_observer = nullptr;
+
     ctx.video_track = nullptr;
 
     if (ctx.peer_connection) {
@@ -799,27 +1599,160 @@ void RTCManager::closePeerConnection(const std::string& clientId) {
         ctx.peer_connection = nullptr;
     }
 
+    ctx.video_sender = nullptr;
     ctx.pending_ice.clear();
     ctx.remote_description_set = false;
 
-    peer_connections_.erase(it);
+    shards_[ctx.shard]->peer_count--;
+
     std::cout << "[RTC] PeerConnection closed for " << clientId << std::endl;
 }
 
-void RTCManager::sendPlaybackPosition(const std::string& clientId, double currentTime, bool isPlaying) {
+int RTCManager::broadcastSync(const SyncFrame& frame) {
+    uint8_t bytes[kSyncFrameSize];
+    encodeSyncFrame(frame, bytes);
+    const webrtc::DataBuffer buffer(webrtc::CopyOnWriteBuffer(bytes, kSyncFrameSize), true);
+
+    std::lock_guard<std::mutex> sync_lock(sync_mutex_);
+    sync_targets_.clear();
+    {
+        std::lock_guard<std::mutex> lock(pc_mutex_);
+        for (const auto& [id, ctx] : peer_connections_) {
+            (void)id;
+            if (ctx.data_channel) sync_targets_.push_back(ctx.data_channel);
+        }
+    }
+
+    // state() is proxied to another thread, so it is read outside pc_mutex_.
+    // The payload is shared by reference across every channel; SendAsync
+    // only posts to the network thread, so nothing here blocks on a peer.
+    int sent = 0;
+    for (const auto& dc : sync_targets_) {
+        if (dc->state() != webrtc::DataChannelInterface::kOpen) continue;
+        dc->SendAsync(buffer, nullptr);
+        ++sent;
+    }
+
+    sync_targets_.clear();
+
+    Metrics::instance().counter("rtc_sync_broadcasts_total").inc();
+    Metrics::instance().counter("rtc_sync_frames_sent_total").inc(sent);
+    return sent;
+}
+
+void RTCManager::onClockReport(const std::string& clientId, const PingFrame& ping) {
+    auto& metrics = Metrics::instance();
+    const std::string label = "client=\"" + clientId + "\"";
+    ViewerClock clock;
+    {
+        std::lock_guard<std::mutex> lock(pc_mutex_);
+        auto it = peer_connections_.find(clientId);
+        if (it == peer_connections_.end()) return;
+        updateViewerClock(it->second.clock, webrtc::TimeMillis(),
+            static_cast<double>(ping.offset_us) / 1000.0, static_cast<double>(ping.rtt_us) / 1000.0,
+            static_cast<double>(ping.render_delay_us) / 1000.0);
+        clock = it->second.clock;
+
+        // Set while the peer is known to exist; closePeerConnection removes
+        // these series under the same lock.
+        metrics.gauge("rtc_clock_offset_ms", label).set(clock.offset_ms);
+        metrics.gauge("rtc_clock_rtt_ms", label).set(clock.rtt_ms);
+        metrics.gauge("rtc_sync_error_ms", label).set(clock.sync_error_ms);
+        if (clock.render_offset_ms > 0.0) metrics.gauge("rtc_render_offset_ms", label).set(clock.render_offset_ms);
+    }
+
+    metrics.histogram("rtc_sync_error_ms_dist", { 1, 2, 5, 10, 20, 50, 100, 200, 500 }).observe(clock.sync_error_ms);
+}
+
+void RTCManager::onTelemetry(const std::string& clientId, const TelemetryFrame& frame) {
+    ViewerTelemetry viewer;
+    int layer = -1;
+    {
+        std::lock_guard<std::mutex> lock(pc_mutex_);
+        auto it = peer_connections_.find(clientId);
+        if (it == peer_connections_.end()) return;
+        TelemetryAggregator::apply(it->second.telemetry, frame, webrtc::TimeMillis());
+        viewer = it->second.telemetry;
+        layer = it->second.layer;
+    }
+    if (telemetry_) telemetry_->ingest(viewer, frame, layer);
+}
+
+std::map<std::string, ViewerTelemetry> RTCManager::getViewerTelemetry() {
+    std::map<std::string, ViewerTelemetry> out;
     std::lock_guard<std::mutex> lock(pc_mutex_);
-    auto it = peer_connections_.find(clientId);
-    if (it == peer_connections_.end()) return;
+    for (const auto& [id, ctx] : peer_connections_) out[id] = ctx.telemetry;
+    return out;
+}
+
+std::map<std::string, ViewerClock> RTCManager::getViewerClocks() {
+    std::map<std::string, ViewerClock> out;
+    std::lock_guard<std::mutex> lock(pc_mutex_);
+    for (const auto& [id, ctx] : peer_connections_) out[id] = ctx.clock;
+    return out;
+}
+
+void RTCManager::setControlHandlers(ControlMessageHandler on_message, ControlClosedHandler on_closed) {
+    control_message_handler_ = std::move(on_message);
+    control_closed_handler_ = std::move(on_closed);
+}
 
-    if (it->second.data_channel && it->second.data_channel->state() == webrtc::DataChannelInterface::kOpen) {
-        json msg = { {"type", "sync"}, {"currentTime", currentTime}, {"isPlaying", isPlaying} };
-        webrtc::DataBuffer buffer(msg.dump());
-        it->second.data_channel->Send(buffer);
+bool RTCManager::hasOpenControlChannel(const std::string& clientId) {
+    webrtc::scoped_refptr<webrtc::DataChannelInterface> control;
+    {
+        std::lock_guard<std::mutex> lock(pc_mutex_);
+        auto it = peer_connections_.find(clientId);
+        if (it != peer_connections_.end()) control = it->second.control_channel;
     }
+    // state() is proxied to another thread; never ask it under pc_mutex_.
+    return control && control->state() == webrtc::DataChannelInterface::kOpen;
 }
 
-RTCManager::FileVideoTrackSource::FileVideoTrackSource(const std::string& file_path, bool loop)
-    : file_path_(file_path), should_loop_(loop) {
+void RTCManager::routeSignaling(const std::string& clientId, const OnMessageCallback& ws, const SignalingMessage& message) {
+    webrtc::scoped_refptr<webrtc::DataChannelInterface> control;
+    {
+        std::lock_guard<std::mutex> lock(pc_mutex_);
+        auto it = peer_connections_.find(clientId);
+        if (it != peer_connections_.end()) control = it->second.control_channel;
+    }
+
+    if (control && control->state() == webrtc::DataChannelInterface::kOpen) {
+        control->SendAsync(webrtc::DataBuffer(*message.payload), nullptr);
+        Metrics::instance().counter("rtc_control_messages_total", "direction=\"out\"").inc();
+        return;
+    }
+    if (ws) ws(message);
+}
+
+void RTCManager::onControlMessage(const std::string& clientId, std::string message) {
+    Metrics::instance().counter("rtc_control_messages_total", "direction=\"in\"").inc();
+    // Called on a signaling thread. The handler ends up in handleOffer() and
+    // friends, which block on that same thread's proxies while the caller may
+    // hold locks another signaling thread is waiting for - so hop off first.
+    control_thread_->PostTask([this, clientId, message = std::move(message)]() {
+        if (control_message_handler_) control_message_handler_(clientId, message);
+    });
+}
+
+void RTCManager::onControlClosed(const std::string& clientId) {
+    control_thread_->PostTask([this, clientId]() {
+        if (control_closed_handler_) control_closed_handler_(clientId);
+    });
+}
+
+bool RTCManager::seekGlobalStream(double seconds) {
+    if (!global_video_source_ || seconds < 0.0) return false;
+    global_video_source_->Seek(seconds);
+    return true;
+}
+
+void RTCManager::setSyncRequestHandler(std::function<void()> handler) {
+    sync_request_handler_ = std::move(handler);
+}
+
+RTCManager::FileVideoTrackSource::FileVideoTrackSource(const std::string& file_path, bool loop,
+    std::vector<std::string> ladder)
+    : file_path_(file_path), should_loop_(loop), ladder_(std::move(ladder)) {
     std::cout << "[VIDEO] FileVideoTrackSource created for: " << file_path << std::endl;
 }
 
@@ -848,6 +1781,11 @@ void RTCManager::FileVideoTrackSource::Stop() {
     std::cout << "[VIDEO] Capture thread stopped" << std::endl;
 }
 
+void RTCManager::FileVideoTrackSource::Seek(double seconds) {
+    // Picked up by the capture loop before its next read.
+    seek_to_ = seconds;
+}
+
 double RTCManager::FileVideoTrackSource::getCurrentTime() const {
     return current_time_.load();
 }
@@ -856,18 +1794,126 @@ bool RTCManager::FileVideoTrackSource::isPlaying() const {
     return is_playing_.load();
 }
 
+// Forwards the Transcoder's ladder: no decode, no conversion, no encode.
+// False if the ladder cannot be read, and CaptureLoop decodes instead.
+bool RTCManager::FileVideoTrackSource::LadderLoop() {
+    PreEncodedLadder ladder;
+    if (!ladder.open(ladder_)) {
+        std::cerr << "[VIDEO] Ladder unusable, decoding " << file_path_ << " instead" << std::endl;
+        return false;
+    }
+
+    const double fps = ladder.fps() >= 1.0 && ladder.fps() <= 120.0 ? ladder.fps() : 30.0;
+    const int64_t frame_delay_us = static_cast<int64_t>(1000000.0 / fps);
+    std::cout << "[VIDEO] Ladder of " << ladder_.size() << " rungs, " << ladder.width() << "x" << ladder.height()
+        << " @ " << fps << " fps, " << ladder.frameCount() << " frames" << std::endl;
+
+    pre_encoded_ = true;
+    is_playing_ = true;
+
+    auto playback_start_time = std::chrono::steady_clock::now();
+    int64_t frame_count = 0; // position in the files
+    int64_t paced = 0;       // frames since playback_start_time
+    int64_t emitted_frames = 0;
+
+    while (running_) {
+        const double seek_to = seek_to_.exchange(-1.0);
+        if (seek_to >= 0.0) {
+            // Every rung has a keyframe there, so each viewer resumes at once.
+            frame_count = ladder.keyframeAtOrBefore(static_cast<int64_t>(seek_to * fps));
+            playback_start_time = std::chrono::steady_clock::now();
+            paced = 0;
+            current_time_ = static_cast<double>(frame_count) / fps;
+            std::cout << "[VIDEO] ⏩ Seek to " << seek_to << "s (keyframe at " << current_time_.load() << "s)" << std::endl;
+        }
+
+        if (frame_count >= ladder.frameCount()) {
+            if (!should_loop_) {
+                std::cout << "[VIDEO] End of file reached" << std::endl;
+                break;
+            }
+            std::cout << "[VIDEO] 🔄 Looping video..." << std::endl;
+            frame_count = 0;
+            playback_start_time = std::chrono::steady_clock::now();
+            paced = 0;
+        }
+
+        auto buffer = ladder.frame(frame_count);
+        if (!buffer) break;
+
+        auto expected_time = playback_start_time + std::chrono::microseconds(paced * frame_delay_us);
+        auto now = std::chrono::steady_clock::now();
+        if (expected_time > now) {
+            std::this_thread::sleep_for(expected_time - now);
+        }
+
+        int64_t timestamp_us = emitted_frames++ * 1000000 / static_cast<int64_t>(fps);
+        webrtc::VideoFrame video_frame = webrtc::VideoFrame::Builder()
+            .set_video_frame_buffer(buffer)
+            .set_timestamp_us(timestamp_us)
+            .set_rotation(webrtc::kVideoRotation_0)
+            .build();
+
+        OnFrame(video_frame);
+
+        current_time_ = static_cast<double>(frame_count) / fps;
+        frame_count++;
+        paced++;
+
+        if (frame_count % 150 == 0) {
+            std::cout << "[VIDEO] 📹 Frames: " << frame_count
+                << " | Time: " << current_time_.load() << "s" << std::endl;
+        }
+    }
+
+    is_playing_ = false;
+    pre_encoded_ = false;
+    std::cout << "[VIDEO] Ladder playback finished" << std::endl;
+    return true;
+}
+
 void RTCManager::FileVideoTrackSource::CaptureLoop() {
     std::cout << "\n[VIDEO] ========================================" << std::endl;
     std::cout << "[VIDEO] Capture loop started" << std::endl;
     std::cout << "[VIDEO] File: " << file_path_ << std::endl;
     std::cout << "[VIDEO] ========================================\n" << std::endl;
 
+    if (!ladder_.empty() && LadderLoop()) return;
+
     AVFormatContext* format_ctx = nullptr;
     AVCodecContext* codec_ctx = nullptr;
     AVFrame* frame = nullptr;
     AVPacket* packet = nullptr;
     SwsContext* sws_ctx = nullptr;
 
+    // Still uploading: demux through ProgressiveInput. avformat_close_input
+    // leaves a custom AVIOContext alone, so the guard frees it on every exit.
+    std::unique_ptr<ProgressiveInput> progressive;
+    struct AvioGuard {
+        AVIOContext* ctx = nullptr;
+        ~AvioGuard() {
+            if (!ctx) return;
+            av_freep(&ctx->buffer);
+            avio_context_free(&ctx);
+        }
+    } avio;
+
+    if (auto ingest = IngestRegistry::instance().find(file_path_)) {
+        progressive = std::make_unique<ProgressiveInput>(std::move(ingest), &running_);
+        if (!progressive->open(file_path_)) {
+            std::cerr << "[ERR] Failed to open file: " << file_path_ << " (" << RandomAccessFile::lastError() << ")" << std::endl;
+            is_playing_ = false;
+            return;
+        }
+        auto* io_buffer = static_cast<unsigned char*>(av_malloc(ProgressiveInput::kBufferBytes));
+        avio.ctx = avio_alloc_context(io_buffer, ProgressiveInput::kBufferBytes, 0, progressive.get(),
+            &ProgressiveInput::read, nullptr, &ProgressiveInput::seek);
+        format_ctx = avformat_alloc_context();
+        format_ctx->pb = avio.ctx;
+        format_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+        std::cout << "[VIDEO] Upload still in progress, reading as it grows" << std::endl;
+    }
+
     std::cout << "[VIDEO] Opening file..." << std::endl;
     if (avformat_open_input(&format_ctx, file_path_.c_str(), nullptr, nullptr) < 0) {
         std::cerr << "[ERR] Failed to open file: " << file_path_ << std::endl;
@@ -946,7 +1992,30 @@ void RTCManager::FileVideoTrackSource::CaptureLoop() {
 
     std::cout << "[VIDEO] 🎬 Starting frame loop...\n" << std::endl;
 
+    AVStream* video_stream = format_ctx->streams[video_stream_idx];
+    double skip_until_s = -1.0;
+    int64_t emitted_frames = 0;
+
     while (running_) {
+        const double seek_to = seek_to_.exchange(-1.0);
+        if (seek_to >= 0.0) {
+            const int64_t target = static_cast<int64_t>(seek_to / av_q2d(video_stream->time_base));
+            if (av_seek_frame(format_ctx, video_stream_idx, target, AVSEEK_FLAG_BACKWARD) >= 0) {
+                avcodec_flush_buffers(codec_ctx);
+                // Land on the keyframe before the target, then decode forward
+                // without presenting until the requested position.
+                skip_until_s = seek_to;
+                frame_count = static_cast<int64_t>(seek_to * fps);
+                playback_start_time = std::chrono::steady_clock::now() -
+                    std::chrono::microseconds(frame_count * frame_delay_us);
+                current_time_ = seek_to;
+                std::cout << "[VIDEO] ⏩ Seek to " << seek_to << "s" << std::endl;
+            }
+            else {
+                std::cerr << "[ERR] Seek to " << seek_to << "s failed" << std::endl;
+            }
+        }
+
         int ret = av_read_frame(format_ctx, packet);
         if (ret < 0) {
             if (ret == AVERROR_EOF && should_loop_) {
@@ -979,6 +2048,12 @@ void RTCManager::FileVideoTrackSource::CaptureLoop() {
                     break;
                 }
 
+                if (skip_until_s >= 0.0) {
+                    const int64_t pts = frame->best_effort_timestamp;
+                    if (pts != AV_NOPTS_VALUE && pts * av_q2d(video_stream->time_base) < skip_until_s) continue;
+                    skip_until_s = -1.0;
+                }
+
                 auto expected_time = playback_start_time + std::chrono::microseconds(frame_count * frame_delay_us);
                 auto now = std::chrono::steady_clock::now();
 
@@ -992,7 +2067,8 @@ void RTCManager::FileVideoTrackSource::CaptureLoop() {
 
                 sws_scale(sws_ctx, frame->data, frame->linesize, 0, height, dest, dest_stride);
 
-                int64_t timestamp_us = frame_count * 1000000 / static_cast<int64_t>(fps);
+                // Capture timestamps must keep moving forward across seeks and loops.
+                int64_t timestamp_us = emitted_frames++ * 1000000 / static_cast<int64_t>(fps);
                 webrtc::VideoFrame video_frame = webrtc::VideoFrame::Builder()
                     .set_video_frame_buffer(i420_buffer)
                     .set_timestamp_us(timestamp_us)
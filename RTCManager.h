@@ -13,6 +13,18 @@
 #include <pc/video_track_source.h>
 #include <absl/types/optional.h>
 
+#include "BroadcastVideoEncoder.h"
+#include "ChannelProtocol.h"
+#include "ClockSync.h"
+#include "CpuGovernor.h"
+#include "EngineConfig.h"
+#include "PeerStats.h"
+#include "PlayoutDelay.h"
+#include "SenderPolicy.h"
+#include "SignalingMessage.h"
+#include "Telemetry.h"
+#include "VideoLayers.h"
+
 #include <memory>
 #include <string>
 #include <functional>
@@ -24,29 +36,67 @@
 
 class RTCManager {
 public:
-    using OnMessageCallback = std::function<void(const std::string&)>;
+    using OnMessageCallback = std::function<void(const SignalingMessage&)>;
+    using ControlMessageHandler = std::function<void(const std::string& clientId, const std::string& message)>;
+    using ControlClosedHandler = std::function<void(const std::string& clientId)>;
 
     struct StreamingConfig {
         std::string video_file_path;
         bool enable_sync = true;
         bool loop = true;
+        // Pre-encoded VP8 rungs of the same video, lowest bitrate first.
+        // When set and readable, frames are forwarded instead of encoded.
+        std::vector<std::string> ladder;
+    };
+
+    using EngineConfig = ::EngineConfig;
+
+    struct ShardStats {
+        int index = 0;
+        int peers = 0;
+        double network_cpu_percent = 0.0;
+        double worker_cpu_percent = 0.0;
+        double signaling_cpu_percent = 0.0;
+        double network_queue_delay_ms = 0.0;
+        double worker_queue_delay_ms = 0.0;
+        double signaling_queue_delay_ms = 0.0;
     };
 
     RTCManager();
     ~RTCManager();
 
     void initialize();
+    void initialize(const EngineConfig& config);
     void createPeerConnection(const std::string& clientId, OnMessageCallback callback);
     void startGlobalStream(const StreamingConfig& config);
     void stopGlobalStream();
+    bool seekGlobalStream(double seconds);
     void handleOffer(const std::string& clientId, const std::string& sdp);
     void handleAnswer(const std::string& clientId, const std::string& sdp);
     void handleIceCandidate(const std::string& clientId, const std::string& candidate,
         const std::string& sdpMid, int sdpMLineIndex);
     void closePeerConnection(const std::string& clientId);
-    void sendPlaybackPosition(const std::string& clientId, double currentTime, bool isPlaying);
+    bool hasPeerConnection(const std::string& clientId);
+    // Restarts ICE and sends a fresh offer. Without `force` this only happens
+    // when the current path is disconnected or failed.
+    bool restartIce(const std::string& clientId, bool force);
+    int broadcastSync(const SyncFrame& frame);
+    void setSyncRequestHandler(std::function<void()> handler);
+    // Control-channel messages are delivered on a dedicated thread, never on a
+    // signaling thread, so handlers may take their own locks and call back in.
+    void setControlHandlers(ControlMessageHandler on_message, ControlClosedHandler on_closed);
+    bool hasOpenControlChannel(const std::string& clientId);
+    const EngineConfig& engineConfig() const { return engine_config_; }
     double getCurrentPlaybackTime() const;
     bool isStreaming() const;
+    std::vector<ShardStats> getShardStats() const;
+    std::map<std::string, PeerStats> getPeerStats();
+    std::map<std::string, ViewerClock> getViewerClocks();
+    std::map<std::string, ViewerTelemetry> getViewerTelemetry();
+    // Room-wide capture-to-render target in ms, 0 while not synchronised.
+    int playoutTargetMs() const { return playout_target_ms_.load(); }
+    void setSenderOverrides(const std::string& clientId, const SenderOverrides& overrides);
+    bool getSenderLimits(const std::string& clientId, SenderLimits& out);
 
 private:
     struct PendingIceCandidate; // <--  forward
@@ -61,20 +111,26 @@ private:
         std::vector<PendingIceCandidate>&& pending
     );
 
-class PeerConnectionObserver;
+    class PeerConnectionObserver;
+    class ControlChannelObserver;
     class CreateSessionDescriptionObserver;
     class DataChannelObserver;
     class RemoteDescriptionObserver;
+    class StatsObserver;
 
     class FileVideoTrackSource : public webrtc::AdaptedVideoTrackSource {
     public:
-        FileVideoTrackSource(const std::string& file_path, bool loop);
+        FileVideoTrackSource(const std::string& file_path, bool loop,
+            std::vector<std::string> ladder = {});
         virtual ~FileVideoTrackSource();
 
         void Start();
         void Stop();
+        void Seek(double seconds);
         double getCurrentTime() const;
         bool isPlaying() const;
+        // True while frames come from the ladder rather than the decoder.
+        bool preEncoded() const { return pre_encoded_; }
 
         bool is_screencast() const override { return false; }
         absl::optional<bool> needs_denoising() const override { return false; }
@@ -88,8 +144,12 @@ class PeerConnectionObserver;
         bool should_loop_;
         std::atomic<double> current_time_{ 0.0 };
         std::atomic<bool> is_playing_{ false };
+        std::atomic<double> seek_to_{ -1.0 };
+        std::vector<std::string> ladder_;
+        std::atomic<bool> pre_encoded_{ false };
 
         void CaptureLoop();
+        bool LadderLoop();
     };
 
     
@@ -105,19 +165,100 @@ class PeerConnectionObserver;
         PeerConnectionObserver* observer = nullptr;
         webrtc::scoped_refptr<webrtc::VideoTrackInterface> video_track;
         DataChannelObserver* data_channel_observer = nullptr;
+        webrtc::scoped_refptr<webrtc::DataChannelInterface> control_channel;
+        ControlChannelObserver* control_channel_observer = nullptr;
         OnMessageCallback callback;
         bool needs_offer = false;
             bool remote_description_set = false;
         std::vector<PendingIceCandidate> pending_ice;
+        int shard = 0;
+        webrtc::scoped_refptr<webrtc::RtpSenderInterface> video_sender;
+        PeerStats stats;
+        int layer = -1;
+        int layer_up_votes = 0;
+        SenderOverrides overrides;
+        SenderLimits applied_limits;
+        bool limits_applied = false;
+        ViewerClock clock;
+        ViewerTelemetry telemetry;
+        uint32_t telemetry_reports_seen = 0;
 };
 
-    webrtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> peer_connection_factory_;
+    struct ThreadProbe {
+        std::atomic<int64_t> last_cpu_ns{ 0 };
+        std::atomic<int64_t> last_wall_ns{ 0 };
+        std::atomic<double> cpu_percent{ 0.0 };
+        std::atomic<double> queue_delay_ms{ 0.0 };
+    };
+
+    // One PeerConnectionFactory with its own network/worker/signaling trio.
+    // Every shard creates tracks from the same global_video_source_, so frames
+    // are fanned out by reference rather than copied per shard.
+    struct FactoryShard {
+        int index = 0;
+        std::unique_ptr<webrtc::Thread> network_thread;
+        std::unique_ptr<webrtc::Thread> worker_thread;
+        std::unique_ptr<webrtc::Thread> signaling_thread;
+        webrtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> factory;
+        std::atomic<int> peer_count{ 0 };
+        ThreadProbe network_probe;
+        ThreadProbe worker_probe;
+        ThreadProbe signaling_probe;
+    };
+
+    // Picks the least loaded shard and counts the new peer on it at once,
+    // so concurrent joins spread out; the caller gives the slot back with
+    // peer_count-- if the peer connection is never created.
+    int reserveShard();
+    bool attachVideoTrack(const std::string& clientId,
+        const webrtc::scoped_refptr<webrtc::PeerConnectionInterface>& pc);
+    void statsLoop();
+    void sampleShards();
+    void exportEncoderStats();
+    void pollPeers();
+    void runGovernor(const std::map<std::string, double>& encode_time_s);
+    void onStatsDelivered(const std::string& clientId,
+        const webrtc::scoped_refptr<const webrtc::RTCStatsReport>& report);
+    bool applySenderLimits(const std::string& clientId,
+        const webrtc::scoped_refptr<webrtc::RtpSenderInterface>& sender, const SenderLimits& limits);
+    static void probeThread(webrtc::Thread* thread, ThreadProbe* probe);
+    void onClockReport(const std::string& clientId, const PingFrame& ping);
+    void onTelemetry(const std::string& clientId, const TelemetryFrame& frame);
+    void routeSignaling(const std::string& clientId, const OnMessageCallback& ws, const SignalingMessage& message);
+    void onControlMessage(const std::string& clientId, std::string message);
+    void onControlClosed(const std::string& clientId);
+    void negotiatePlayoutDelay(const std::string& clientId,
+        const webrtc::scoped_refptr<webrtc::PeerConnectionInterface>& pc,
+        const webrtc::scoped_refptr<webrtc::RtpSenderInterface>& sender);
+    void updatePlayoutDelay(const std::vector<PeerStats>& viewers);
+
+    EngineConfig engine_config_;
+    std::shared_ptr<BroadcastEncoderHub> encoder_hub_;
+    BroadcastEncoderHub::Stats exported_encoder_stats_; // stats thread only
+    std::unique_ptr<SenderPolicy> sender_policy_;
+    std::unique_ptr<CpuGovernor> cpu_governor_;
+    std::unique_ptr<PlayoutDelayPlanner> playout_planner_;
+    std::unique_ptr<TelemetryAggregator> telemetry_;
+    std::atomic<int> playout_target_ms_{ 0 };
+    std::vector<std::unique_ptr<FactoryShard>> shards_;
     std::map<std::string, PeerConnectionContext> peer_connections_;
     std::mutex pc_mutex_;
+    std::mutex shard_mutex_; // serializes reserveShard()
 
     webrtc::scoped_refptr<FileVideoTrackSource> global_video_source_;
+    // The running stream forwards the ladder: senders keep full resolution.
+    std::atomic<bool> pre_encoded_{ false };
+
+    ControlMessageHandler control_message_handler_;
+    ControlClosedHandler control_closed_handler_;
+    std::unique_ptr<webrtc::Thread> control_thread_;
+
+    // Set once before the first peer joins; invoked on a signaling thread
+    // whenever a "sync" channel opens.
+    std::function<void()> sync_request_handler_;
+    std::vector<webrtc::scoped_refptr<webrtc::DataChannelInterface>> sync_targets_;
+    std::mutex sync_mutex_;
 
-    std::unique_ptr<webrtc::Thread> signaling_thread_;
-    std::unique_ptr<webrtc::Thread> worker_thread_;
-    std::unique_ptr<webrtc::Thread> network_thread_;
+    std::thread stats_thread_;
+    std::atomic<bool> stats_running_{ false };
 };
\ No newline at end of file
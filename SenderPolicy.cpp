@@ -0,0 +1,94 @@
+#include "SenderPolicy.h"
+
+#include <algorithm>
+
+namespace {
+
+    // Below this share of the bottom rung's bitrate the viewer keeps its
+    // resolution and loses frame rate instead.
+    constexpr double kStarvedRatio = 0.6;
+    constexpr double kStarvedFramerate = 15.0;
+
+}
+
+StartBitratePreset startBitratePreset(const std::string& name) {
+    if (name == "conservative") return { "conservative", 100000, 300000, 2500000 };
+    if (name == "fast") return { "fast", 300000, 1500000, 4000000 };
+    return { "balanced", 150000, 800000, 3000000 };
+}
+
+SenderPolicy::SenderPolicy(std::vector<VideoLayer> layers, bool adaptive,
+    StartBitratePreset preset, DegradationMode degradation)
+    : selector_(std::move(layers))
+    , adaptive_(adaptive)
+    , preset_(std::move(preset))
+    , degradation_(degradation)
+{
+}
+
+int SenderPolicy::initialLayer() const {
+    const auto& ladder = selector_.layers();
+    if (ladder.empty()) return -1;
+
+    int layer = 0;
+    for (int i = 0; i < static_cast<int>(ladder.size()); ++i) {
+        if (ladder[i].max_bitrate_bps <= preset_.start_bitrate_bps) layer = i;
+    }
+    return layer;
+}
+
+SenderLimits SenderPolicy::decide(const PeerStats& stats, const SenderOverrides& overrides,
+    int& layer, int& up_votes) const {
+    const auto& ladder = selector_.layers();
+    SenderLimits limits;
+    limits.degradation = degradation_;
+
+    if (ladder.empty()) return limits;
+
+    if (overrides.layer) {
+        layer = std::clamp(*overrides.layer, 0, static_cast<int>(ladder.size()) - 1);
+        up_votes = 0;
+    }
+    else if (!adaptive_) {
+        // Layer selection is off: the sender keeps the library's own
+        // resolution and bitrate, tightened only by the overrides below.
+        layer = -1;
+        up_votes = 0;
+    }
+    else {
+        if (layer < 0) layer = initialLayer();
+        if (stats.updated_ms > 0) layer = selector_.select(layer, stats, up_votes);
+    }
+
+    if (layer >= 0) {
+        const VideoLayer& rung = ladder[layer];
+        limits.layer = layer;
+        limits.scale_resolution_down_by = rung.scale_resolution_down_by;
+        limits.max_bitrate_bps = rung.max_bitrate_bps;
+
+        if (adaptive_ && layer == 0 && stats.available_outgoing_bitrate_bps > 0.0 &&
+            stats.available_outgoing_bitrate_bps < rung.max_bitrate_bps * kStarvedRatio) {
+            limits.max_framerate = kStarvedFramerate;
+            limits.degradation = DegradationMode::kMaintainResolution;
+        }
+    }
+
+    if (overrides.max_bitrate_bps) {
+        limits.max_bitrate_bps = limits.max_bitrate_bps > 0
+            ? std::min(limits.max_bitrate_bps, *overrides.max_bitrate_bps)
+            : *overrides.max_bitrate_bps;
+    }
+    if (overrides.max_framerate) {
+        limits.max_framerate = limits.max_framerate > 0.0
+            ? std::min(limits.max_framerate, *overrides.max_framerate)
+            : *overrides.max_framerate;
+    }
+    if (overrides.scale_resolution_down_by) {
+        limits.scale_resolution_down_by = std::max(limits.scale_resolution_down_by, *overrides.scale_resolution_down_by);
+    }
+    if (overrides.degradation) {
+        limits.degradation = *overrides.degradation;
+    }
+
+    return limits;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "PeerStats.h"
+#include "VideoLayers.h"
+
+#include <optional>
+#include <string>
+#include <vector>
+
+enum class DegradationMode {
+    kBalanced,
+    kMaintainFramerate,
+    kMaintainResolution,
+};
+
+// Encoding parameters for one viewer's video sender, as decided by the policy.
+struct SenderLimits {
+    int layer = -1;
+    double scale_resolution_down_by = 1.0;
+    int max_bitrate_bps = 0;    // 0 = library default
+    double max_framerate = 0.0; // 0 = library default
+    DegradationMode degradation = DegradationMode::kBalanced;
+
+    bool operator==(const SenderLimits& o) const {
+        return layer == o.layer &&
+            scale_resolution_down_by == o.scale_resolution_down_by &&
+            max_bitrate_bps == o.max_bitrate_bps &&
+            max_framerate == o.max_framerate &&
+            degradation == o.degradation;
+    }
+    bool operator!=(const SenderLimits& o) const { return !(*this == o); }
+};
+
+// Operator-set caps for a single viewer. They tighten whatever the policy
+// decides; `layer` pins the viewer to a rung and disables adaptation.
+struct SenderOverrides {
+    std::optional<int> layer;
+    std::optional<int> max_bitrate_bps;
+    std::optional<double> max_framerate;
+    std::optional<double> scale_resolution_down_by;
+    std::optional<DegradationMode> degradation;
+};
+
+struct StartBitratePreset {
+    std::string name;
+    int min_bitrate_bps = 0;
+    int start_bitrate_bps = 0;
+    int max_bitrate_bps = 0;
+};
+
+// "conservative", "balanced" or "fast"; unknown names fall back to balanced.
+StartBitratePreset startBitratePreset(const std::string& name);
+
+class SenderPolicy {
+public:
+    SenderPolicy(std::vector<VideoLayer> layers, bool adaptive,
+        StartBitratePreset preset, DegradationMode degradation);
+
+    const std::vector<VideoLayer>& layers() const { return selector_.layers(); }
+    const StartBitratePreset& preset() const { return preset_; }
+
+    // Highest rung the start bitrate can carry, so a new viewer does not sit
+    // on a blurry rung while the bandwidth estimate ramps up.
+    int initialLayer() const;
+
+    // Without adaptation only an override pins a rung; otherwise `layer` is
+    // -1 and the limits leave resolution and bitrate to the library.
+    SenderLimits decide(const PeerStats& stats, const SenderOverrides& overrides,
+        int& layer, int& up_votes) const;
+
+private:
+    LayerSelector selector_;
+    bool adaptive_;
+    StartBitratePreset preset_;
+    DegradationMode degradation_;
+};
@@ -5,17 +5,30 @@
 #include "SharedState.h"
 #include "WebSocketSession.h"
 #include "RTCManager.h"
-
-#include <nlohmann/json.hpp>
+#include "CpuTime.h"
+#include "Metrics.h"
+#include "SignalingMessage.h"
+#include "Transcoder.h"
+#include "MediaCatalog.h"
+#include "IngestRegistry.h"
+
+#include <algorithm>
+#include <filesystem>
 #include <iostream>
 #include <vector>
 #include <chrono>
+#include <random>
 
-using json = nlohmann::json;
+SharedState::SharedState() : SharedState(EngineConfig{}) {
+}
 
-SharedState::SharedState() : rtc_manager_(std::make_unique<RTCManager>()) {
+SharedState::SharedState(const EngineConfig& config) : rtc_manager_(std::make_unique<RTCManager>()) {
     std::cout << "[STATE] Initializing SharedState..." << std::endl;
-    rtc_manager_->initialize();
+    rtc_manager_->initialize(config);
+    rtc_manager_->setSyncRequestHandler([this]() { requestSync(); });
+    rtc_manager_->setControlHandlers(
+        [this](const std::string& client_id, const std::string& message) { dispatch(client_id, message); },
+        [this](const std::string& client_id) { onControlClosed(client_id); });
     sync_running_ = true;
     sync_thread_ = std::thread(&SharedState::syncLoop, this);
     std::cout << "[STATE] SharedState initialized" << std::endl;
@@ -23,46 +36,98 @@ SharedState::SharedState() : rtc_manager_(std::make_unique<RTCManager>()) {
 
 SharedState::~SharedState() {
     std::cout << "[STATE] Shutting down SharedState..." << std::endl;
-    sync_running_ = false;
+    {
+        std::lock_guard<std::mutex> lock(sync_mutex_);
+        sync_running_ = false;
+    }
+    sync_cv_.notify_all();
     if (sync_thread_.joinable()) sync_thread_.join();
+    // Control handlers run on RTCManager's thread and touch our members; tear
+    // it down while those members are still alive.
+    rtc_manager_.reset();
     std::cout << "[STATE] SharedState shut down" << std::endl;
 }
 
-void SharedState::join(std::shared_ptr<WebSocketSession> session) {
+namespace {
+
+    std::string makeResumeToken() {
+        static thread_local std::mt19937_64 rng{ std::random_device{}() };
+        static const char* hex = "0123456789abcdef";
+        std::string token(32, '0');
+        for (int half = 0; half < 2; ++half) {
+            uint64_t bits = rng();
+            for (int i = 0; i < 16; ++i, bits >>= 4) token[half * 16 + i] = hex[bits & 0xF];
+        }
+        return token;
+    }
+
+}
+
+void SharedState::join(std::shared_ptr<WebSocketSession> session, const std::string& resume_token) {
+    const auto now = std::chrono::steady_clock::now();
     std::string client_id;
+    std::string token;
+    bool resumed = false;
+    double detached_ms = 0.0;
     {
         std::lock_guard<std::mutex> lock(mutex_);
 
         sessions_.insert(session);
 
-   
-        client_id = "client_" + std::to_string(reinterpret_cast<uintptr_t>(session.get()));
+        auto known = resume_token.empty() ? resume_tokens_.end() : resume_tokens_.find(resume_token);
+        if (known != resume_tokens_.end()) {
+            client_id = known->second;
+            token = known->first;
+            resumed = true;
+
+            auto d = detached_.find(client_id);
+            if (d != detached_.end()) {
+                detached_ms = std::chrono::duration<double, std::milli>(now - d->second.since).count();
+                detached_.erase(d);
+            }
+            parked_clients_.erase(client_id);
+
+            // The old socket may still look alive (half-open after a network
+            // switch); unmap it so its eventual leave() is a no-op.
+            auto old = client_sessions_.find(client_id);
+            if (old != client_sessions_.end()) session_to_client_id_.erase(old->second);
+        }
+        else {
+            client_id = "client_" + std::to_string(++next_client_id_);
+            token = makeResumeToken();
+            resume_tokens_[token] = client_id;
+        }
 
-    
         session_to_client_id_[std::weak_ptr<WebSocketSession>(session)] = client_id;
+        client_sessions_[client_id] = session;
 
         std::cout << "[STATE] ======================================" << std::endl;
-        std::cout << "[STATE] Client joined: " << client_id << std::endl;
+        std::cout << "[STATE] Client " << (resumed ? "resumed: " : "joined: ") << client_id << std::endl;
         std::cout << "[STATE] Total clients: " << sessions_.size() << std::endl;
         std::cout << "[STATE] ======================================" << std::endl;
     }
 
+    sendToSession(session, SignalingMessage::session(client_id, token, resumed));
 
-    {
-        std::lock_guard<std::mutex> rtc_lock(rtc_mutex_);
-
-    
-        std::weak_ptr<WebSocketSession> weak_session = session;
+    std::lock_guard<std::mutex> rtc_lock(rtc_mutex_);
 
-        rtc_manager_->createPeerConnection(client_id, [this, weak_session](const std::string& msg) {
-            if (auto s = weak_session.lock()) {
-                this->sendToSession(s, msg);
-            }
-            else {
-                std::cerr << "[STATE] Session expired, cannot send message!" << std::endl;
-            }
-            });
+    if (resumed && rtc_manager_->hasPeerConnection(client_id)) {
+        auto& metrics = Metrics::instance();
+        metrics.counter("ws_resumes_total").inc();
+        metrics.histogram("ws_resume_gap_ms", { 100, 250, 500, 1000, 2500, 5000, 10000, 30000 }).observe(detached_ms);
+        // Only when the path is actually gone; a live ICE session survives a
+        // WebSocket blip untouched.
+        if (rtc_manager_->restartIce(client_id, false)) {
+            std::cout << "[STATE] ICE restart for resumed " << client_id << std::endl;
+        }
+        return;
     }
+
+    // Signaling is routed by client id, not by socket, so a resumed session
+    // picks up the existing peer connection's messages without rewiring it.
+    rtc_manager_->createPeerConnection(client_id, [this, client_id](const SignalingMessage& msg) {
+        this->sendToClient(client_id, msg);
+        });
 }
 
 void SharedState::leave(std::shared_ptr<WebSocketSession> session) {
@@ -71,7 +136,6 @@ void SharedState::leave(std::shared_ptr<WebSocketSession> session) {
     {
         std::lock_guard<std::mutex> lock(mutex_);
 
-    
         auto it = session_to_client_id_.find(std::weak_ptr<WebSocketSession>(session));
         if (it != session_to_client_id_.end()) {
             client_id = it->second;
@@ -83,154 +147,293 @@ void SharedState::leave(std::shared_ptr<WebSocketSession> session) {
         std::cout << "[STATE] Remaining clients: " << sessions_.size() << std::endl;
     }
 
-    if (!client_id.empty()) {
-        std::cout << "[STATE] Client leaving: " << client_id << std::endl;
-        std::lock_guard<std::mutex> rtc_lock(rtc_mutex_);
-        rtc_manager_->closePeerConnection(client_id);
+    if (client_id.empty()) return;
+
+    std::lock_guard<std::mutex> rtc_lock(rtc_mutex_);
+    if (rtc_manager_->hasOpenControlChannel(client_id)) {
+        // The peer connection carries its own signaling now; keep it until
+        // the control channel goes away.
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            parked_clients_.insert(client_id);
+        }
+        std::cout << "[STATE] WebSocket parked, control channel keeps " << client_id << std::endl;
+        return;
+    }
+
+    const int grace_ms = rtc_manager_->engineConfig().resume_grace_ms;
+    if (grace_ms > 0) {
+        const auto now = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            detached_[client_id] = { now, now + std::chrono::milliseconds(grace_ms) };
+        }
+        std::cout << "[STATE] Client detached: " << client_id << " (resumable for " << grace_ms << " ms)" << std::endl;
+        return;
+    }
+
+    std::cout << "[STATE] Client leaving: " << client_id << std::endl;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        forgetClientLocked(client_id);
+    }
+    rtc_manager_->closePeerConnection(client_id);
+}
+
+void SharedState::forgetClientLocked(const std::string& client_id) {
+    for (auto it = resume_tokens_.begin(); it != resume_tokens_.end();) {
+        if (it->second == client_id) it = resume_tokens_.erase(it);
+        else ++it;
     }
+    client_sessions_.erase(client_id);
+    detached_.erase(client_id);
 }
 
-void SharedState::send(std::string message, std::shared_ptr<WebSocketSession> sender) {
+void SharedState::reapDetached() {
+    const auto now = std::chrono::steady_clock::now();
+    std::vector<std::string> expired;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = detached_.begin(); it != detached_.end();) {
+            if (it->second.deadline > now) {
+                ++it;
+                continue;
+            }
+            expired.push_back(it->first);
+            it = detached_.erase(it);
+        }
+        // Tokens go in the same critical section, so a join racing with the
+        // reaper cannot resume a peer connection that is about to be closed.
+        for (const auto& id : expired) forgetClientLocked(id);
+    }
+    if (expired.empty()) return;
+
+    std::lock_guard<std::mutex> rtc_lock(rtc_mutex_);
+    for (const auto& id : expired) {
+        std::cout << "[STATE] Resume window expired: " << id << std::endl;
+        rtc_manager_->closePeerConnection(id);
+    }
+    Metrics::instance().counter("ws_resume_expired_total").inc(expired.size());
+}
+
+void SharedState::onControlClosed(const std::string& client_id) {
+    // rtc_mutex_ first: leave() checks the channel and parks under it, so a
+    // close racing with that check cannot slip past unnoticed.
+    std::lock_guard<std::mutex> rtc_lock(rtc_mutex_);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (parked_clients_.erase(client_id) == 0) return;
+        forgetClientLocked(client_id);
+    }
+    std::cout << "[STATE] Parked client gone: " << client_id << std::endl;
+    rtc_manager_->closePeerConnection(client_id);
+}
+
+void SharedState::send(std::string_view message, std::shared_ptr<WebSocketSession> sender) {
     std::cout << "\n[STATE] ========================================" << std::endl;
     std::cout << "[STATE] Received message: " << message << std::endl;
     std::cout << "[STATE] ========================================" << std::endl;
 
-    try {
-        auto j = json::parse(message);
-        std::string type = j.value("type", "");
-
-        std::cout << "[STATE] Message type: " << type << std::endl;
-
-        std::string client_id;
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
+    std::string client_id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
 
-            auto it = session_to_client_id_.find(std::weak_ptr<WebSocketSession>(sender));
-            if (it == session_to_client_id_.end()) {
-                std::cerr << "[STATE] ❌ ERROR: Sender session not found!" << std::endl;
-                return;
-            }
-            client_id = it->second;
+        auto it = session_to_client_id_.find(std::weak_ptr<WebSocketSession>(sender));
+        if (it == session_to_client_id_.end()) {
+            std::cerr << "[STATE] ❌ ERROR: Sender session not found!" << std::endl;
+            return;
         }
+        client_id = it->second;
+    }
 
-        std::cout << "[STATE] Client ID: " << client_id << std::endl;
+    dispatch(client_id, message);
+}
 
-        if (type == "start_stream") {
-            std::string file_path = j.value("file_path", "");
+// Shared by the WebSocket and the control data channel.
+void SharedState::dispatch(const std::string& client_id, std::string_view message) {
+    // Views in `in` point into `message` or this buffer; it is reused, so
+    // steady-state parsing allocates nothing.
+    static thread_local std::string scratch;
+    InboundSignal in;
+    if (!parseSignal(message, in, scratch)) {
+        std::cerr << "[STATE] ERROR parsing message from " << client_id << std::endl;
+        std::cerr << "[STATE] Message was: " << message << std::endl;
+        return;
+    }
 
-            std::cout << "\n[STATE] ========================================" << std::endl;
-            std::cout << "[STATE] START_STREAM REQUEST" << std::endl;
-            std::cout << "[STATE] Client: " << client_id << std::endl;
-            std::cout << "[STATE] File: " << file_path << std::endl;
-            std::cout << "[STATE] ========================================\n" << std::endl;
+    std::cout << "[STATE] Message type: " << in.type_name << std::endl;
+    std::cout << "[STATE] Client ID: " << client_id << std::endl;
 
-            if (file_path.empty()) {
-                std::cerr << "[STATE] ERROR: Empty file path!" << std::endl;
-                return;
-            }
+    switch (in.type) {
+    case SignalType::kStartStream: {
+        std::cout << "\n[STATE] ========================================" << std::endl;
+        std::cout << "[STATE] START_STREAM REQUEST" << std::endl;
+        std::cout << "[STATE] Client: " << client_id << std::endl;
+        std::cout << "[STATE] File: " << in.file_path << std::endl;
+        std::cout << "[STATE] ========================================\n" << std::endl;
 
-            RTCManager::StreamingConfig config;
-            config.video_file_path = file_path;
-            config.enable_sync = true;
-            config.loop = true;
-
-            std::cout << "[STATE] Calling rtc_manager_->startGlobalStream()..." << std::endl;
-            { std::lock_guard<std::mutex> rtc_lock(rtc_mutex_); rtc_manager_->startGlobalStream(config); }
-            std::cout << "[STATE] startGlobalStream() completed\n" << std::endl;
-        }
-        else if (type == "stop_stream") {
-            std::cout << "[STATE] STOP_STREAM REQUEST from " << client_id << std::endl;
-            { std::lock_guard<std::mutex> rtc_lock(rtc_mutex_); rtc_manager_->stopGlobalStream(); }
-            std::cout << "[STATE] Stream stopped\n" << std::endl;
-        }
-        else if (type == "offer") {
-            std::string sdp = j.value("sdp", "");
-            std::cout << "[STATE] OFFER from " << client_id << " (SDP length: " << sdp.length() << ")" << std::endl;
-            { std::lock_guard<std::mutex> rtc_lock(rtc_mutex_); rtc_manager_->handleOffer(client_id, sdp); }
-        }
-        else if (type == "answer") {
-            std::string sdp = j.value("sdp", "");
-            std::cout << "[STATE] ANSWER from " << client_id << " (SDP length: " << sdp.length() << ")" << std::endl;
-            { std::lock_guard<std::mutex> rtc_lock(rtc_mutex_); rtc_manager_->handleAnswer(client_id, sdp); }
-        }
-        else if (type == "ice_candidate") {
-            std::string candidate = j.value("candidate", "");
-            std::string sdpMid = j.value("sdpMid", "");
-            int sdpMLineIndex = j.value("sdpMLineIndex", 0);
-            std::cout << "[STATE] ICE_CANDIDATE from " << client_id << std::endl;
-            { std::lock_guard<std::mutex> rtc_lock(rtc_mutex_); rtc_manager_->handleIceCandidate(client_id, candidate, sdpMid, sdpMLineIndex); }
+        if (in.file_path.empty()) {
+            std::cerr << "[STATE] ERROR: Empty file path!" << std::endl;
+            return;
         }
-        else {
-            std::cerr << "[STATE] Unknown message type: " << type << std::endl;
+
+        RTCManager::StreamingConfig config;
+        config.video_file_path = std::string(in.file_path);
+        // Renditions are only for catalogued uploads that have finished
+        // arriving: anything else is played as it is, and a growing file is
+        // enqueued by the catalog once its upload completes.
+        const bool transcodable = transcoder_ && catalog_ &&
+            catalog_->mediaPath(std::filesystem::path(config.video_file_path).filename().string()) == config.video_file_path &&
+            !IngestRegistry::instance().find(config.video_file_path);
+        if (transcodable) {
+            // Play the normalized rendition if it exists; otherwise the
+            // original now, and this file goes to the front of the queue.
+            transcoder_->enqueue(config.video_file_path, TranscodePriority::kHigh);
+            config.ladder = transcoder_->ladder(config.video_file_path);
+            config.video_file_path = transcoder_->preferred(config.video_file_path);
+            if (config.video_file_path != in.file_path) {
+                std::cout << "[STATE] Using rendition " << config.video_file_path << std::endl;
+            }
         }
+        config.enable_sync = true;
+        config.loop = true;
+
+        std::cout << "[STATE] Calling rtc_manager_->startGlobalStream()..." << std::endl;
+        { std::lock_guard<std::mutex> rtc_lock(rtc_mutex_); rtc_manager_->startGlobalStream(config); }
+        requestSync();
+        std::cout << "[STATE] startGlobalStream() completed\n" << std::endl;
+        break;
     }
-    catch (const std::exception& e) {
-        std::cerr << "[STATE] ERROR parsing message: " << e.what() << std::endl;
-        std::cerr << "[STATE] Message was: " << message << std::endl;
+    case SignalType::kStopStream:
+        std::cout << "[STATE] STOP_STREAM REQUEST from " << client_id << std::endl;
+        { std::lock_guard<std::mutex> rtc_lock(rtc_mutex_); rtc_manager_->stopGlobalStream(); }
+        requestSync();
+        std::cout << "[STATE] Stream stopped\n" << std::endl;
+        break;
+    case SignalType::kSeek: {
+        std::cout << "[STATE] SEEK to " << in.position << "s from " << client_id << std::endl;
+        bool ok = false;
+        { std::lock_guard<std::mutex> rtc_lock(rtc_mutex_); ok = rtc_manager_->seekGlobalStream(in.position); }
+        if (ok) requestSync();
+        break;
     }
+    case SignalType::kRestartIce:
+        std::cout << "[STATE] RESTART_ICE from " << client_id << std::endl;
+        { std::lock_guard<std::mutex> rtc_lock(rtc_mutex_); rtc_manager_->restartIce(client_id, true); }
+        break;
+    case SignalType::kReconnected:
+        std::cout << "[STATE] " << client_id << " back after " << in.latency_ms << " ms" << std::endl;
+        if (in.latency_ms >= 0.0) {
+            Metrics::instance().histogram("client_reconnect_latency_ms",
+                { 100, 250, 500, 1000, 2500, 5000, 10000, 30000 }).observe(in.latency_ms);
+        }
+        break;
+    case SignalType::kOffer:
+        std::cout << "[STATE] OFFER from " << client_id << " (SDP length: " << in.sdp.length() << ")" << std::endl;
+        { std::lock_guard<std::mutex> rtc_lock(rtc_mutex_); rtc_manager_->handleOffer(client_id, std::string(in.sdp)); }
+        break;
+    case SignalType::kAnswer:
+        std::cout << "[STATE] ANSWER from " << client_id << " (SDP length: " << in.sdp.length() << ")" << std::endl;
+        { std::lock_guard<std::mutex> rtc_lock(rtc_mutex_); rtc_manager_->handleAnswer(client_id, std::string(in.sdp)); }
+        break;
+    case SignalType::kIceCandidate:
+        std::cout << "[STATE] ICE_CANDIDATE from " << client_id << std::endl;
+        {
+            std::lock_guard<std::mutex> rtc_lock(rtc_mutex_);
+            rtc_manager_->handleIceCandidate(client_id, std::string(in.candidate), std::string(in.sdp_mid), in.sdp_mline_index);
+        }
+        break;
+    default:
+        std::cerr << "[STATE] Unknown message type: " << in.type_name << std::endl;
+        break;
+    }
+}
+
+void SharedState::sendToSession(std::shared_ptr<WebSocketSession> session, const SignalingMessage& message) {
+    std::cout << "[STATE] Sending to client: " << signalTypeName(message.type) << std::endl;
+    session->send(message);
 }
 
-void SharedState::sendToSession(std::shared_ptr<WebSocketSession> session, const std::string& message) {
-    try {
-        auto j = json::parse(message);
-        std::string type = j.value("type", "");
-        std::cout << "[STATE] Sending to client: " << type << std::endl;
+void SharedState::sendToClient(const std::string& client_id, const SignalingMessage& message) {
+    std::shared_ptr<WebSocketSession> session;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = client_sessions_.find(client_id);
+        if (it != client_sessions_.end()) session = it->second.lock();
+    }
+    if (session) {
+        sendToSession(session, message);
     }
-    catch (...) {
-        std::cout << "[STATE] Sending to client (non-JSON)" << std::endl;
+    else {
+        // Detached: whatever we drop here is regenerated by the ICE restart
+        // on resume.
+        std::cerr << "[STATE] No session for " << client_id << ", message dropped" << std::endl;
     }
+}
+
+void SharedState::broadcast(const SignalingMessage& message) {
+    std::vector<std::shared_ptr<WebSocketSession>> targets;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        targets.reserve(sessions_.size());
+        for (const auto& weak : sessions_) {
+            if (auto session = weak.lock()) targets.push_back(std::move(session));
+        }
+    }
+    for (auto& session : targets) session->send(message);
+}
 
-    
-    session->send(std::make_shared<std::string const>(message));
+void SharedState::setTranscoder(std::shared_ptr<Transcoder> transcoder, std::shared_ptr<MediaCatalog> catalog) {
+    transcoder_ = std::move(transcoder);
+    catalog_ = std::move(catalog);
 }
 
+void SharedState::requestSync() {
+    {
+        std::lock_guard<std::mutex> lock(sync_mutex_);
+        sync_pending_ = true;
+    }
+    sync_cv_.notify_one();
+}
+
+// Wakes on start/stop, on a newly opened sync channel, or after
+// sync_heartbeat_ms of silence. One frame is encoded per wake-up and the same
+// bytes go to every open channel.
 void SharedState::syncLoop() {
     std::cout << "[STATE] Sync loop started" << std::endl;
 
-    while (sync_running_) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-
+    // A non-positive heartbeat would turn wait_for() into a spin on rtc_mutex_.
+    const auto heartbeat = std::chrono::milliseconds(std::max(50, rtc_manager_->engineConfig().sync_heartbeat_ms));
+    bool was_streaming = false;
 
-        bool streaming = false;
-        double time = 0.0;
+    while (true) {
         {
-            std::lock_guard<std::mutex> rtc_lock(rtc_mutex_);
-            streaming = rtc_manager_->isStreaming();
-            if (streaming) time = rtc_manager_->getCurrentPlaybackTime();
+            std::unique_lock<std::mutex> lock(sync_mutex_);
+            sync_cv_.wait_for(lock, heartbeat, [this]() { return sync_pending_ || !sync_running_; });
+            if (!sync_running_) break;
+            sync_pending_ = false;
         }
-        if (!streaming) continue;
 
-      
-        std::vector<std::string> client_ids;
-        client_ids.reserve(64);
+        // Cheap when nothing is detached; riding the heartbeat keeps expiry
+        // within a second of the deadline without another thread.
+        reapDetached();
 
+        SyncFrame frame;
         {
-            std::lock_guard<std::mutex> lock(mutex_);
-
-            for (auto it = session_to_client_id_.begin(); it != session_to_client_id_.end();) {
-                if (it->first.expired()) {
-                    it = session_to_client_id_.erase(it);
-                    continue;
-                }
-                client_ids.push_back(it->second);
-                ++it;
-            }
-
-
-            for (auto it = sessions_.begin(); it != sessions_.end();) {
-                if (it->expired()) it = sessions_.erase(it);
-                else ++it;
-            }
+            std::lock_guard<std::mutex> rtc_lock(rtc_mutex_);
+            frame.playing = rtc_manager_->isStreaming();
+            if (frame.playing) frame.media_time = rtc_manager_->getCurrentPlaybackTime();
         }
 
-        if (client_ids.empty()) continue;
+        // While idle only the stop transition itself is worth announcing.
+        if (!frame.playing && !was_streaming) continue;
+        was_streaming = frame.playing;
 
-        {
-            std::lock_guard<std::mutex> rtc_lock(rtc_mutex_);
-            for (const auto& client_id : client_ids) {
-                rtc_manager_->sendPlaybackPosition(client_id, time, true);
-            }
-        }
+        frame.seq = ++sync_seq_;
+        frame.wallclock_us = wallClockUs();
+        frame.playout_target_ms = static_cast<uint16_t>(rtc_manager_->playoutTargetMs());
+
+        rtc_manager_->broadcastSync(frame);
     }
 
     std::cout << "[STATE] Sync loop stopped" << std::endl;
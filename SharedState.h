@@ -4,13 +4,22 @@
 #include <mutex>
 #include <set>
 #include <string>
+#include <string_view>
 #include <map>
 #include <functional>
 #include <thread>
 #include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+
+#include "EngineConfig.h"
 
 class WebSocketSession;
 class RTCManager;
+class Transcoder;
+class MediaCatalog;
+struct SignalingMessage;
 
 class SharedState {
     std::mutex mutex_;
@@ -24,17 +33,52 @@ class SharedState {
     std::unique_ptr<RTCManager> rtc_manager_;
     std::mutex rtc_mutex_;
 
+    // Optional; start_stream prefers its renditions. Set before serving.
+    // Only files the catalog lists are handed to the transcoder.
+    std::shared_ptr<Transcoder> transcoder_;
+    std::shared_ptr<MediaCatalog> catalog_;
+
     std::thread sync_thread_;
     std::atomic<bool> sync_running_{ false };
+    std::mutex sync_mutex_;
+    std::condition_variable sync_cv_;
+    bool sync_pending_ = false;
+    uint32_t sync_seq_ = 0;
+
+    // Clients whose WebSocket went away while their control channel stayed up.
+    std::set<std::string> parked_clients_;
 
-    void sendToSession(std::shared_ptr<WebSocketSession> session, const std::string& message);
+    // Session resumption: every client gets a token on join; a WebSocket that
+    // drops leaves its peer connection detached for resume_grace_ms, and a new
+    // WebSocket presenting the token takes it over.
+    struct Detached {
+        std::chrono::steady_clock::time_point since;
+        std::chrono::steady_clock::time_point deadline;
+    };
+    uint64_t next_client_id_ = 0;
+    std::map<std::string, std::string> resume_tokens_; // token -> client id
+    std::map<std::string, std::weak_ptr<WebSocketSession>> client_sessions_;
+    std::map<std::string, Detached> detached_;
+
+    void sendToSession(std::shared_ptr<WebSocketSession> session, const SignalingMessage& message);
+    void sendToClient(const std::string& client_id, const SignalingMessage& message);
+    void forgetClientLocked(const std::string& client_id);
+    void reapDetached();
     void syncLoop();
+    void requestSync();
+    void dispatch(const std::string& client_id, std::string_view message);
+    void onControlClosed(const std::string& client_id);
 
 public:
     SharedState();
+    explicit SharedState(const EngineConfig& config);
     ~SharedState();
 
-    void join(std::shared_ptr<WebSocketSession> session);
+    void join(std::shared_ptr<WebSocketSession> session, const std::string& resume_token = std::string());
     void leave(std::shared_ptr<WebSocketSession> session);
-    void send(std::string message, std::shared_ptr<WebSocketSession> sender);
+    void send(std::string_view message, std::shared_ptr<WebSocketSession> sender);
+
+    // To every connected WebSocket; safe from any thread.
+    void broadcast(const SignalingMessage& message);
+    void setTranscoder(std::shared_ptr<Transcoder> transcoder, std::shared_ptr<MediaCatalog> catalog);
 };
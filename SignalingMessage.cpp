@@ -0,0 +1,362 @@
+#include "SignalingMessage.h"
+
+#include <charconv>
+
+namespace {
+
+    struct TypeName {
+        SignalType type;
+        std::string_view name;
+    };
+
+    constexpr TypeName kTypeNames[] = {
+        { SignalType::kSession, "session" },
+        { SignalType::kOffer, "offer" },
+        { SignalType::kAnswer, "answer" },
+        { SignalType::kIceCandidate, "ice_candidate" },
+        { SignalType::kStartStream, "start_stream" },
+        { SignalType::kStopStream, "stop_stream" },
+        { SignalType::kSeek, "seek" },
+        { SignalType::kRestartIce, "restart_ice" },
+        { SignalType::kReconnected, "reconnected" },
+        { SignalType::kTranscodeProgress, "transcode_progress" },
+        { SignalType::kTranscodeDone, "transcode_done" },
+    };
+
+    void appendQuoted(std::string& out, std::string_view s) {
+        static const char* hex = "0123456789abcdef";
+        out.push_back('"');
+        std::size_t run = 0;
+        for (std::size_t i = 0; i < s.size(); ++i) {
+            const unsigned char c = static_cast<unsigned char>(s[i]);
+            if (c >= 0x20 && c != '"' && c != '\\') continue;
+            out.append(s.data() + run, i - run);
+            run = i + 1;
+            switch (c) {
+            case '"': out.append("\\\""); break;
+            case '\\': out.append("\\\\"); break;
+            case '\n': out.append("\\n"); break;
+            case '\r': out.append("\\r"); break;
+            case '\t': out.append("\\t"); break;
+            case '\b': out.append("\\b"); break;
+            case '\f': out.append("\\f"); break;
+            default:
+                out.append("\\u00");
+                out.push_back(hex[c >> 4]);
+                out.push_back(hex[c & 0xF]);
+            }
+        }
+        out.append(s.data() + run, s.size() - run);
+        out.push_back('"');
+    }
+
+    void appendField(std::string& out, std::string_view key, std::string_view value) {
+        out.push_back(',');
+        appendQuoted(out, key);
+        out.push_back(':');
+        appendQuoted(out, value);
+    }
+
+    std::string openMessage(SignalType type, std::size_t body_hint) {
+        std::string out;
+        out.reserve(body_hint + 48);
+        out.append("{\"type\":");
+        appendQuoted(out, signalTypeName(type));
+        return out;
+    }
+
+    // Single forward pass over the text; nothing is materialized except
+    // strings that contain escapes.
+    class Scanner {
+    public:
+        Scanner(std::string_view text, std::string& scratch)
+            : p_(text.data()), end_(text.data() + text.size()), scratch_(scratch) {
+        }
+
+        bool parseObject(InboundSignal& out) {
+            skipWs();
+            if (!consume('{')) return false;
+            skipWs();
+            if (consume('}')) return true;
+
+            while (true) {
+                skipWs();
+                std::string_view key;
+                if (!rawString(key)) return false;
+                skipWs();
+                if (!consume(':')) return false;
+                skipWs();
+                if (!field(key, out)) return false;
+                skipWs();
+                if (consume(',')) continue;
+                if (consume('}')) return true;
+                return false;
+            }
+        }
+
+    private:
+        bool field(std::string_view key, InboundSignal& out) {
+            if (key == "type") return stringOrSkip(out.type_name);
+            if (key == "sdp") return stringOrSkip(out.sdp);
+            if (key == "candidate") return stringOrSkip(out.candidate);
+            if (key == "sdpMid") return stringOrSkip(out.sdp_mid);
+            if (key == "file_path") return stringOrSkip(out.file_path);
+            if (key == "sdpMLineIndex") {
+                double v = 0.0;
+                if (!numberOrSkip(v)) return false;
+                out.sdp_mline_index = static_cast<int>(v);
+                return true;
+            }
+            if (key == "position") return numberOrSkip(out.position);
+            if (key == "latency_ms") return numberOrSkip(out.latency_ms);
+            return skipValue();
+        }
+
+        bool stringOrSkip(std::string_view& out) {
+            if (p_ < end_ && *p_ == '"') return string(out);
+            return skipValue();
+        }
+
+        bool numberOrSkip(double& out) {
+            if (p_ < end_ && (*p_ == '-' || (*p_ >= '0' && *p_ <= '9'))) {
+                const char* start = p_;
+                while (p_ < end_ && isNumberChar(*p_)) ++p_;
+                const auto r = std::from_chars(start, p_, out);
+                return r.ec == std::errc() && r.ptr == p_;
+            }
+            return skipValue();
+        }
+
+        // Key or value without unescaping; used where the content is only
+        // compared or thrown away.
+        bool rawString(std::string_view& out) {
+            if (!consume('"')) return false;
+            const char* start = p_;
+            while (p_ < end_ && *p_ != '"') {
+                if (*p_ == '\\') ++p_;
+                ++p_;
+            }
+            if (p_ >= end_) return false;
+            out = std::string_view(start, static_cast<std::size_t>(p_ - start));
+            ++p_;
+            return true;
+        }
+
+        bool string(std::string_view& out) {
+            if (!consume('"')) return false;
+            const char* start = p_;
+            while (p_ < end_ && *p_ != '"' && *p_ != '\\') {
+                if (static_cast<unsigned char>(*p_) < 0x20) return false;
+                ++p_;
+            }
+            if (p_ >= end_) return false;
+            if (*p_ == '"') {
+                out = std::string_view(start, static_cast<std::size_t>(p_ - start));
+                ++p_;
+                return true;
+            }
+
+            // Escaped: the unescaped form is never longer than the source, so
+            // the reservation made in parseSignal() holds.
+            const std::size_t begin = scratch_.size();
+            scratch_.append(start, static_cast<std::size_t>(p_ - start));
+            while (p_ < end_ && *p_ != '"') {
+                const char c = *p_++;
+                if (static_cast<unsigned char>(c) < 0x20) return false;
+                if (c != '\\') {
+                    scratch_.push_back(c);
+                    continue;
+                }
+                if (p_ >= end_) return false;
+                switch (*p_++) {
+                case '"': scratch_.push_back('"'); break;
+                case '\\': scratch_.push_back('\\'); break;
+                case '/': scratch_.push_back('/'); break;
+                case 'b': scratch_.push_back('\b'); break;
+                case 'f': scratch_.push_back('\f'); break;
+                case 'n': scratch_.push_back('\n'); break;
+                case 'r': scratch_.push_back('\r'); break;
+                case 't': scratch_.push_back('\t'); break;
+                case 'u': if (!unicodeEscape()) return false; break;
+                default: return false;
+                }
+            }
+            if (p_ >= end_) return false;
+            ++p_;
+            out = std::string_view(scratch_.data() + begin, scratch_.size() - begin);
+            return true;
+        }
+
+        bool hex4(uint32_t& out) {
+            if (end_ - p_ < 4) return false;
+            out = 0;
+            for (int i = 0; i < 4; ++i) {
+                const char c = *p_++;
+                out <<= 4;
+                if (c >= '0' && c <= '9') out |= static_cast<uint32_t>(c - '0');
+                else if (c >= 'a' && c <= 'f') out |= static_cast<uint32_t>(c - 'a' + 10);
+                else if (c >= 'A' && c <= 'F') out |= static_cast<uint32_t>(c - 'A' + 10);
+                else return false;
+            }
+            return true;
+        }
+
+        bool unicodeEscape() {
+            uint32_t cp = 0;
+            if (!hex4(cp)) return false;
+            if (cp >= 0xD800 && cp <= 0xDBFF) {
+                uint32_t low = 0;
+                if (end_ - p_ < 6 || p_[0] != '\\' || p_[1] != 'u') return false;
+                p_ += 2;
+                if (!hex4(low) || low < 0xDC00 || low > 0xDFFF) return false;
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+            }
+            else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                return false;
+            }
+
+            if (cp < 0x80) {
+                scratch_.push_back(static_cast<char>(cp));
+            }
+            else if (cp < 0x800) {
+                scratch_.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+                scratch_.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+            }
+            else if (cp < 0x10000) {
+                scratch_.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+                scratch_.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+                scratch_.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+            }
+            else {
+                scratch_.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+                scratch_.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+                scratch_.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+                scratch_.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+            }
+            return true;
+        }
+
+        bool skipValue() {
+            if (p_ >= end_) return false;
+            const char c = *p_;
+            if (c == '"') {
+                std::string_view ignored;
+                return rawString(ignored);
+            }
+            if (c == '{' || c == '[') {
+                int depth = 0;
+                while (p_ < end_) {
+                    const char d = *p_;
+                    if (d == '"') {
+                        std::string_view ignored;
+                        if (!rawString(ignored)) return false;
+                        continue;
+                    }
+                    ++p_;
+                    if (d == '{' || d == '[') ++depth;
+                    else if (d == '}' || d == ']') {
+                        if (--depth == 0) return true;
+                    }
+                }
+                return false;
+            }
+            // Number or literal.
+            const char* start = p_;
+            while (p_ < end_ && (isNumberChar(*p_) || (*p_ >= 'a' && *p_ <= 'z'))) ++p_;
+            return p_ != start;
+        }
+
+        static bool isNumberChar(char c) {
+            return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+        }
+
+        void skipWs() {
+            while (p_ < end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t')) ++p_;
+        }
+
+        bool consume(char c) {
+            if (p_ < end_ && *p_ == c) {
+                ++p_;
+                return true;
+            }
+            return false;
+        }
+
+        const char* p_;
+        const char* end_;
+        std::string& scratch_;
+    };
+
+}
+
+const char* signalTypeName(SignalType type) {
+    for (const auto& t : kTypeNames) {
+        if (t.type == type) return t.name.data();
+    }
+    return "unknown";
+}
+
+SignalType signalTypeFromName(std::string_view name) {
+    for (const auto& t : kTypeNames) {
+        if (t.name == name) return t.type;
+    }
+    return SignalType::kUnknown;
+}
+
+SignalingMessage SignalingMessage::description(SignalType type, std::string_view sdp) {
+    std::string out = openMessage(type, sdp.size() + sdp.size() / 16);
+    appendField(out, "sdp", sdp);
+    out.push_back('}');
+    return { type, std::make_shared<const std::string>(std::move(out)), {} };
+}
+
+SignalingMessage SignalingMessage::iceCandidate(std::string_view candidate, std::string_view sdp_mid, int sdp_mline_index) {
+    std::string out = openMessage(SignalType::kIceCandidate, candidate.size() + sdp_mid.size());
+    appendField(out, "candidate", candidate);
+    appendField(out, "sdpMid", sdp_mid);
+    out.append(",\"sdpMLineIndex\":");
+    out.append(std::to_string(sdp_mline_index));
+    out.push_back('}');
+    return { SignalType::kIceCandidate, std::make_shared<const std::string>(std::move(out)), {} };
+}
+
+SignalingMessage SignalingMessage::session(std::string_view client_id, std::string_view resume_token, bool resumed) {
+    std::string out = openMessage(SignalType::kSession, client_id.size() + resume_token.size());
+    appendField(out, "client_id", client_id);
+    appendField(out, "resume_token", resume_token);
+    out.append(resumed ? ",\"resumed\":true}" : ",\"resumed\":false}");
+    return { SignalType::kSession, std::make_shared<const std::string>(std::move(out)), {} };
+}
+
+SignalingMessage SignalingMessage::transcodeProgress(std::string_view file_path, std::string_view state, int percent, int fps) {
+    std::string out = openMessage(SignalType::kTranscodeProgress, file_path.size() + state.size() + 32);
+    appendField(out, "file_path", file_path);
+    appendField(out, "state", state);
+    out.append(",\"percent\":");
+    out.append(std::to_string(percent));
+    out.append(",\"fps\":");
+    out.append(std::to_string(fps));
+    out.push_back('}');
+    return { SignalType::kTranscodeProgress, std::make_shared<const std::string>(std::move(out)), std::string(file_path) };
+}
+
+SignalingMessage SignalingMessage::transcodeDone(std::string_view file_path, std::string_view state, std::string_view rendition, int rungs) {
+    std::string out = openMessage(SignalType::kTranscodeDone, file_path.size() + state.size() + rendition.size() + 16);
+    appendField(out, "file_path", file_path);
+    appendField(out, "state", state);
+    appendField(out, "rendition", rendition);
+    out.append(",\"rungs\":");
+    out.append(std::to_string(rungs));
+    out.push_back('}');
+    return { SignalType::kTranscodeDone, std::make_shared<const std::string>(std::move(out)), {} };
+}
+
+bool parseSignal(std::string_view text, InboundSignal& out, std::string& scratch) {
+    scratch.clear();
+    scratch.reserve(text.size());
+    out = InboundSignal{};
+    Scanner scanner(text, scratch);
+    if (!scanner.parseObject(out)) return false;
+    out.type = signalTypeFromName(out.type_name);
+    return true;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// JSON signaling carried over the WebSocket and the control data channel.
+// Outgoing messages are serialized once and keep their type next to the
+// bytes, so nothing downstream has to parse them again. Incoming ones are
+// scanned in a single pass into views over the received text.
+
+enum class SignalType : uint8_t {
+    kUnknown = 0,
+    kSession,
+    kOffer,
+    kAnswer,
+    kIceCandidate,
+    kStartStream,
+    kStopStream,
+    kSeek,
+    kRestartIce,
+    kReconnected,
+    kTranscodeProgress,
+    kTranscodeDone,
+};
+
+const char* signalTypeName(SignalType type);
+SignalType signalTypeFromName(std::string_view name);
+
+struct SignalingMessage {
+    SignalType type = SignalType::kUnknown;
+    std::shared_ptr<const std::string> payload;
+    // Status messages supersede a queued one only with the same type and key.
+    std::string key;
+
+    static SignalingMessage description(SignalType type, std::string_view sdp);
+    static SignalingMessage iceCandidate(std::string_view candidate, std::string_view sdp_mid, int sdp_mline_index);
+    static SignalingMessage session(std::string_view client_id, std::string_view resume_token, bool resumed);
+    // Broadcast while an upload is normalized; `percent` of the source duration.
+    static SignalingMessage transcodeProgress(std::string_view file_path, std::string_view state, int percent, int fps);
+    // `state` is done, skipped or failed; `rendition` is set only when done,
+    // `rungs` counts the pre-encoded ladder files.
+    static SignalingMessage transcodeDone(std::string_view file_path, std::string_view state, std::string_view rendition, int rungs);
+};
+
+// Fields point into the parsed text, or into the scratch buffer handed to
+// parseSignal() for strings that had escapes; both must outlive the struct.
+// Absent fields stay empty / at their defaults.
+struct InboundSignal {
+    SignalType type = SignalType::kUnknown;
+    std::string_view type_name;
+    std::string_view sdp;
+    std::string_view candidate;
+    std::string_view sdp_mid;
+    std::string_view file_path;
+    int sdp_mline_index = 0;
+    double position = -1.0;
+    double latency_ms = -1.0;
+};
+
+// Returns false on malformed JSON or a non-object top level. `scratch` is
+// cleared and reserved up front, so views into it never move mid-parse and a
+// reused buffer stops allocating once it has seen the largest message.
+bool parseSignal(std::string_view text, InboundSignal& out, std::string& scratch);
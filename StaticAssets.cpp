@@ -0,0 +1,301 @@
+#include "StaticAssets.h"
+#include "ContentHash.h"
+#include "Metrics.h"
+
+#include <boost/beast/zlib/deflate_stream.hpp>
+#include <boost/crc.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace fs = std::filesystem;
+namespace zlib = boost::beast::zlib;
+
+namespace {
+
+    int64_t mtime_of(const fs::path& path, std::error_code& ec) {
+        const auto t = fs::last_write_time(path, ec);
+        if (ec) return 0;
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+    }
+
+    // The <file>.br sibling's mtime while it is at least as new as the file,
+    // otherwise 0: a stale one would serve old content.
+    int64_t brotli_mtime_of(const std::string& path, int64_t mtime) {
+        std::error_code ec;
+        const int64_t br = mtime_of(path + ".br", ec);
+        return !ec && br >= mtime ? br : 0;
+    }
+
+    bool read_file(const fs::path& path, std::string& out) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return false;
+        out.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        return !file.bad();
+    }
+
+    std::string content_type_of(const fs::path& path) {
+        std::string ext = path.extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+        if (ext == ".html" || ext == ".htm") return "text/html; charset=utf-8";
+        if (ext == ".js" || ext == ".mjs") return "application/javascript; charset=utf-8";
+        if (ext == ".css") return "text/css; charset=utf-8";
+        if (ext == ".json" || ext == ".map") return "application/json; charset=utf-8";
+        if (ext == ".txt") return "text/plain; charset=utf-8";
+        if (ext == ".svg") return "image/svg+xml";
+        if (ext == ".png") return "image/png";
+        if (ext == ".jpg" || ext == ".jpeg") return "image/jpeg";
+        if (ext == ".gif") return "image/gif";
+        if (ext == ".webp") return "image/webp";
+        if (ext == ".ico") return "image/x-icon";
+        if (ext == ".wasm") return "application/wasm";
+        if (ext == ".woff2") return "font/woff2";
+        return "application/octet-stream";
+    }
+
+    // Already compressed: gzip would only cost CPU at load time.
+    bool compressible(const std::string& content_type) {
+        return content_type.compare(0, 5, "text/") == 0 ||
+            content_type.compare(0, 22, "application/javascript") == 0 ||
+            content_type.compare(0, 16, "application/json") == 0 ||
+            content_type == "image/svg+xml" || content_type == "application/wasm" ||
+            content_type == "image/x-icon";
+    }
+
+    // RFC 1952 member around a raw deflate stream, with Beast's header-only
+    // deflate so no zlib has to be linked.
+    bool gzip(const std::string& in, int level, std::string& out) {
+        zlib::deflate_stream ds;
+        ds.reset(level, 15, 8, zlib::Strategy::normal);
+
+        static const unsigned char header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 255 };
+        out.assign(reinterpret_cast<const char*>(header), sizeof(header));
+        out.resize(sizeof(header) + ds.upper_bound(in.size()));
+
+        zlib::z_params zs;
+        zs.next_in = in.data();
+        zs.avail_in = in.size();
+        zs.next_out = &out[sizeof(header)];
+        zs.avail_out = out.size() - sizeof(header);
+        boost::beast::error_code ec;
+        ds.write(zs, zlib::Flush::finish, ec);
+        if (ec != zlib::error::end_of_stream) return false;
+        out.resize(sizeof(header) + zs.total_out);
+
+        boost::crc_32_type crc;
+        crc.process_bytes(in.data(), in.size());
+        const uint32_t trailer[2] = { crc.checksum(), static_cast<uint32_t>(in.size()) };
+        for (uint32_t v : trailer) {
+            for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+        }
+        return true;
+    }
+
+    std::string trim(std::string_view s) {
+        const auto b = s.find_first_not_of(" \t");
+        if (b == std::string_view::npos) return {};
+        const auto e = s.find_last_not_of(" \t");
+        return std::string(s.substr(b, e - b + 1));
+    }
+
+    // True when `coding` is listed without q=0 (or covered by a "*" that is).
+    bool accepts(std::string_view header, std::string_view coding) {
+        bool star = false;
+        std::size_t pos = 0;
+        while (pos <= header.size()) {
+            auto comma = header.find(',', pos);
+            if (comma == std::string_view::npos) comma = header.size();
+            const std::string_view item = header.substr(pos, comma - pos);
+            pos = comma + 1;
+
+            const auto semi = item.find(';');
+            std::string name = trim(item.substr(0, semi));
+            std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+            bool zero = false;
+            if (semi != std::string_view::npos) {
+                const std::string param = trim(item.substr(semi + 1));
+                if (param.size() >= 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+                    zero = std::strtod(param.c_str() + 2, nullptr) <= 0.0;
+                }
+            }
+            if (name == coding) return !zero;
+            if (name == "*") star = !zero;
+        }
+        return star;
+    }
+
+}
+
+const StaticAsset::Variant& StaticAsset::variant(Encoding e) const {
+    switch (e) {
+    case Encoding::kGzip: return gzip;
+    case Encoding::kBrotli: return brotli;
+    default: return identity;
+    }
+}
+
+StaticAssetCache::StaticAssetCache(std::string web_root, StaticAssetOptions options)
+    : web_root_(std::move(web_root))
+    , options_(options)
+{
+}
+
+void StaticAssetCache::load() {
+    std::size_t files = 0;
+    uint64_t bytes = 0;
+    uint64_t gzip_bytes = 0;
+    std::error_code ec;
+    for (fs::recursive_directory_iterator it(web_root_, ec), end; !ec && it != end; it.increment(ec)) {
+        std::error_code file_ec;
+        if (it->path().filename().string().front() == '.') {
+            // Never served, see resolve().
+            if (it->is_directory(file_ec)) it.disable_recursion_pending();
+            continue;
+        }
+        if (!it->is_regular_file(file_ec)) continue;
+        const std::string ext = it->path().extension().string();
+        if (ext == ".br" || ext == ".gz") continue;
+
+        auto asset = read(it->path().string());
+        if (!asset) continue;
+        ++files;
+        bytes += asset->identity.body.size();
+        gzip_bytes += asset->gzip.body.empty() ? asset->identity.body.size() : asset->gzip.body.size();
+
+        const std::string path = asset->path;
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_[path] = Entry{ std::move(asset), std::chrono::steady_clock::now() };
+    }
+    if (ec) std::cerr << "[STATIC] Cannot list " << web_root_ << ": " << ec.message() << std::endl;
+    std::cout << "[STATIC] " << files << " asset(s) from " << web_root_ << ", " << bytes
+        << " bytes, " << gzip_bytes << " gzipped" << std::endl;
+}
+
+std::shared_ptr<const StaticAsset> StaticAssetCache::find(std::string_view target) {
+    static auto& reloads = Metrics::instance().counter("http_static_reloads_total");
+
+    const std::string path = resolve(target);
+    if (path.empty()) return nullptr;
+
+    const auto now = std::chrono::steady_clock::now();
+    std::shared_ptr<const StaticAsset> cached;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(path);
+        if (it != entries_.end()) {
+            if (now - it->second.checked < options_.recheck_interval) return it->second.asset;
+            // Claim the check so concurrent requests keep serving the
+            // cached copy instead of all stat-ing the same file.
+            it->second.checked = now;
+            cached = it->second.asset;
+        }
+    }
+
+    if (cached) {
+        std::error_code ec;
+        const int64_t mtime = mtime_of(path, ec);
+        const auto size = fs::file_size(path, ec);
+        if (!ec && mtime == cached->mtime && size == cached->size &&
+            brotli_mtime_of(path, mtime) == cached->brotli_mtime) {
+            return cached;
+        }
+    }
+
+    auto fresh = read(path);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!fresh) {
+        entries_.erase(path);
+        return nullptr;
+    }
+    if (cached) {
+        reloads.inc();
+        std::cout << "[STATIC] Reloaded " << path << std::endl;
+    }
+    entries_[path] = Entry{ fresh, now };
+    return fresh;
+}
+
+std::string StaticAssetCache::resolve(std::string_view target) const {
+    target = target.substr(0, target.find_first_of("?#"));
+    if (target.empty() || target.front() != '/') return {};
+    if (target.find('\\') != std::string_view::npos || target.find('\0') != std::string_view::npos) return {};
+
+    fs::path rel = fs::path(std::string(target.substr(1))).lexically_normal();
+    if (rel.empty() || rel == ".") rel = "index.html";
+    // Anything that climbs out of the root, or names a hidden file.
+    for (const auto& part : rel) {
+        const std::string s = part.string();
+        if (s == ".." || (!s.empty() && s.front() == '.')) return {};
+    }
+    if (rel.is_absolute()) return {};
+    return (fs::path(web_root_) / rel).string();
+}
+
+std::shared_ptr<const StaticAsset> StaticAssetCache::read(const std::string& path) const {
+    std::error_code ec;
+    if (!fs::is_regular_file(path, ec)) return nullptr;
+    const auto size = fs::file_size(path, ec);
+    if (ec) return nullptr;
+    if (size > options_.max_file_bytes) {
+        std::cerr << "[STATIC] " << path << " is " << size << " bytes, over the "
+            << options_.max_file_bytes << " limit; not served" << std::endl;
+        return nullptr;
+    }
+
+    auto asset = std::make_shared<StaticAsset>();
+    asset->path = path;
+    asset->mtime = mtime_of(path, ec);
+    if (ec || !read_file(path, asset->identity.body)) return nullptr;
+    // Taken after the read: a file rewritten meanwhile is simply reloaded
+    // by the next check.
+    asset->size = asset->identity.body.size();
+    asset->content_type = content_type_of(path);
+    asset->html = asset->content_type.compare(0, 9, "text/html") == 0;
+
+    const std::string hash = toHex(Xxh64::hash(asset->identity.body.data(), asset->identity.body.size()));
+    asset->identity.etag = "\"" + hash + "\"";
+
+    if (compressible(asset->content_type) && asset->size >= options_.min_gzip_bytes) {
+        std::string packed;
+        if (gzip(asset->identity.body, options_.gzip_level, packed) && packed.size() < asset->size) {
+            asset->gzip.body = std::move(packed);
+            asset->gzip.etag = "\"" + hash + "-gz\"";
+        }
+    }
+
+    const int64_t br_mtime = brotli_mtime_of(path, asset->mtime);
+    if (br_mtime != 0 && read_file(path + ".br", asset->brotli.body) && !asset->brotli.body.empty()) {
+        asset->brotli.etag = "\"" + hash + "-br\"";
+        asset->brotli_mtime = br_mtime;
+    }
+    else {
+        asset->brotli.body.clear();
+    }
+    return asset;
+}
+
+StaticAsset::Encoding StaticAssetCache::negotiate(const StaticAsset& asset, std::string_view accept_encoding) {
+    if (!asset.brotli.body.empty() && accepts(accept_encoding, "br")) return StaticAsset::Encoding::kBrotli;
+    if (!asset.gzip.body.empty() && accepts(accept_encoding, "gzip")) return StaticAsset::Encoding::kGzip;
+    return StaticAsset::Encoding::kIdentity;
+}
+
+bool StaticAssetCache::notModified(std::string_view if_none_match, const std::string& etag) {
+    std::size_t pos = 0;
+    while (pos < if_none_match.size()) {
+        auto comma = if_none_match.find(',', pos);
+        if (comma == std::string_view::npos) comma = if_none_match.size();
+        std::string tag = trim(if_none_match.substr(pos, comma - pos));
+        pos = comma + 1;
+
+        if (tag == "*") return true;
+        // Weak comparison, as If-None-Match calls for.
+        if (tag.compare(0, 2, "W/") == 0) tag.erase(0, 2);
+        if (tag == etag) return true;
+    }
+    return false;
+}
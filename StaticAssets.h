@@ -0,0 +1,83 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+struct StaticAssetOptions {
+    std::size_t max_file_bytes = 8 * 1024 * 1024; // larger files are not served from here
+    std::size_t min_gzip_bytes = 256;             // below this the gzip header eats the gain
+    int gzip_level = 9;                           // paid once per load, not per request
+    // How often a request may stat the file behind an asset to notice edits.
+    std::chrono::milliseconds recheck_interval{ 1000 };
+};
+
+// One file of the web root, ready to send: the bytes as they are, a gzip
+// copy when it is smaller, and the .br sibling when one was shipped.
+struct StaticAsset {
+    enum class Encoding { kIdentity, kGzip, kBrotli };
+
+    struct Variant {
+        std::string body;
+        std::string etag; // strong, quoted; differs per encoding
+    };
+
+    std::string path;
+    std::string content_type;
+    bool html = false;
+    Variant identity;
+    Variant gzip;   // body empty: not worth it
+    Variant brotli; // body empty: no current <file>.br
+
+    int64_t mtime = 0;
+    uint64_t size = 0;
+    int64_t brotli_mtime = 0; // of the .br sibling in use, 0 if none
+
+    const Variant& variant(Encoding e) const;
+};
+
+// In-memory copy of the web root for GET/HEAD of the UI. Everything under
+// the root is read once at startup; a request notices an edited file within
+// recheck_interval and reloads it, and a file added later is loaded on its
+// first request. Brotli is never computed here: run `brotli -k` over the
+// assets and the <file>.br siblings are picked up while they are at least
+// as new as the file. Thread-safe; one instance serves every HttpServer.
+class StaticAssetCache {
+public:
+    explicit StaticAssetCache(std::string web_root, StaticAssetOptions options = StaticAssetOptions());
+
+    StaticAssetCache(const StaticAssetCache&) = delete;
+    StaticAssetCache& operator=(const StaticAssetCache&) = delete;
+
+    void load();
+
+    // The asset for a request target ("/" is index.html, the query is
+    // ignored), or nullptr when there is no such file or the path leaves
+    // the root.
+    std::shared_ptr<const StaticAsset> find(std::string_view target);
+
+    // Best encoding the Accept-Encoding header allows that the asset has.
+    static StaticAsset::Encoding negotiate(const StaticAsset& asset, std::string_view accept_encoding);
+
+    // If-None-Match against the ETag of the variant about to be sent.
+    static bool notModified(std::string_view if_none_match, const std::string& etag);
+
+private:
+    struct Entry {
+        std::shared_ptr<const StaticAsset> asset;
+        std::chrono::steady_clock::time_point checked;
+    };
+
+    std::string resolve(std::string_view target) const;
+    std::shared_ptr<const StaticAsset> read(const std::string& path) const;
+
+    const std::string web_root_;
+    const StaticAssetOptions options_;
+
+    std::mutex mutex_;
+    std::map<std::string, Entry> entries_; // by path under web_root_
+};
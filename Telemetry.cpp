@@ -0,0 +1,56 @@
+#include "Telemetry.h"
+
+namespace {
+
+    const std::vector<double> kFpsBounds = { 5, 10, 15, 20, 24, 30, 45, 60 };
+    const std::vector<double> kDropBounds = { 0.001, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5 };
+    const std::vector<double> kJitterBounds = { 10, 20, 50, 100, 200, 500, 1000, 2000 };
+    const std::vector<double> kStallBounds = { 50, 100, 250, 500, 1000, 2500, 5000 };
+
+}
+
+TelemetryAggregator::TelemetryAggregator(const std::vector<VideoLayer>& layers) {
+    per_layer_.reserve(layers.size());
+    for (const auto& l : layers) per_layer_.push_back(makeSeries(l.name));
+    unknown_ = makeSeries("unknown");
+}
+
+TelemetryAggregator::Series TelemetryAggregator::makeSeries(const std::string& stream) {
+    auto& m = Metrics::instance();
+    const std::string label = "stream=\"" + stream + "\"";
+    Series s;
+    s.fps = &m.histogram("viewer_decoded_fps", kFpsBounds, label);
+    s.drop_ratio = &m.histogram("viewer_frame_drop_ratio", kDropBounds, label);
+    s.jitter_buffer_ms = &m.histogram("viewer_jitter_buffer_ms", kJitterBounds, label);
+    s.stall_ms = &m.histogram("viewer_stall_ms", kStallBounds, label);
+    s.reports = &m.counter("viewer_telemetry_reports_total", label);
+    s.stalls = &m.counter("viewer_stalls_total", label);
+    s.frames_dropped = &m.counter("viewer_frames_dropped_total", label);
+    return s;
+}
+
+void TelemetryAggregator::apply(ViewerTelemetry& viewer, const TelemetryFrame& frame, int64_t now_ms) {
+    const uint32_t frames = frame.frames_decoded + frame.frames_dropped;
+    viewer.fps = frame.interval_ms > 0 ? 1000.0 * frame.frames_decoded / frame.interval_ms : 0.0;
+    viewer.drop_ratio = frames > 0 ? static_cast<double>(frame.frames_dropped) / frames : 0.0;
+    viewer.jitter_buffer_ms = frame.jitter_buffer_us / 1000.0;
+    viewer.position_s = frame.position_s;
+    viewer.stalled = frame.stalled;
+    viewer.stalls = frame.stalls;
+    viewer.stalls_total += frame.stalls;
+    viewer.stall_ms_total += frame.stall_ms;
+    viewer.updated_ms = now_ms;
+    viewer.reports++;
+}
+
+void TelemetryAggregator::ingest(const ViewerTelemetry& viewer, const TelemetryFrame& frame, int layer) {
+    const Series& s = layer >= 0 && layer < static_cast<int>(per_layer_.size()) ? per_layer_[layer] : unknown_;
+
+    s.reports->inc();
+    if (frame.interval_ms > 0) s.fps->observe(viewer.fps);
+    if (frame.frames_decoded + frame.frames_dropped > 0) s.drop_ratio->observe(viewer.drop_ratio);
+    if (frame.jitter_buffer_us > 0) s.jitter_buffer_ms->observe(viewer.jitter_buffer_ms);
+    if (frame.stall_ms > 0) s.stall_ms->observe(frame.stall_ms);
+    if (frame.stalls) s.stalls->inc(frame.stalls);
+    if (frame.frames_dropped) s.frames_dropped->inc(frame.frames_dropped);
+}
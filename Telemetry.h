@@ -0,0 +1,51 @@
+#pragma once
+
+#include "ChannelProtocol.h"
+#include "Metrics.h"
+#include "VideoLayers.h"
+
+#include <cstdint>
+#include <vector>
+
+// Latest report from one viewer, already turned into rates.
+struct ViewerTelemetry {
+    int64_t updated_ms = 0;
+    uint32_t reports = 0;
+    double fps = 0.0;
+    double drop_ratio = 0.0;
+    double jitter_buffer_ms = 0.0;
+    double position_s = 0.0;
+    bool stalled = false;
+    uint32_t stalls = 0;          // in the last interval
+    uint64_t stalls_total = 0;
+    uint64_t stall_ms_total = 0;
+};
+
+// Folds viewer reports into per-stream histograms. Each rung of the layer
+// ladder is its own encoded stream, so series are labelled by rung. All series
+// are created up front; ingest() only touches atomics.
+class TelemetryAggregator {
+public:
+    explicit TelemetryAggregator(const std::vector<VideoLayer>& layers);
+
+    static void apply(ViewerTelemetry& viewer, const TelemetryFrame& frame, int64_t now_ms);
+
+    // `layer` < 0 or out of range lands in the "unknown" stream.
+    void ingest(const ViewerTelemetry& viewer, const TelemetryFrame& frame, int layer);
+
+private:
+    struct Series {
+        Metrics::Histogram* fps = nullptr;
+        Metrics::Histogram* drop_ratio = nullptr;
+        Metrics::Histogram* jitter_buffer_ms = nullptr;
+        Metrics::Histogram* stall_ms = nullptr;
+        Metrics::Counter* reports = nullptr;
+        Metrics::Counter* stalls = nullptr;
+        Metrics::Counter* frames_dropped = nullptr;
+    };
+
+    static Series makeSeries(const std::string& stream);
+
+    std::vector<Series> per_layer_;
+    Series unknown_;
+};
@@ -0,0 +1,623 @@
+#include "Transcoder.h"
+#include "IngestRegistry.h"
+#include "Metrics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+#include <libswscale/swscale.h>
+}
+
+namespace fs = std::filesystem;
+
+namespace {
+
+    // A timestamp jump in the source must not turn into minutes of repeated frames.
+    constexpr int64_t kMaxDuplicateSeconds = 10;
+
+    int64_t mtime_of(const std::string& path) {
+        std::error_code ec;
+        const auto t = fs::last_write_time(path, ec);
+        if (ec) return -1;
+        return std::chrono::duration_cast<std::chrono::seconds>(t.time_since_epoch()).count();
+    }
+
+    // A rendition counts only while it is at least as new as its source; an
+    // upload that replaced the source makes it stale.
+    bool is_fresh(const std::string& source, const std::string& rendition) {
+        const int64_t src = mtime_of(source);
+        const int64_t out = mtime_of(rendition);
+        return src >= 0 && out >= src;
+    }
+
+    bool all_fresh(const std::string& source, const std::vector<std::string>& renditions) {
+        return std::all_of(renditions.begin(), renditions.end(),
+            [&](const std::string& r) { return is_fresh(source, r); });
+    }
+
+    // What CaptureLoop already decodes cheaply: nothing to gain from a copy.
+    bool is_normalized(const AVStream* vs, const TranscoderConfig& config) {
+        const AVCodecParameters* par = vs->codecpar;
+        if (par->codec_id != AV_CODEC_ID_VP8 && par->codec_id != AV_CODEC_ID_H264) return false;
+        if (par->format != AV_PIX_FMT_YUV420P) return false;   // 8-bit 4:2:0 only
+        if (par->video_delay > 0) return false;                // B-frames
+        if (vs->avg_frame_rate.num <= 0 || av_cmp_q(vs->avg_frame_rate, vs->r_frame_rate) != 0) return false; // VFR
+        if (av_q2d(vs->avg_frame_rate) > config.max_fps + 0.5) return false;
+        return par->height <= config.max_height;
+    }
+
+    // One encoded output of a transcode: the mezzanine file or a ladder rung.
+    struct Output {
+        std::string path;
+        std::string tmp;
+        int width = 0;
+        int height = 0;
+        AVCodecContext* encoder = nullptr;
+        AVFormatContext* format = nullptr;
+        AVPacket* packet = nullptr;
+        SwsContext* sws = nullptr;
+        AVFrame* last = nullptr; // most recent scaled frame, repeated to fill gaps
+
+        ~Output() {
+            av_frame_free(&last);
+            sws_freeContext(sws);
+            av_packet_free(&packet);
+            avcodec_free_context(&encoder);
+            if (format) {
+                if (format->pb) avio_closep(&format->pb);
+                avformat_free_context(format);
+            }
+        }
+    };
+
+    // Everything one transcode opens, released on every exit.
+    struct TranscodeContext {
+        AVFormatContext* input = nullptr;
+        AVCodecContext* decoder = nullptr;
+        AVFrame* decoded = nullptr;
+        AVPacket* packet = nullptr;
+        std::vector<std::unique_ptr<Output>> outputs;
+
+        ~TranscodeContext() {
+            outputs.clear();
+            av_packet_free(&packet);
+            av_frame_free(&decoded);
+            avcodec_free_context(&decoder);
+            avformat_close_input(&input);
+        }
+
+        // Drops every partial file.
+        TranscodeProgress::State fail() {
+            for (auto& o : outputs) {
+                if (o->format && o->format->pb) avio_closep(&o->format->pb);
+                std::error_code ec;
+                fs::remove(o->tmp, ec);
+            }
+            return TranscodeProgress::State::kFailed;
+        }
+    };
+
+    // Encoder and muxer for one output, writing to `o.tmp`. `cbr` pins the
+    // rate of ladder rungs, so a rung's average is what it costs on the wire.
+    bool open_output(Output& o, const AVCodec* enc, const char* muxer, AVRational rate, int gop,
+        int64_t bitrate_bps, bool cbr) {
+        o.encoder = avcodec_alloc_context3(enc);
+        o.encoder->width = o.width;
+        o.encoder->height = o.height;
+        o.encoder->pix_fmt = AV_PIX_FMT_YUV420P;
+        o.encoder->time_base = av_inv_q(rate);
+        o.encoder->framerate = rate;
+        o.encoder->gop_size = gop;
+        o.encoder->keyint_min = gop; // fixed GOP: keyframes on the grid only
+        o.encoder->max_b_frames = 0;
+        o.encoder->bit_rate = bitrate_bps;
+        o.encoder->thread_count = 0;
+        if (cbr) {
+            o.encoder->rc_min_rate = bitrate_bps;
+            o.encoder->rc_max_rate = bitrate_bps;
+            o.encoder->rc_buffer_size = static_cast<int>(bitrate_bps);
+        }
+        if (enc->id == AV_CODEC_ID_VP8) {
+            av_opt_set(o.encoder->priv_data, "deadline", "good", 0);
+            av_opt_set_int(o.encoder->priv_data, "cpu-used", 4, 0);
+            // One visible frame per packet, which is what a WebRTC receiver
+            // expects when rungs are forwarded as they are.
+            av_opt_set_int(o.encoder->priv_data, "auto-alt-ref", 0, 0);
+            av_opt_set_int(o.encoder->priv_data, "lag-in-frames", 0, 0);
+        }
+        else {
+            av_opt_set(o.encoder->priv_data, "profile", "baseline", 0);
+            av_opt_set(o.encoder->priv_data, "preset", "veryfast", 0);
+            av_opt_set(o.encoder->priv_data, "x264-params", "scenecut=0", 0);
+        }
+
+        if (avformat_alloc_output_context2(&o.format, nullptr, muxer, o.tmp.c_str()) < 0) return false;
+        if (o.format->oformat->flags & AVFMT_GLOBALHEADER) o.encoder->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        if (avcodec_open2(o.encoder, enc, nullptr) < 0) return false;
+
+        AVStream* os = avformat_new_stream(o.format, nullptr);
+        if (!os) return false;
+        avcodec_parameters_from_context(os->codecpar, o.encoder);
+        os->time_base = o.encoder->time_base;
+        os->avg_frame_rate = rate;
+        o.packet = av_packet_alloc();
+        if (avio_open(&o.format->pb, o.tmp.c_str(), AVIO_FLAG_WRITE) < 0) return false;
+        return avformat_write_header(o.format, nullptr) >= 0;
+    }
+
+    // Sends one frame (nullptr flushes) and writes out whatever the encoder
+    // has ready. Returns < 0 on error.
+    int encode(Output& o, const AVFrame* frame) {
+        int ret = avcodec_send_frame(o.encoder, frame);
+        if (ret < 0) return ret;
+        while ((ret = avcodec_receive_packet(o.encoder, o.packet)) == 0) {
+            av_packet_rescale_ts(o.packet, o.encoder->time_base, o.format->streams[0]->time_base);
+            o.packet->stream_index = 0;
+            ret = av_interleaved_write_frame(o.format, o.packet);
+            if (ret < 0) return ret;
+        }
+        return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+    }
+
+    // Scales `in` for `o` into a fresh buffer (the encoder may still hold
+    // the previous one) and encodes it as frame `pts`.
+    bool encode_scaled(Output& o, const AVFrame* in, int64_t pts) {
+        o.sws = sws_getCachedContext(o.sws, in->width, in->height, static_cast<AVPixelFormat>(in->format),
+            o.width, o.height, AV_PIX_FMT_YUV420P, SWS_BILINEAR, nullptr, nullptr, nullptr);
+        if (!o.sws) return false;
+        AVFrame* scaled = av_frame_alloc();
+        scaled->format = AV_PIX_FMT_YUV420P;
+        scaled->width = o.width;
+        scaled->height = o.height;
+        if (av_frame_get_buffer(scaled, 0) < 0) {
+            av_frame_free(&scaled);
+            return false;
+        }
+        sws_scale(o.sws, in->data, in->linesize, 0, in->height, scaled->data, scaled->linesize);
+        scaled->pts = pts;
+        av_frame_free(&o.last);
+        o.last = scaled;
+        return encode(o, scaled) >= 0;
+    }
+
+    bool encode_repeat(Output& o, int64_t pts) {
+        AVFrame* dup = av_frame_clone(o.last);
+        if (!dup) return false;
+        dup->pts = pts;
+        const int ret = encode(o, dup);
+        av_frame_free(&dup);
+        return ret >= 0;
+    }
+
+}
+
+const char* transcodeStateName(TranscodeProgress::State state) {
+    switch (state) {
+    case TranscodeProgress::State::kQueued: return "queued";
+    case TranscodeProgress::State::kRunning: return "running";
+    case TranscodeProgress::State::kDone: return "done";
+    case TranscodeProgress::State::kSkipped: return "skipped";
+    default: return "failed";
+    }
+}
+
+Transcoder::Transcoder(std::string directory, TranscoderConfig config)
+    : directory_(std::move(directory))
+    , mezzanine_dir_(directory_ + "/mezzanine")
+    , config_(config)
+    , ladder_(config_.ladder)
+{
+    // Same order as LayerSelector, so rung i is viewer layer i.
+    std::sort(ladder_.begin(), ladder_.end(), [](const VideoLayer& a, const VideoLayer& b) {
+        return a.max_bitrate_bps < b.max_bitrate_bps;
+    });
+}
+
+Transcoder::~Transcoder() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t : workers_) {
+        if (t.joinable()) t.join();
+    }
+}
+
+void Transcoder::setProgressListener(std::function<void(const TranscodeProgress&)> listener) {
+    listener_ = std::move(listener);
+}
+
+void Transcoder::start() {
+    if (!config_.enabled) return;
+
+    std::error_code ec;
+    fs::create_directories(mezzanine_dir_, ec);
+
+    // Outputs of earlier runs: <name>.webm / <name>.mp4 and <name>.<rung>.ivf.
+    // Leftovers of interrupted jobs are removed.
+    std::set<std::string> laddered;
+    std::size_t found = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (fs::directory_iterator it(mezzanine_dir_, ec), end; !ec && it != end; it.increment(ec)) {
+            const fs::path& p = it->path();
+            std::error_code rm_ec;
+            if (p.extension() == ".tmp") {
+                fs::remove(p, rm_ec);
+                continue;
+            }
+            const std::string stem = p.stem().string();
+            if (p.extension() == ".ivf") {
+                for (const auto& rung : ladder_) {
+                    const std::string suffix = "." + rung.name;
+                    if (stem.size() > suffix.size() && stem.compare(stem.size() - suffix.size(), suffix.size(), suffix) == 0) {
+                        laddered.insert(stem.substr(0, stem.size() - suffix.size()));
+                    }
+                }
+                continue;
+            }
+            if (p.extension() != ".webm" && p.extension() != ".mp4") continue;
+            const std::string source = directory_ + "/" + stem;
+            if (!is_fresh(source, p.string())) continue;
+            renditions_[source].normalized = p.string();
+            ++found;
+        }
+
+        // A ladder counts only when every configured rung is there.
+        for (const auto& name : laddered) {
+            const std::string source = directory_ + "/" + name;
+            std::vector<std::string> rungs;
+            for (const auto& rung : ladder_) rungs.push_back(ladderPath(name, rung));
+            if (!all_fresh(source, rungs)) continue;
+            renditions_[source].ladder = std::move(rungs);
+            ++found;
+        }
+    }
+    std::cout << "[TRANSCODE] " << found << " rendition(s) in " << mezzanine_dir_
+        << ", " << config_.workers << " worker(s), ladder of " << ladder_.size() << std::endl;
+
+    for (std::size_t i = 0; i < std::max<std::size_t>(config_.workers, 1); ++i) {
+        workers_.emplace_back(&Transcoder::workerLoop, this);
+    }
+}
+
+void Transcoder::enqueue(const std::string& file_path, TranscodePriority priority) {
+    static auto& depth = Metrics::instance().gauge("transcode_queue_depth");
+
+    if (!config_.enabled) return;
+    // Outputs are named by basename, so only files directly in directory_
+    // can have one; a file still being uploaded is queued when it is done.
+    if (file_path != directory_ + "/" + fs::path(file_path).filename().string()) return;
+    if (IngestRegistry::instance().find(file_path)) return;
+    const int64_t mtime = mtime_of(file_path);
+    if (mtime < 0) return;
+
+    TranscodeProgress p;
+    p.file_path = file_path;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_ || running_.count(file_path) || satisfiedLocked(file_path)) return;
+
+        auto s = settled_.find(file_path);
+        if (s != settled_.end()) {
+            if (s->second == mtime) return;
+            settled_.erase(s);
+        }
+
+        auto q = pending_.find(file_path);
+        if (q != pending_.end() && q->second >= priority) return;
+        const bool fresh = q == pending_.end();
+        pending_[file_path] = priority;
+        // A raised priority leaves the old heap entry behind; the worker
+        // discards it because it no longer matches pending_.
+        queue_.push(Job{ priority, next_seq_++, file_path });
+        depth.set(static_cast<double>(pending_.size()));
+        if (!fresh) return;
+    }
+    cv_.notify_one();
+    report(p);
+}
+
+std::string Transcoder::preferred(const std::string& file_path) const {
+    std::string rendition;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = renditions_.find(file_path);
+        if (it == renditions_.end() || it->second.normalized.empty()) return file_path;
+        rendition = it->second.normalized;
+    }
+    return is_fresh(file_path, rendition) ? rendition : file_path;
+}
+
+std::vector<std::string> Transcoder::ladder(const std::string& file_path) const {
+    std::vector<std::string> rungs;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = renditions_.find(file_path);
+        if (it == renditions_.end() || it->second.ladder.empty() || it->second.ladder.size() != ladder_.size()) return {};
+        rungs = it->second.ladder;
+    }
+    return all_fresh(file_path, rungs) ? rungs : std::vector<std::string>{};
+}
+
+bool Transcoder::satisfiedLocked(const std::string& file_path) const {
+    auto it = renditions_.find(file_path);
+    if (it == renditions_.end()) return false;
+    const Rendition& r = it->second;
+    if (!r.normalized.empty() && !is_fresh(file_path, r.normalized)) return false;
+    if (ladder_.empty()) return !r.normalized.empty();
+    return r.ladder.size() == ladder_.size() && all_fresh(file_path, r.ladder);
+}
+
+std::string Transcoder::ladderPath(const std::string& name, const VideoLayer& rung) const {
+    return mezzanine_dir_ + "/" + name + "." + rung.name + ".ivf";
+}
+
+void Transcoder::workerLoop() {
+    static auto& depth = Metrics::instance().gauge("transcode_queue_depth");
+
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (stopping_) return;
+            job = queue_.top();
+            queue_.pop();
+            auto it = pending_.find(job.file_path);
+            if (it == pending_.end() || it->second != job.priority) continue; // superseded
+            pending_.erase(it);
+            running_.insert(job.file_path);
+            depth.set(static_cast<double>(pending_.size()));
+        }
+
+        const int64_t mtime = mtime_of(job.file_path);
+        Rendition out;
+        const TranscodeProgress::State state = transcode(job.file_path, out);
+        if (stopping_) return; // the .tmp files are cleaned up by the next start()
+
+        static auto& done = Metrics::instance().counter("transcode_jobs_total", "result=\"done\"");
+        static auto& skipped = Metrics::instance().counter("transcode_jobs_total", "result=\"skipped\"");
+        static auto& failed = Metrics::instance().counter("transcode_jobs_total", "result=\"failed\"");
+        (state == TranscodeProgress::State::kDone ? done
+            : state == TranscodeProgress::State::kSkipped ? skipped : failed).inc();
+
+        TranscodeProgress p;
+        p.file_path = job.file_path;
+        p.rendition = out.normalized;
+        p.rungs = static_cast<int>(out.ladder.size());
+        p.state = state;
+        p.progress = state == TranscodeProgress::State::kDone ? 1.0 : 0.0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_.erase(job.file_path);
+            if (state == TranscodeProgress::State::kDone) renditions_[job.file_path] = std::move(out);
+            else settled_[job.file_path] = mtime;
+        }
+        report(p);
+    }
+}
+
+TranscodeProgress::State Transcoder::transcode(const std::string& source, Rendition& out) {
+    // Throughput of the running job: media seconds per wall second, and
+    // frames encoded per second. Read these to size `workers`.
+    static auto& speed = Metrics::instance().gauge("transcode_speed_x");
+    static auto& fps_gauge = Metrics::instance().gauge("transcode_fps");
+    static auto& duration_ms = Metrics::instance().histogram("transcode_duration_ms", { 1000, 5000, 30000, 120000, 600000, 1800000 });
+
+    using Clock = std::chrono::steady_clock;
+    const auto t0 = Clock::now();
+    const std::string name = fs::path(source).filename().string();
+
+    // Whatever is still current from an earlier job is kept, not redone.
+    Rendition existing;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = renditions_.find(source);
+        if (it != renditions_.end()) existing = it->second;
+    }
+    if (!existing.normalized.empty() && is_fresh(source, existing.normalized)) out.normalized = existing.normalized;
+    if (!ladder_.empty() && existing.ladder.size() == ladder_.size() && all_fresh(source, existing.ladder)) {
+        out.ladder = existing.ladder;
+    }
+
+    TranscodeContext c;
+    if (avformat_open_input(&c.input, source.c_str(), nullptr, nullptr) < 0) return TranscodeProgress::State::kFailed;
+    if (avformat_find_stream_info(c.input, nullptr) < 0) return TranscodeProgress::State::kFailed;
+    const int stream = av_find_best_stream(c.input, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (stream < 0) return TranscodeProgress::State::kFailed;
+    AVStream* vs = c.input->streams[stream];
+
+    const AVCodec* vp8 = avcodec_find_encoder_by_name("libvpx");
+    const bool normalized = is_normalized(vs, config_);
+    const bool want_mezzanine = !normalized && out.normalized.empty();
+    bool want_ladder = !ladder_.empty() && out.ladder.empty();
+    if (want_ladder && !vp8) {
+        std::cerr << "[TRANSCODE] libvpx is not available, no ladder for " << name << std::endl;
+        want_ladder = false;
+    }
+    if (!want_mezzanine && !want_ladder) {
+        if (normalized) std::cout << "[TRANSCODE] " << name << ": already normalized, streamed as is" << std::endl;
+        return out.normalized.empty() && out.ladder.empty()
+            ? TranscodeProgress::State::kSkipped : TranscodeProgress::State::kDone;
+    }
+
+    const AVCodec* dec = avcodec_find_decoder(vs->codecpar->codec_id);
+    if (!dec) return TranscodeProgress::State::kFailed;
+    c.decoder = avcodec_alloc_context3(dec);
+    avcodec_parameters_to_context(c.decoder, vs->codecpar);
+    c.decoder->thread_count = 0; // auto
+    if (avcodec_open2(c.decoder, dec, nullptr) < 0) return TranscodeProgress::State::kFailed;
+
+    // Output rate and geometry: capped, never raised; even dimensions for 4:2:0.
+    double src_fps = av_q2d(vs->avg_frame_rate);
+    if (src_fps <= 0.0) src_fps = av_q2d(vs->r_frame_rate);
+    const AVRational out_rate = src_fps > 0.0 && src_fps <= config_.max_fps
+        ? av_d2q(src_fps, 1001000) : AVRational{ config_.max_fps, 1 };
+    const double fps = av_q2d(out_rate);
+    const int top_h = std::min(c.decoder->height, config_.max_height) & ~1;
+    const int top_w = c.decoder->height > 0
+        ? static_cast<int>(std::lround(static_cast<double>(c.decoder->width) * top_h / c.decoder->height)) & ~1 : 0;
+    if (top_w < 2 || top_h < 2) return TranscodeProgress::State::kFailed;
+    // Every output shares the frame grid and the GOP, so ladder keyframes
+    // land on the same frames.
+    const int gop = std::max(1, static_cast<int>(std::lround(config_.gop_seconds * fps)));
+
+    std::string mezzanine_path;
+    if (want_mezzanine) {
+        // VP8 first: the codec every WebRTC endpoint decodes, and what the
+        // streamer sends anyway. H.264 constrained baseline where libvpx is not built in.
+        const AVCodec* enc = vp8;
+        const char* muxer = "webm";
+        const char* ext = ".webm";
+        if (!enc) {
+            enc = avcodec_find_encoder_by_name("libx264");
+            muxer = "mp4";
+            ext = ".mp4";
+        }
+        if (!enc) {
+            std::cerr << "[TRANSCODE] Neither libvpx nor libx264 is available" << std::endl;
+            return TranscodeProgress::State::kFailed;
+        }
+        auto o = std::make_unique<Output>();
+        o->path = mezzanine_dir_ + "/" + name + ext;
+        o->tmp = o->path + ".tmp";
+        o->width = top_w;
+        o->height = top_h;
+        c.outputs.push_back(std::move(o));
+        mezzanine_path = c.outputs.back()->path;
+        if (!open_output(*c.outputs.back(), enc, muxer, out_rate, gop,
+            static_cast<int64_t>(config_.bitrate_kbps) * 1000, false)) return c.fail();
+    }
+    const std::size_t first_rung = c.outputs.size();
+    if (want_ladder) {
+        for (const auto& rung : ladder_) {
+            const double down = std::max(1.0, rung.scale_resolution_down_by);
+            auto o = std::make_unique<Output>();
+            o->path = ladderPath(name, rung);
+            o->tmp = o->path + ".tmp";
+            o->width = std::max(2, static_cast<int>(std::lround(top_w / down)) & ~1);
+            o->height = std::max(2, static_cast<int>(std::lround(top_h / down)) & ~1);
+            c.outputs.push_back(std::move(o));
+            if (!open_output(*c.outputs.back(), vp8, "ivf", out_rate, gop, rung.max_bitrate_bps, true)) return c.fail();
+        }
+    }
+
+    double duration = 0.0;
+    if (c.input->duration != AV_NOPTS_VALUE) duration = c.input->duration / static_cast<double>(AV_TIME_BASE);
+    const int64_t start = vs->start_time != AV_NOPTS_VALUE ? vs->start_time : 0;
+    const int64_t max_dup = static_cast<int64_t>(kMaxDuplicateSeconds * fps);
+
+    c.decoded = av_frame_alloc();
+    c.packet = av_packet_alloc();
+    int64_t next_index = 0; // output frame number == pts in 1/fps
+    double media_t = 0.0;
+    auto last_report = t0;
+
+    // CFR: each decoded frame lands on the output slot nearest its timestamp.
+    // Frames that share a slot are dropped; empty slots repeat the previous
+    // frame. Every output gets the same slots.
+    auto place = [&](AVFrame* in) -> bool {
+        const int64_t ts = in->best_effort_timestamp != AV_NOPTS_VALUE ? in->best_effort_timestamp : in->pts;
+        if (ts != AV_NOPTS_VALUE) media_t = std::max(0.0, (ts - start) * av_q2d(vs->time_base));
+        const int64_t slot = std::llround(media_t * fps);
+        const bool started = next_index > 0;
+        if (slot < next_index && started) return true;
+
+        for (int64_t n = 0; started && next_index < slot && n < max_dup; ++n, ++next_index) {
+            for (auto& o : c.outputs) {
+                if (!encode_repeat(*o, next_index)) return false;
+            }
+        }
+        next_index = std::max(next_index, slot);
+        for (auto& o : c.outputs) {
+            if (!encode_scaled(*o, in, next_index)) return false;
+        }
+        ++next_index;
+        return true;
+    };
+
+    auto drain_decoder = [&]() -> bool {
+        int ret;
+        while ((ret = avcodec_receive_frame(c.decoder, c.decoded)) == 0) {
+            const bool ok = place(c.decoded);
+            av_frame_unref(c.decoded);
+            if (!ok) return false;
+        }
+        return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF;
+    };
+
+    TranscodeProgress p;
+    p.file_path = source;
+    p.state = TranscodeProgress::State::kRunning;
+    report(p);
+
+    while (!stopping_) {
+        const int ret = av_read_frame(c.input, c.packet);
+        if (ret < 0) break;
+        bool ok = true;
+        if (c.packet->stream_index == stream) {
+            avcodec_send_packet(c.decoder, c.packet); // a corrupt packet is just skipped
+            ok = drain_decoder();
+        }
+        av_packet_unref(c.packet);
+        if (!ok) return c.fail();
+
+        const auto now = Clock::now();
+        if (now - last_report >= std::chrono::seconds(1)) {
+            const double wall = std::chrono::duration<double>(now - t0).count();
+            p.progress = duration > 0.0 ? std::min(1.0, media_t / duration) : 0.0;
+            p.fps = next_index / wall;
+            speed.set(media_t / wall);
+            fps_gauge.set(p.fps);
+            report(p);
+            last_report = now;
+        }
+    }
+    if (stopping_) return c.fail();
+
+    avcodec_send_packet(c.decoder, nullptr);
+    if (!drain_decoder()) return c.fail();
+    for (auto& o : c.outputs) {
+        if (encode(*o, nullptr) < 0 || av_write_trailer(o->format) < 0) return c.fail();
+        avio_closep(&o->format->pb);
+    }
+    for (auto& o : c.outputs) {
+        std::error_code ec;
+        fs::rename(o->tmp, o->path, ec);
+        if (ec) return c.fail();
+    }
+
+    if (want_mezzanine) out.normalized = mezzanine_path;
+    if (want_ladder) {
+        out.ladder.clear();
+        for (std::size_t i = first_rung; i < c.outputs.size(); ++i) out.ladder.push_back(c.outputs[i]->path);
+    }
+
+    const double wall = std::chrono::duration<double>(Clock::now() - t0).count();
+    duration_ms.observe(wall * 1000.0);
+    std::cout << "[TRANSCODE] " << name << ": " << next_index << " frames @ " << fps << " fps, GOP " << gop;
+    if (want_mezzanine) std::cout << ", " << fs::path(mezzanine_path).filename().string() << " " << top_w << "x" << top_h;
+    if (want_ladder) {
+        std::cout << ", ladder";
+        for (std::size_t i = first_rung; i < c.outputs.size(); ++i) {
+            std::cout << " " << c.outputs[i]->width << "x" << c.outputs[i]->height;
+        }
+    }
+    std::cout << " in " << wall << " s (" << (wall > 0.0 ? media_t / wall : 0.0) << "x realtime, "
+        << (wall > 0.0 ? next_index / wall : 0.0) << " fps)" << std::endl;
+    return TranscodeProgress::State::kDone;
+}
+
+void Transcoder::report(const TranscodeProgress& p) {
+    if (listener_) listener_(p);
+}
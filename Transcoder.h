@@ -0,0 +1,122 @@
+#pragma once
+
+#include "VideoLayers.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct TranscoderConfig {
+    bool enabled = true;
+    std::size_t workers = 1;    // each one keeps the encoder's own threads busy
+    double gop_seconds = 2.0;   // fixed keyframe interval, no scene-cut keyframes
+    int max_fps = 30;
+    int max_height = 1080;
+    int bitrate_kbps = 4000;
+
+    // Offline VP8 ladder, one IVF file per rung, keyframes on the same frames
+    // in every rung. Meant to be EngineConfig::video_layers, so each viewer
+    // layer has a pre-encoded rung. Empty: no ladder.
+    std::vector<VideoLayer> ladder;
+};
+
+// Priority of a queued transcode. A file someone is about to play jumps
+// ahead of fresh uploads.
+enum class TranscodePriority { kLow, kNormal, kHigh };
+
+struct TranscodeProgress {
+    enum class State { kQueued, kRunning, kDone, kSkipped, kFailed };
+
+    std::string file_path;
+    std::string rendition; // set once kDone, if the source needed one
+    int rungs = 0;         // ladder rungs written, once kDone
+    State state = State::kQueued;
+    double progress = 0.0; // 0..1 of the source duration
+    double fps = 0.0;      // frames encoded per wall-clock second
+};
+
+const char* transcodeStateName(TranscodeProgress::State state);
+
+// What a finished job left in the mezzanine directory for one source.
+struct Rendition {
+    std::string normalized;          // empty: the source is streamed as is
+    std::vector<std::string> ladder; // IVF per rung, lowest bitrate first
+};
+
+// Post-upload normalization. Every source that is not already 8-bit 4:2:0
+// VP8/H.264 without B-frames at a constant rate is re-encoded once, off the
+// streaming path, into <directory>/mezzanine: VP8 in WebM (H.264 constrained
+// baseline in MP4 where libvpx is missing), I420, CFR, a fixed GOP, video
+// only. The streamer plays the rendition when there is one, so decode and
+// pixel conversion in CaptureLoop become cheap and seeks land on a keyframe
+// at most gop_seconds back. The same pass writes the ladder, if configured,
+// for pass-through playback. Thread-safe.
+class Transcoder {
+public:
+    Transcoder(std::string directory, TranscoderConfig config);
+    ~Transcoder();
+
+    Transcoder(const Transcoder&) = delete;
+    Transcoder& operator=(const Transcoder&) = delete;
+
+    // Called from worker threads on every state change and about once a
+    // second while running. Set before start().
+    void setProgressListener(std::function<void(const TranscodeProgress&)> listener);
+
+    // Picks up renditions from earlier runs and starts the workers.
+    void start();
+
+    // Queues `file_path` unless it already has a rendition, is not directly
+    // in the uploads directory, or is still being uploaded. Queuing a file
+    // again only ever raises its priority.
+    void enqueue(const std::string& file_path, TranscodePriority priority);
+
+    // The rendition to stream for `file_path`, or `file_path` itself.
+    std::string preferred(const std::string& file_path) const;
+
+    // Rung files for `file_path`, in ladder order, or empty when there is no
+    // complete, current ladder.
+    std::vector<std::string> ladder(const std::string& file_path) const;
+
+private:
+    struct Job {
+        TranscodePriority priority;
+        uint64_t seq; // FIFO within a priority
+        std::string file_path;
+        bool operator<(const Job& o) const {
+            return priority != o.priority ? priority < o.priority : seq > o.seq;
+        }
+    };
+
+    void workerLoop();
+    bool satisfiedLocked(const std::string& file_path) const;
+    std::string ladderPath(const std::string& name, const VideoLayer& rung) const;
+    TranscodeProgress::State transcode(const std::string& source, Rendition& out);
+    void report(const TranscodeProgress& p);
+
+    const std::string directory_;
+    const std::string mezzanine_dir_;
+    const TranscoderConfig config_;
+    std::vector<VideoLayer> ladder_; // config_.ladder, lowest bitrate first
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::priority_queue<Job> queue_;
+    std::map<std::string, TranscodePriority> pending_; // queued, not started
+    std::set<std::string> running_;
+    std::map<std::string, int64_t> settled_;           // skipped or failed, by source mtime
+    std::map<std::string, Rendition> renditions_;      // by source
+    uint64_t next_seq_ = 0;
+
+    std::function<void(const TranscodeProgress&)> listener_;
+    std::atomic<bool> stopping_{ false };
+    std::vector<std::thread> workers_;
+};
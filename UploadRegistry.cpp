@@ -0,0 +1,357 @@
+#include "UploadRegistry.h"
+#include "IngestRegistry.h"
+#include "Metrics.h"
+
+#include <boost/asio/post.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+namespace {
+
+    // Uploads nobody has touched for this long are dropped from the
+    // registry; the partial file stays on disk.
+    constexpr std::chrono::hours kUploadIdleExpiry{ 24 };
+
+    // Read-back size for hashing the received prefix.
+    constexpr std::size_t kHashBlockBytes = 1024 * 1024;
+
+    std::string sanitize_basename(std::string name) {
+
+        auto pos1 = name.find_last_of('/');
+        auto pos2 = name.find_last_of('\\');
+        auto pos = (pos1 == std::string::npos) ? pos2 : (pos2 == std::string::npos ? pos1 : std::max(pos1, pos2));
+        if (pos != std::string::npos) name = name.substr(pos + 1);
+
+        for (char& c : name) {
+            const bool ok = std::isalnum(static_cast<unsigned char>(c)) || c == '.' || c == '_' || c == '-';
+            if (!ok) c = '_';
+        }
+
+        bool any_alnum = false;
+        for (char c : name) if (std::isalnum(static_cast<unsigned char>(c))) { any_alnum = true; break; }
+        if (!any_alnum) name = "upload.bin";
+
+        return name;
+    }
+
+    std::string random_suffix() {
+        static thread_local std::mt19937_64 rng{ std::random_device{}() };
+        std::uniform_int_distribution<uint64_t> dist;
+        std::ostringstream oss;
+        oss << std::hex << dist(rng);
+        return oss.str();
+    }
+
+}
+
+void ByteRangeSet::add(uint64_t begin, uint64_t end) {
+    if (begin >= end) return;
+
+    // Swallow every range that overlaps or touches [begin, end).
+    auto it = ranges_.upper_bound(begin);
+    if (it != ranges_.begin()) {
+        auto prev = std::prev(it);
+        if (prev->second >= begin) it = prev;
+    }
+    while (it != ranges_.end() && it->first <= end) {
+        begin = std::min(begin, it->first);
+        end = std::max(end, it->second);
+        it = ranges_.erase(it);
+    }
+    ranges_.emplace(begin, end);
+}
+
+bool ByteRangeSet::covers(uint64_t begin, uint64_t end) const {
+    if (begin >= end) return true;
+    auto it = ranges_.upper_bound(begin);
+    if (it == ranges_.begin()) return false;
+    --it;
+    return it->first <= begin && it->second >= end;
+}
+
+uint64_t ByteRangeSet::prefix() const {
+    if (ranges_.empty() || ranges_.begin()->first != 0) return 0;
+    return ranges_.begin()->second;
+}
+
+uint64_t ByteRangeSet::total() const {
+    uint64_t n = 0;
+    for (const auto& r : ranges_) n += r.second - r.first;
+    return n;
+}
+
+std::vector<std::pair<uint64_t, uint64_t>> ByteRangeSet::ranges() const {
+    return { ranges_.begin(), ranges_.end() };
+}
+
+// Keeps the upload open for one chunk PUT; the last copy of the file handed
+// out by beginChunk() releases it.
+struct UploadRegistry::ChunkLease {
+    std::weak_ptr<UploadRegistry> registry;
+    std::shared_ptr<Upload> upload;
+    std::shared_ptr<RandomAccessFile> file;
+
+    ~ChunkLease() {
+        if (auto r = registry.lock()) r->endChunk(*upload);
+    }
+};
+
+UploadRegistry::UploadRegistry(std::string directory, bool sha256)
+    : directory_(std::move(directory))
+    , store_(directory_, sha256)
+{
+}
+
+std::string UploadRegistry::makeFilePath(const std::string& name_hint) const {
+    try {
+        std::filesystem::create_directories(directory_);
+    }
+    catch (...) {
+    }
+
+    const std::string client_name = name_hint.empty() ? std::string() : sanitize_basename(name_hint);
+
+    const auto now = std::chrono::system_clock::now().time_since_epoch();
+    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+
+    std::string ext = ".bin";
+    if (!client_name.empty()) {
+        auto dot = client_name.find_last_of('.');
+        if (dot != std::string::npos && dot + 1 < client_name.size()) {
+            ext = client_name.substr(dot);
+            if (ext.size() > 16) ext = ".bin";
+        }
+    }
+
+    return directory_ + "/stream_" + std::to_string(ms) + "_" + random_suffix() + ext;
+}
+
+std::shared_ptr<UploadRegistry::Upload> UploadRegistry::create(const std::string& name_hint, uint64_t size) {
+    auto upload = std::make_shared<Upload>();
+    upload->file_path = makeFilePath(name_hint);
+    upload->size = size;
+    upload->file = std::make_shared<RandomAccessFile>();
+    upload->hasher = std::make_unique<ContentHasher>(store_.sha256());
+
+    if (!upload->file->open(upload->file_path, RandomAccessFile::Mode::kWriteTruncate)) {
+        std::cerr << "[UPLOAD] Cannot create " << upload->file_path << ": " << upload->file->lastError() << std::endl;
+        return nullptr;
+    }
+    if (size > 0 && !upload->file->preallocate(size)) {
+        std::cout << "[UPLOAD] Preallocation skipped: " << upload->file->lastError() << std::endl;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    upload->touched = now;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    expireLocked(now);
+    do {
+        upload->id = random_suffix() + random_suffix();
+    } while (uploads_.count(upload->id));
+    uploads_[upload->id] = upload;
+    // Playable from here on, as far as chunks have arrived in order.
+    IngestRegistry::instance().begin(upload->file_path, size);
+
+    std::cout << "[UPLOAD] Created " << upload->id << " -> " << upload->file_path
+        << " (" << size << " bytes)" << std::endl;
+    return upload;
+}
+
+UploadRegistry::ChunkResult UploadRegistry::beginChunk(const std::string& id, uint64_t offset, uint64_t len,
+    std::shared_ptr<RandomAccessFile>& file) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = uploads_.find(id);
+    if (it == uploads_.end()) return ChunkResult::kUnknown;
+    auto& u = *it->second;
+    if (u.sealed || !u.file) return ChunkResult::kComplete;
+    if (offset > u.size || len > u.size - offset) return ChunkResult::kOutOfRange;
+    u.touched = std::chrono::steady_clock::now();
+    ++u.writers;
+
+    // Aliasing pointer: every copy of `file` keeps the lease alive.
+    auto lease = std::make_shared<ChunkLease>();
+    lease->registry = weak_from_this();
+    lease->upload = it->second;
+    lease->file = u.file;
+    file = std::shared_ptr<RandomAccessFile>(lease, lease->file.get());
+    return ChunkResult::kOk;
+}
+
+void UploadRegistry::endChunk(Upload& u) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    --u.writers;
+}
+
+void UploadRegistry::markReceived(const std::string& id, uint64_t offset, uint64_t len) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = uploads_.find(id);
+    if (it == uploads_.end()) return;
+    auto& u = *it->second;
+    // Once sealed every byte was already counted; a late duplicate write
+    // must not restart hashing under the finalizer.
+    if (u.sealed) return;
+    u.received.add(offset, offset + len);
+    u.touched = std::chrono::steady_clock::now();
+    IngestRegistry::instance().commit(u.file_path, u.received.prefix());
+    scheduleHashLocked(it->second);
+}
+
+void UploadRegistry::scheduleHashLocked(const std::shared_ptr<Upload>& u) {
+    if (u->hashing || u->hash_failed || u->received.prefix() <= u->hashed) return;
+    u->hashing = true;
+    boost::asio::post(fileIoPool(), [self = shared_from_this(), u]() { self->advanceHash(u); });
+}
+
+void UploadRegistry::advanceHash(const std::shared_ptr<Upload>& u) {
+    static thread_local std::vector<char> block;
+    block.resize(kHashBlockBytes);
+
+    uint64_t from, to;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        from = u->hashed;
+        to = u->received.prefix();
+    }
+
+    bool ok = u->reader.isOpen() || u->reader.open(u->file_path, RandomAccessFile::Mode::kRead);
+    // One block per job, so a long backlog does not hold a pool thread
+    // while other uploads wait to write.
+    const uint64_t until = std::min<uint64_t>(to, from + kHashBlockBytes);
+    while (ok && from < until) {
+        const int64_t n = u->reader.readAt(from, block.data(), static_cast<std::size_t>(until - from));
+        if (n <= 0) {
+            ok = false;
+            break;
+        }
+        u->hasher->update(block.data(), static_cast<std::size_t>(n));
+        from += static_cast<uint64_t>(n);
+    }
+    if (!ok) {
+        std::cerr << "[UPLOAD] Hashing " << u->id << " failed at " << from << ": "
+            << RandomAccessFile::lastError() << std::endl;
+    }
+
+    bool ready = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        u->hashed = from;
+        u->hashing = false;
+        if (!ok) u->hash_failed = true;
+        scheduleHashLocked(u);
+        ready = readyToFinalizeLocked(*u);
+    }
+    if (ready) finalize(u);
+}
+
+bool UploadRegistry::readyToFinalizeLocked(Upload& u) {
+    if (!u.sealed || u.finalizing || u.complete || u.hashing) return false;
+    if (u.hashed < u.size && !u.hash_failed) return false;
+    u.finalizing = true;
+    return true;
+}
+
+void UploadRegistry::finalize(const std::shared_ptr<Upload>& u) {
+    static auto& dedup_hits = Metrics::instance().counter("upload_dedup_total", "via=\"content\"");
+    static auto& dedup_bytes = Metrics::instance().counter("upload_dedup_bytes_total");
+
+    std::string key;
+    bool duplicate = false;
+    if (!u->hash_failed) {
+        key = store_.keyFor(u->hasher->finish());
+        duplicate = store_.publish(key, u->file_path);
+    }
+    u->reader.close();
+
+    Status st;
+    std::vector<CompleteCallback> waiters;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        u->complete = true;
+        u->content_key = key;
+        u->deduplicated = duplicate;
+        u->hasher.reset();
+        fill(*u, st);
+        waiters.swap(u->waiters);
+    }
+    IngestRegistry::instance().finish(u->file_path, true);
+
+    if (duplicate) {
+        dedup_hits.inc();
+        dedup_bytes.inc(u->size);
+    }
+    std::cout << "[UPLOAD] Completed " << u->id << " (" << u->size << " bytes"
+        << (key.empty() ? std::string() : ", " + key) << (duplicate ? ", duplicate" : "") << ")" << std::endl;
+    for (auto& done : waiters) done(st);
+}
+
+void UploadRegistry::fill(const Upload& u, Status& out) {
+    out.id = u.id;
+    out.file_path = u.file_path;
+    out.size = u.size;
+    out.received_bytes = u.received.total();
+    out.received = u.received.ranges();
+    out.complete = u.complete;
+    out.content_key = u.content_key;
+    out.deduplicated = u.deduplicated;
+}
+
+bool UploadRegistry::status(const std::string& id, Status& out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = uploads_.find(id);
+    if (it == uploads_.end()) return false;
+    fill(*it->second, out);
+    return true;
+}
+
+UploadRegistry::CompleteResult UploadRegistry::complete(const std::string& id, CompleteCallback done, Status& out) {
+    std::shared_ptr<Upload> upload;
+    std::shared_ptr<RandomAccessFile> file;
+    bool already_complete = false;
+    bool ready = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = uploads_.find(id);
+        if (it == uploads_.end()) return CompleteResult::kUnknown;
+        upload = it->second;
+        auto& u = *upload;
+        fill(u, out);
+        already_complete = u.complete;
+        if (!already_complete) {
+            if (!u.received.covers(0, u.size)) return CompleteResult::kIncomplete;
+            if (u.writers > 0) return CompleteResult::kBusy;
+            u.sealed = true;
+            file = std::move(u.file);
+            u.waiters.push_back(std::move(done));
+            ready = readyToFinalizeLocked(u);
+        }
+    }
+    if (already_complete) {
+        if (done) done(out);
+        return CompleteResult::kOk;
+    }
+    // No writer holds a reference any more, so this closes the file.
+    file.reset();
+    if (ready) {
+        boost::asio::post(fileIoPool(), [self = shared_from_this(), upload]() { self->finalize(upload); });
+    }
+    return CompleteResult::kOk;
+}
+
+void UploadRegistry::expireLocked(std::chrono::steady_clock::time_point now) {
+    for (auto it = uploads_.begin(); it != uploads_.end();) {
+        if (now - it->second->touched > kUploadIdleExpiry) {
+            std::cout << "[UPLOAD] Expired " << it->first << std::endl;
+            if (!it->second->complete) IngestRegistry::instance().finish(it->second->file_path, false);
+            it = uploads_.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "ContentStore.h"
+#include "FileIO.h"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Disjoint, merged [begin, end) byte ranges.
+class ByteRangeSet {
+public:
+    void add(uint64_t begin, uint64_t end);
+    bool covers(uint64_t begin, uint64_t end) const;
+    // End of the contiguous run starting at 0.
+    uint64_t prefix() const;
+    uint64_t total() const;
+    std::vector<std::pair<uint64_t, uint64_t>> ranges() const;
+
+private:
+    std::map<uint64_t, uint64_t> ranges_; // begin -> end
+};
+
+// Chunked uploads: a client creates an upload of known size, PUTs byte
+// ranges at arbitrary offsets (in parallel, over any number of connections,
+// on any io_context) and completes it once every byte has arrived. Shared by
+// every HttpServer; all methods are thread-safe.
+//
+// The body is hashed as it arrives: whenever the contiguous prefix grows, the
+// file I/O pool reads the new bytes back (from the page cache, just written)
+// into the upload's ContentHasher. On completion only the tail is left to
+// hash, and the file is handed to the ContentStore.
+class UploadRegistry : public std::enable_shared_from_this<UploadRegistry> {
+public:
+    struct Status {
+        std::string id;
+        std::string file_path;
+        uint64_t size = 0;
+        uint64_t received_bytes = 0;
+        std::vector<std::pair<uint64_t, uint64_t>> received;
+        bool complete = false;
+        std::string content_key; // empty if the body could not be hashed
+        bool deduplicated = false;
+    };
+
+    using CompleteCallback = std::function<void(const Status&)>;
+
+    struct Upload {
+        std::string id;
+        std::string file_path;
+        uint64_t size = 0;
+
+        // Guarded by the registry mutex. `file` is dropped on completion.
+        std::shared_ptr<RandomAccessFile> file;
+        ByteRangeSet received;
+        int writers = 0;          // chunk PUTs holding the file
+        bool sealed = false;      // complete() accepted; no more chunks
+        bool finalizing = false;
+        bool complete = false;
+        std::string content_key;
+        bool deduplicated = false;
+        std::chrono::steady_clock::time_point touched;
+
+        // Hash state. `hasher` and `reader` belong to the one hash job in
+        // flight (`hashing`), or to the finalizer once hashing is done.
+        std::unique_ptr<ContentHasher> hasher;
+        RandomAccessFile reader;
+        uint64_t hashed = 0;
+        bool hashing = false;
+        bool hash_failed = false;
+
+        std::vector<CompleteCallback> waiters;
+    };
+
+    // `sha256` chooses how the ContentStore keys objects; XXH64 is always
+    // computed.
+    UploadRegistry(std::string directory, bool sha256 = true);
+
+    const std::string& directory() const { return directory_; }
+    ContentStore& store() { return store_; }
+
+    // Reserves a new file under directory(); `name_hint` only contributes the
+    // extension. Returns nullptr if the file cannot be created.
+    std::shared_ptr<Upload> create(const std::string& name_hint, uint64_t size);
+
+    // Validates a PUT of [offset, offset + len) and hands out the file to
+    // write it to. The upload cannot complete while any copy of `file` is
+    // alive, so release it as soon as the chunk is written.
+    enum class ChunkResult { kOk, kUnknown, kComplete, kOutOfRange };
+    ChunkResult beginChunk(const std::string& id, uint64_t offset, uint64_t len,
+        std::shared_ptr<RandomAccessFile>& file);
+
+    // Called after the bytes are on disk.
+    void markReceived(const std::string& id, uint64_t offset, uint64_t len);
+    bool status(const std::string& id, Status& out);
+
+    // Succeeds once every byte has been received and no chunk is still being
+    // written; the upload then stops accepting chunks. On kOk `done` runs
+    // once the hash is final and the file is in the store - on the file I/O
+    // pool, or inline if the upload had already been completed. Otherwise
+    // `out` describes why not.
+    enum class CompleteResult { kOk, kUnknown, kIncomplete, kBusy };
+    CompleteResult complete(const std::string& id, CompleteCallback done, Status& out);
+
+    // Paths for one-shot uploads that bypass the chunked protocol.
+    std::string makeFilePath(const std::string& name_hint) const;
+
+private:
+    struct ChunkLease;
+
+    void endChunk(Upload& u);
+    void scheduleHashLocked(const std::shared_ptr<Upload>& u);
+    void advanceHash(const std::shared_ptr<Upload>& u);
+    bool readyToFinalizeLocked(Upload& u);
+    void finalize(const std::shared_ptr<Upload>& u);
+    void expireLocked(std::chrono::steady_clock::time_point now);
+    static void fill(const Upload& u, Status& out);
+
+    const std::string directory_;
+    ContentStore store_;
+    std::mutex mutex_;
+    std::map<std::string, std::shared_ptr<Upload>> uploads_;
+};
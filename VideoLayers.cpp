@@ -0,0 +1,75 @@
+#include "VideoLayers.h"
+
+#include <algorithm>
+
+namespace {
+
+    constexpr double kUpHeadroom = 1.2;
+    constexpr double kDownThreshold = 0.85;
+    constexpr double kMaxLossForUp = 0.02;
+    constexpr double kLossForDown = 0.10;
+    constexpr int kUpVotesRequired = 2;
+    // Viewer-side symptoms: frames the viewer could not decode/render in
+    // time, or outright stalls, mean the rung is too heavy for it.
+    constexpr double kViewerDropsForDown = 0.15;
+    constexpr double kMaxViewerDropsForUp = 0.02;
+
+}
+
+std::vector<VideoLayer> defaultVideoLayers() {
+    return {
+        { "low", 4.0, 200000 },
+        { "mid", 2.0, 600000 },
+        { "high", 1.0, 2000000 },
+    };
+}
+
+LayerSelector::LayerSelector(std::vector<VideoLayer> layers)
+    : layers_(std::move(layers))
+{
+    std::sort(layers_.begin(), layers_.end(), [](const VideoLayer& a, const VideoLayer& b) {
+        return a.max_bitrate_bps < b.max_bitrate_bps;
+    });
+}
+
+int LayerSelector::initialLayer() const {
+    if (layers_.empty()) return -1;
+    return static_cast<int>(layers_.size()) / 2;
+}
+
+int LayerSelector::select(int current, const PeerStats& stats, int& up_votes) const {
+    if (layers_.empty()) return -1;
+
+    const int top = static_cast<int>(layers_.size()) - 1;
+    current = std::clamp(current < 0 ? initialLayer() : current, 0, top);
+
+    const double available = stats.available_outgoing_bitrate_bps;
+    if (available <= 0.0) return current;
+
+    const bool congested = stats.fraction_lost >= kLossForDown ||
+        available < layers_[current].max_bitrate_bps * kDownThreshold ||
+        stats.viewer_drop_ratio >= kViewerDropsForDown ||
+        stats.viewer_stalls > 0;
+
+    if (congested) {
+        up_votes = 0;
+        int next = current;
+        while (next > 0 && layers_[next].max_bitrate_bps * kDownThreshold > available) --next;
+        if (next == current && current > 0) --next;
+        return next;
+    }
+
+    if (current < top &&
+        stats.fraction_lost <= kMaxLossForUp &&
+        stats.viewer_drop_ratio <= kMaxViewerDropsForUp &&
+        available >= layers_[current + 1].max_bitrate_bps * kUpHeadroom) {
+        if (++up_votes >= kUpVotesRequired) {
+            up_votes = 0;
+            return current + 1;
+        }
+        return current;
+    }
+
+    up_votes = 0;
+    return current;
+}
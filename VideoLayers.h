@@ -0,0 +1,32 @@
+#pragma once
+
+#include "PeerStats.h"
+
+#include <string>
+#include <vector>
+
+// One rung of the server-side layer ladder. Viewers on the same rung end up
+// with identical encoder settings, so in broadcast mode each rung is encoded
+// once no matter how many viewers sit on it.
+struct VideoLayer {
+    std::string name;
+    double scale_resolution_down_by = 1.0;
+    int max_bitrate_bps = 0;
+};
+
+std::vector<VideoLayer> defaultVideoLayers();
+
+class LayerSelector {
+public:
+    explicit LayerSelector(std::vector<VideoLayer> layers);
+
+    const std::vector<VideoLayer>& layers() const { return layers_; }
+    int initialLayer() const;
+
+    // `up_votes` is per-viewer hysteresis state: a viewer only moves up after
+    // kUpVotesRequired consecutive samples with enough headroom.
+    int select(int current, const PeerStats& stats, int& up_votes) const;
+
+private:
+    std::vector<VideoLayer> layers_;
+};
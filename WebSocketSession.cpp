@@ -1,20 +1,29 @@
 #include "WebSocketSession.h"
 #include "SharedState.h"
+#include "Metrics.h"
 
+#include <boost/version.hpp>
 #include <iostream>
 
 WebSocketSession::WebSocketSession(tcp::socket socket,
     std::shared_ptr<SharedState> state,
-    net::io_context& ioc)
+    net::io_context& ioc,
+    WebSocketOptions options,
+    AdmissionController::Ticket ticket)
     : ws_(std::move(socket))
     , state_(std::move(state))
+    , inbound_pool_(std::make_shared<InboundBufferPool>(kInboundPoolSize))
     , strand_(net::make_strand(ioc))
+    , options_(options)
+    , ticket_(std::move(ticket))
 {
 }
 
 void WebSocketSession::run(http::request<http::string_body> req) {
 
-    ws_.set_option(websocket::stream_base::timeout::suggested(beast::role_type::server));
+    auto timeout = websocket::stream_base::timeout::suggested(beast::role_type::server);
+    timeout.handshake_timeout = std::chrono::milliseconds(options_.handshake_timeout_ms);
+    ws_.set_option(timeout);
     ws_.set_option(websocket::stream_base::decorator(
         [](websocket::response_type& res) {
             res.set(http::field::server, "RTCServer");
@@ -22,6 +31,33 @@ void WebSocketSession::run(http::request<http::string_body> req) {
 
     ws_.read_message_max(kMaxIncomingMessageBytes);
 
+    if (options_.deflate) {
+        websocket::permessage_deflate pmd;
+        pmd.server_enable = true;
+        pmd.client_enable = true;
+        pmd.server_max_window_bits = options_.deflate_window_bits;
+        pmd.server_no_context_takeover = options_.deflate_no_context_takeover;
+        pmd.memLevel = options_.deflate_mem_level;
+        pmd.compLevel = options_.deflate_level;
+#if BOOST_VERSION >= 108100
+        pmd.msg_size_threshold = options_.deflate_threshold;
+#endif
+        ws_.set_option(pmd);
+    }
+
+    // ws://host:port/?resume=<token> reattaches to a detached session.
+    const std::string target(req.target());
+    const auto query = target.find('?');
+    const auto key = query == std::string::npos ? std::string::npos : target.find("resume=", query);
+    if (key != std::string::npos) {
+        const auto begin = key + 7;
+        const auto end = target.find('&', begin);
+        std::string token = target.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+        const bool valid = !token.empty() && token.size() <= 64 &&
+            token.find_first_not_of("0123456789abcdef") == std::string::npos;
+        if (valid) resume_token_ = std::move(token);
+    }
+
     ws_.async_accept(
         req,
         net::bind_executor(
@@ -37,13 +73,25 @@ void WebSocketSession::on_accept(beast::error_code ec) {
         return;
     }
 
-    if (state_) state_->join(shared_from_this());
+    if (state_) state_->join(shared_from_this(), resume_token_);
     do_read();
 }
 
 void WebSocketSession::do_read() {
+    if (inbound_pool_->outstanding() >= kMaxInflightMessages) {
+        read_paused_ = true;
+        return;
+    }
+
+    bool fresh = false;
+    reading_ = inbound_pool_->acquire(&fresh);
+    if (fresh) {
+        static auto& allocated = Metrics::instance().counter("ws_inbound_buffers_allocated_total");
+        allocated.inc();
+    }
+
     ws_.async_read(
-        buffer_,
+        reading_->storage(),
         net::bind_executor(
             strand_,
             beast::bind_front_handler(&WebSocketSession::on_read, shared_from_this())
@@ -51,7 +99,9 @@ void WebSocketSession::do_read() {
     );
 }
 
-void WebSocketSession::on_read(beast::error_code ec, std::size_t) {
+void WebSocketSession::on_read(beast::error_code ec, std::size_t bytes_transferred) {
+    InboundBufferPool::Ref msg = std::move(reading_);
+
     if (ec == websocket::error::closed) {
         leave_state_once();
         return;
@@ -63,71 +113,180 @@ void WebSocketSession::on_read(beast::error_code ec, std::size_t) {
         return;
     }
 
-    std::string msg = beast::buffers_to_string(buffer_.data());
-    buffer_.consume(buffer_.size());
+    static auto& messages_in = Metrics::instance().counter("ws_messages_in_total");
+    static auto& bytes_in = Metrics::instance().counter("ws_bytes_in_total");
+    messages_in.inc();
+    bytes_in.inc(bytes_transferred);
 
-  
+    // The next frame goes into another pooled buffer while this one is
+    // dispatched. Both run on strand_, which keeps arrival order; asio
+    // recycles the handler memory, so the common path does not allocate.
     do_read();
 
-    auto self = shared_from_this();
     net::post(
-        ws_.get_executor(),
-        [self, msg = std::move(msg)]() mutable {
+        strand_,
+        [self = shared_from_this(), msg = std::move(msg)]() mutable {
             if (self->state_) {
-                self->state_->send(std::move(msg), self);
+                self->state_->send(msg.view(), self);
+            }
+            msg.reset();
+            if (self->read_paused_ && !self->closing_) {
+                self->read_paused_ = false;
+                self->do_read();
             }
         }
     );
 }
 
 
-void WebSocketSession::send(std::shared_ptr<std::string const> const& msg) {
+WebSocketSession::SendClass WebSocketSession::classify(SignalType type) {
+    switch (type) {
+    case SignalType::kSession:
+    case SignalType::kOffer:
+    case SignalType::kAnswer:
+    case SignalType::kTranscodeDone: // a final state, never superseded
+        return SendClass::kControl;
+    case SignalType::kIceCandidate:
+        return SendClass::kCandidate;
+    default:
+        return SendClass::kStatus;
+    }
+}
+
+void WebSocketSession::send(const SignalingMessage& msg) {
     net::post(
         strand_,
-        [self = shared_from_this(), msg]() {
-            if (self->closing_) return;
-
-    
-            if (self->write_queue_.size() >= kMaxWriteQueue) {
-                std::cerr << "[WS] write queue overflow (" << self->write_queue_.size()
-                    << "), closing session\n";
-                self->do_close(websocket::close_reason(websocket::close_code::try_again_later));
-                return;
-            }
-
-            const bool writing = !self->write_queue_.empty();
-            self->write_queue_.push_back(msg);
-            if (!writing) self->do_write();
+        [self = shared_from_this(), msg = Outgoing{ msg.payload, msg.type, msg.key }]() mutable {
+            self->enqueue(std::move(msg));
         }
     );
 }
 
+void WebSocketSession::send(std::shared_ptr<std::string const> const& msg) {
+    send(SignalingMessage{ SignalType::kUnknown, msg, {} });
+}
+
 void WebSocketSession::send(std::string msg) {
     send(std::make_shared<std::string const>(std::move(msg)));
 }
 
+namespace {
+
+    struct SendMetrics {
+        Metrics::Counter& messages_out;
+        Metrics::Counter& bytes_out;
+        Metrics::Counter& coalesced;
+        Metrics::Counter& dropped_status;
+        Metrics::Counter& dropped_candidate;
+        Metrics::Counter& closed;
+        Metrics::Histogram& queue_bytes;
+    };
+
+    SendMetrics& sendMetrics() {
+        auto& m = Metrics::instance();
+        static SendMetrics s{
+            m.counter("ws_messages_out_total"),
+            m.counter("ws_bytes_out_total"),
+            m.counter("ws_messages_coalesced_total"),
+            m.counter("ws_messages_dropped_total", "class=\"status\""),
+            m.counter("ws_messages_dropped_total", "class=\"candidate\""),
+            m.counter("ws_sessions_closed_backpressure_total"),
+            m.histogram("ws_send_queue_bytes", { 1024, 4096, 16384, 65536, 262144, 1048576, 4194304 }),
+        };
+        return s;
+    }
+
+}
+
+// Runs on strand_.
+void WebSocketSession::enqueue(Outgoing msg) {
+    if (closing_ || !msg.payload) return;
+
+    auto& metrics = sendMetrics();
+    const SendClass cls = classify(msg.type);
+    const std::size_t size = msg.payload->size();
+    auto& status = write_queues_[static_cast<std::size_t>(SendClass::kStatus)];
+
+    // A newer status of the same type and key supersedes the queued one;
+    // only the latest state matters to the viewer. The key keeps, e.g., the
+    // progress of different files apart.
+    if (cls == SendClass::kStatus && msg.type != SignalType::kUnknown) {
+        for (auto& queued : status) {
+            if (queued.type != msg.type || queued.key != msg.key) continue;
+            queued_bytes_ = queued_bytes_ - queued.payload->size() + size;
+            queued = std::move(msg);
+            metrics.coalesced.inc();
+            return;
+        }
+    }
+
+    // Shed status messages oldest-first before refusing anything else.
+    while (queued_bytes_ + size > options_.send_budget_bytes && !status.empty()) {
+        queued_bytes_ -= status.front().payload->size();
+        status.pop_front();
+        metrics.dropped_status.inc();
+    }
+
+    if (queued_bytes_ + size > options_.send_budget_bytes) {
+        if (cls == SendClass::kStatus) {
+            metrics.dropped_status.inc();
+            return;
+        }
+        if (cls == SendClass::kCandidate) {
+            // Losing a trickled candidate costs a path at worst; ICE restart
+            // on resume regenerates them.
+            metrics.dropped_candidate.inc();
+            return;
+        }
+        if (queued_bytes_ + size > options_.send_hard_limit_bytes) {
+            std::cerr << "[WS] send queue at " << queued_bytes_ << " bytes, closing session\n";
+            metrics.closed.inc();
+            do_close(websocket::close_reason(websocket::close_code::try_again_later));
+            return;
+        }
+    }
+
+    queued_bytes_ += size;
+    metrics.queue_bytes.observe(static_cast<double>(queued_bytes_));
+    write_queues_[static_cast<std::size_t>(cls)].push_back(std::move(msg));
+    if (!in_flight_.payload) do_write();
+}
+
 void WebSocketSession::do_write() {
-    if (closing_ || write_queue_.empty()) return;
+    if (closing_) return;
 
-    ws_.text(true);
-    ws_.async_write(
-        net::buffer(*write_queue_.front()),
-        net::bind_executor(
-            strand_,
-            beast::bind_front_handler(&WebSocketSession::on_write, shared_from_this())
-        )
-    );
+    for (auto& queue : write_queues_) {
+        if (queue.empty()) continue;
+        // Off the queue while it is written, so neither coalescing nor
+        // shedding can touch the buffer under the async_write.
+        in_flight_ = std::move(queue.front());
+        queue.pop_front();
+        ws_.text(true);
+        ws_.async_write(
+            net::buffer(*in_flight_.payload),
+            net::bind_executor(
+                strand_,
+                beast::bind_front_handler(&WebSocketSession::on_write, shared_from_this())
+            )
+        );
+        return;
+    }
 }
 
-void WebSocketSession::on_write(beast::error_code ec, std::size_t) {
+void WebSocketSession::on_write(beast::error_code ec, std::size_t bytes_transferred) {
     if (ec) {
         std::cerr << "[WS] write error: " << ec.message() << "\n";
         leave_state_once();
         return;
     }
 
-    if (!write_queue_.empty()) write_queue_.pop_front();
-    if (!write_queue_.empty()) do_write();
+    auto& metrics = sendMetrics();
+    metrics.messages_out.inc();
+    metrics.bytes_out.inc(bytes_transferred);
+
+    if (in_flight_.payload) queued_bytes_ -= in_flight_.payload->size();
+    in_flight_ = Outgoing();
+    do_write();
 }
 
 void WebSocketSession::close() {
@@ -140,8 +299,9 @@ void WebSocketSession::do_close(websocket::close_reason reason) {
     if (closing_) return;
     closing_ = true;
 
-
-    write_queue_.clear();
+    // in_flight_ stays: a pending async_write may still be reading it.
+    for (auto& queue : write_queues_) queue.clear();
+    queued_bytes_ = in_flight_.payload ? in_flight_.payload->size() : 0;
 
     ws_.async_close(
         reason,
@@ -5,6 +5,11 @@
 #include <boost/beast/websocket.hpp>
 #include <boost/beast/http.hpp>
 
+#include "AdmissionController.h"
+#include "InboundBuffer.h"
+#include "SignalingMessage.h"
+
+#include <array>
 #include <deque>
 #include <memory>
 #include <string>
@@ -18,20 +23,48 @@ namespace http = beast::http;
 
 using tcp = net::ip::tcp;
 
+struct WebSocketOptions {
+    int handshake_timeout_ms = 30000;
+
+    // Bytes queued or in flight per session. Past it, status messages are
+    // shed oldest-first, then new candidates are refused; control messages
+    // always get in.
+    std::size_t send_budget_bytes = 512 * 1024;
+    // Only a session this far behind is closed; it is not coming back.
+    std::size_t send_hard_limit_bytes = 4 * 1024 * 1024;
+
+    // permessage-deflate, if the client offers it. SDPs compress well.
+    bool deflate = true;
+    int deflate_window_bits = 15;          // server_max_window_bits, 9..15
+    int deflate_mem_level = 4;             // zlib memLevel 1..9, memory per session
+    int deflate_level = 6;                 // zlib compression level 0..9
+    std::size_t deflate_threshold = 256;   // smaller messages go out uncompressed (Boost 1.81+)
+    bool deflate_no_context_takeover = false;
+};
+
 class WebSocketSession : public std::enable_shared_from_this<WebSocketSession> {
 public:
   
     static constexpr std::size_t kMaxIncomingMessageBytes = 64 * 1024;
 
-   
-    static constexpr std::size_t kMaxWriteQueue = 256;
+    // Write order when several messages are waiting; lower goes first.
+    enum class SendClass : uint8_t { kControl = 0, kCandidate = 1, kStatus = 2 };
+    static SendClass classify(SignalType type);
+
+    // Messages read but not yet dispatched; reading pauses at this depth
+    // until the strand catches up.
+    static constexpr std::size_t kMaxInflightMessages = 8;
+    static constexpr std::size_t kInboundPoolSize = 4;
 
     WebSocketSession(tcp::socket socket,
         std::shared_ptr<SharedState> state,
-        net::io_context& ioc);
+        net::io_context& ioc,
+        WebSocketOptions options = WebSocketOptions(),
+        AdmissionController::Ticket ticket = AdmissionController::Ticket());
 
     void run(http::request<http::string_body> req);
 
+    void send(const SignalingMessage& msg);
     void send(std::shared_ptr<std::string const> const& msg);
     void send(std::string msg);
 
@@ -43,6 +76,13 @@ private:
     void do_read();
     void on_read(beast::error_code ec, std::size_t bytes_transferred);
 
+    struct Outgoing {
+        std::shared_ptr<std::string const> payload;
+        SignalType type = SignalType::kUnknown;
+        std::string key;
+    };
+
+    void enqueue(Outgoing msg);
     void do_write();
     void on_write(beast::error_code ec, std::size_t bytes_transferred);
 
@@ -54,10 +94,17 @@ private:
     websocket::stream<tcp::socket> ws_;
     std::shared_ptr<SharedState> state_;
 
-    beast::flat_buffer buffer_;
+    std::shared_ptr<InboundBufferPool> inbound_pool_;
+    InboundBufferPool::Ref reading_;
+    bool read_paused_{ false };
 
     net::strand<net::io_context::executor_type> strand_;
-    std::deque<std::shared_ptr<std::string const>> write_queue_;
+    WebSocketOptions options_;
+    std::array<std::deque<Outgoing>, 3> write_queues_;
+    std::size_t queued_bytes_{ 0 }; // includes the message being written
+    Outgoing in_flight_;
 
     bool closing_{ false };
+    AdmissionController::Ticket ticket_;
+    std::string resume_token_;
 };
@@ -21,11 +21,45 @@ const uploadInfo = document.getElementById("uploadInfo");
 let ws = null;
 let pc = null;
 let dataChannel = null;
+let controlChannel = null;
+
+// With the server's control channel enabled, signaling moves onto it once it
+// opens; set this to also close the WebSocket at that point.
+const PARK_WS_ON_CONTROL = true;
+
+// Session resumption: the server hands out a token on join; if the WebSocket
+// drops without us asking, reconnect with it and keep the same peer connection.
+let resumeToken = null;
+let clientId = null;
+let wsClosedByUser = false;
+let reconnectTimer = null;
+let reconnectAttempts = 0;
+let reconnectStartedAt = 0;
 let remoteStream = null;
 
 
 let pendingRemoteCandidates = [];
 
+// Binary data channel frames; see ChannelProtocol.h for the wire layouts.
+const SYNC_FRAME = 1;
+const PING_FRAME = 2;
+const PONG_FRAME = 3;
+let lastSync = null;
+
+// Clock exchange with the server: a short burst on open, then a slow cadence.
+// The estimate is taken from the lowest-RTT sample of the recent window,
+// which is the one least skewed by queueing.
+const CLOCK_WINDOW = 8;
+const CLOCK_BURST = 5;
+let clockSamples = [];
+let clock = { offsetMs: 0, rttMs: 0 };
+let pingSeq = 0;
+let pingTimer = null;
+
+// Receive-to-render delay from inbound-rtp stats, averaged over the last poll.
+let renderDelayMs = 0;
+let lastJitterStats = null;
+
 function log(msg) {
     const line = `[${new Date().toLocaleTimeString()}] ${msg}`;
     console.log(line);
@@ -47,7 +81,27 @@ function setRtcState(state) {
 
 function wsUrl() {
     const proto = location.protocol === "https:" ? "wss" : "ws";
-    return `${proto}://${location.hostname}:8080`;
+    const base = `${proto}://${location.hostname}:8080/`;
+    return resumeToken ? base + "?resume=" + resumeToken : base;
+}
+
+function scheduleReconnect() {
+    if (reconnectTimer || wsClosedByUser || !resumeToken) return;
+    if (!reconnectStartedAt) reconnectStartedAt = performance.now();
+    const delay = Math.min(5000, 250 * 2 ** reconnectAttempts++);
+    log("WS reconnect in " + delay + " ms");
+    reconnectTimer = setTimeout(() => {
+        reconnectTimer = null;
+        connectWS();
+    }, delay);
+}
+
+function reportReconnected() {
+    if (!reconnectStartedAt) return;
+    const latencyMs = Math.round(performance.now() - reconnectStartedAt);
+    reconnectStartedAt = 0;
+    log("Reconnected in " + latencyMs + " ms");
+    sendSignal({ type: "reconnected", latency_ms: latencyMs });
 }
 
 
@@ -57,12 +111,14 @@ function connectWS() {
         return;
     }
 
+    wsClosedByUser = false;
     setWsState("connecting");
     ws = new WebSocket(wsUrl());
 
     ws.onopen = () => {
         setWsState("connected");
         log("WS connected: " + wsUrl());
+        reconnectAttempts = 0;
     };
 
     ws.onmessage = async (ev) => {
@@ -81,6 +137,7 @@ function connectWS() {
     ws.onclose = () => {
         setWsState("disconnected");
         log("WS closed");
+        if (!controlOpen()) scheduleReconnect();
     };
 
     ws.onerror = (e) => {
@@ -90,7 +147,51 @@ function connectWS() {
     };
 }
 
+function controlOpen() {
+    return controlChannel && controlChannel.readyState === "open";
+}
+
+function signalingReady() {
+    return controlOpen() || (ws && ws.readyState === WebSocket.OPEN);
+}
+
+function sendSignal(obj) {
+    const text = JSON.stringify(obj);
+    if (controlOpen()) controlChannel.send(text);
+    else if (ws && ws.readyState === WebSocket.OPEN) ws.send(text);
+    else return false;
+    return true;
+}
+
+function setupControlChannel(channel) {
+    controlChannel = channel;
+    channel.onopen = () => {
+        log("Control channel open, signaling moves to the peer connection");
+        if (PARK_WS_ON_CONTROL && ws) {
+            log("Parking WebSocket");
+            disconnectWS();
+        }
+    };
+    channel.onclose = () => {
+        log("Control channel closed");
+        if (controlChannel === channel) controlChannel = null;
+    };
+    channel.onmessage = async (e) => {
+        let msg;
+        try { msg = JSON.parse(e.data); }
+        catch { log("CTRL non-JSON: " + e.data); return; }
+        try {
+            await handleSignal(msg);
+        } catch (err) {
+            log("handleSignal error: " + (err?.message || err));
+        }
+    };
+}
+
 function disconnectWS() {
+    wsClosedByUser = true;
+    if (reconnectTimer) clearTimeout(reconnectTimer);
+    reconnectTimer = null;
     try { if (ws) ws.close(); } catch { }
     ws = null;
     setWsState("disconnected");
@@ -165,7 +266,7 @@ function createPeerConnection() {
             log("ICE gathering complete (browser)");
             return;
         }
-        if (!ws || ws.readyState !== WebSocket.OPEN) return;
+        if (!signalingReady()) return;
 
         const payload = {
             type: "ice_candidate",
@@ -175,7 +276,7 @@ function createPeerConnection() {
         };
 
         log("ICE -> server: " + payload.candidate.slice(0, 60) + "...");
-        ws.send(JSON.stringify(payload));
+        sendSignal(payload);
     };
 
     pc.onicegatheringstatechange = () => {
@@ -184,6 +285,12 @@ function createPeerConnection() {
 
     pc.oniceconnectionstatechange = () => {
         log("ICE connection state: " + pc.iceConnectionState);
+        const st = pc.iceConnectionState;
+        if (st === "connected" || st === "completed") reportReconnected();
+        if (st === "failed" && signalingReady()) {
+            if (!reconnectStartedAt) reconnectStartedAt = performance.now();
+            sendSignal({ type: "restart_ice" });
+        }
     };
 
     pc.onconnectionstatechange = () => {
@@ -194,17 +301,237 @@ function createPeerConnection() {
     };
 
     pc.ondatachannel = (ev) => {
+        if (ev.channel.label === "control") {
+            setupControlChannel(ev.channel);
+            return;
+        }
         dataChannel = ev.channel;
         log("DataChannel received: " + dataChannel.label);
-        dataChannel.onopen = () => log("DC open: " + dataChannel.label);
-        dataChannel.onclose = () => log("DC closed: " + dataChannel.label);
-        dataChannel.onmessage = (e) => log("DC msg: " + e.data);
+        dataChannel.onopen = () => {
+            log("DC open: " + dataChannel.label);
+            startClockSync();
+        };
+        dataChannel.onclose = () => {
+            log("DC closed: " + dataChannel.label);
+            stopClockSync();
+        };
+        dataChannel.binaryType = "arraybuffer";
+        lastSync = null;
+        dataChannel.onmessage = (e) => {
+            if (typeof e.data === "string") {
+                log("DC msg: " + e.data);
+                return;
+            }
+            handleChannelFrame(new DataView(e.data));
+        };
+    };
+}
+
+function handleChannelFrame(view) {
+    if (view.byteLength < 1) return;
+    switch (view.getUint8(0)) {
+        case SYNC_FRAME: {
+            if (view.byteLength < 24) return;
+            const seq = view.getUint32(4, true);
+            // The channel may be unordered; a stale frame must not rewind us.
+            if (lastSync && seq <= lastSync.seq) return;
+            lastSync = {
+                seq,
+                playing: (view.getUint8(1) & 1) !== 0,
+                playoutTargetMs: view.getUint16(2, true),
+                mediaTime: view.getFloat64(8, true),
+                serverTimeMs: Number(view.getBigInt64(16, true)) / 1000,
+                receivedAt: performance.now()
+            };
+            applyPlayoutTarget(lastSync.playoutTargetMs);
+            break;
+        }
+        case PONG_FRAME: {
+            if (view.byteLength < 32) return;
+            const t3 = clientNowUs();
+            const t0 = Number(view.getBigInt64(8, true));
+            const t1 = Number(view.getBigInt64(16, true));
+            const t2 = Number(view.getBigInt64(24, true));
+            addClockSample(((t1 - t0) + (t2 - t3)) / 2000, ((t3 - t0) - (t2 - t1)) / 1000);
+            break;
+        }
+        default:
+            log("DC frame of unknown type " + view.getUint8(0));
+    }
+}
+
+function clientNowUs() {
+    return Math.round((performance.timeOrigin + performance.now()) * 1000);
+}
+
+function addClockSample(offsetMs, rttMs) {
+    if (rttMs < 0) return;
+    clockSamples.push({ offsetMs, rttMs });
+    if (clockSamples.length > CLOCK_WINDOW) clockSamples.shift();
+    let best = clockSamples[0];
+    for (const c of clockSamples) if (c.rttMs < best.rttMs) best = c;
+    clock = { offsetMs: best.offsetMs, rttMs: best.rttMs };
+}
+
+function sendPing() {
+    if (!dataChannel || dataChannel.readyState !== "open") return;
+    const view = new DataView(new ArrayBuffer(32));
+    view.setUint8(0, PING_FRAME);
+    view.setUint32(4, ++pingSeq, true);
+    view.setBigInt64(8, BigInt(clientNowUs()), true);
+    // Report the current estimate so the server can track per-viewer sync error.
+    view.setBigInt64(16, BigInt(Math.round(clock.offsetMs * 1000)), true);
+    view.setUint32(24, clockSamples.length ? Math.max(1, Math.round(clock.rttMs * 1000)) : 0, true);
+    view.setUint32(28, Math.round(renderDelayMs * 1000), true);
+    dataChannel.send(view.buffer);
+}
+
+// The server publishes a capture-to-render target for the whole room; our
+// share of it is whatever our one-way delay leaves for the jitter buffer.
+function applyPlayoutTarget(targetMs) {
+    if (!pc || !targetMs || !clockSamples.length) return;
+    const jitterMs = Math.max(0, targetMs - clock.rttMs / 2);
+    for (const r of pc.getReceivers()) {
+        if (!r.track || r.track.kind !== "video") continue;
+        if ("jitterBufferTarget" in r) r.jitterBufferTarget = jitterMs;
+        else if ("playoutDelayHint" in r) r.playoutDelayHint = jitterMs / 1000;
+    }
+}
+
+// Viewer telemetry: counters since the previous report, sent every
+// TELEMETRY_INTERVAL_MS. The same poll refreshes renderDelayMs for pings.
+const TELEMETRY_FRAME = 4;
+const TELEMETRY_INTERVAL_MS = 2000;
+let telemetryTimer = null;
+let telemetrySeq = 0;
+let lastTelemetryAt = 0;
+let stallStartedAt = 0;
+let stallCount = 0;
+let stallMs = 0;
+
+video.addEventListener("waiting", () => {
+    if (stallStartedAt) return;
+    stallStartedAt = performance.now();
+    stallCount++;
+});
+video.addEventListener("playing", () => {
+    if (!stallStartedAt) return;
+    stallMs += performance.now() - stallStartedAt;
+    stallStartedAt = 0;
+});
+
+async function pollViewerStats() {
+    if (!pc) return;
+    let cur = null;
+    try {
+        const report = await pc.getStats();
+        report.forEach((st) => {
+            if (st.type !== "inbound-rtp" || st.kind !== "video") return;
+            cur = {
+                jitter: st.jitterBufferDelay || 0,
+                emitted: st.jitterBufferEmittedCount || 0,
+                decode: st.totalDecodeTime || 0,
+                decoded: st.framesDecoded || 0,
+                dropped: st.framesDropped || 0
+            };
+        });
+    } catch { }
+    if (!cur) return;
+
+    const prev = lastJitterStats;
+    lastJitterStats = cur;
+    const now = performance.now();
+    const intervalMs = lastTelemetryAt ? now - lastTelemetryAt : 0;
+    lastTelemetryAt = now;
+    if (!prev) return;
+
+    let jitterMs = 0;
+    if (cur.emitted > prev.emitted) {
+        jitterMs = 1000 * (cur.jitter - prev.jitter) / (cur.emitted - prev.emitted);
+        let ms = jitterMs;
+        if (cur.decoded > prev.decoded) ms += 1000 * (cur.decode - prev.decode) / (cur.decoded - prev.decoded);
+        renderDelayMs = ms;
+    }
+
+    if (stallStartedAt) {
+        stallMs += now - stallStartedAt;
+        stallStartedAt = now;
+    }
+
+    if (!dataChannel || dataChannel.readyState !== "open") return;
+    const view = new DataView(new ArrayBuffer(40));
+    view.setUint8(0, TELEMETRY_FRAME);
+    view.setUint8(1, stallStartedAt ? 1 : 0);
+    view.setUint32(4, ++telemetrySeq, true);
+    view.setUint32(8, Math.round(intervalMs), true);
+    view.setUint32(12, Math.max(0, cur.decoded - prev.decoded), true);
+    view.setUint32(16, Math.max(0, cur.dropped - prev.dropped), true);
+    view.setUint32(20, Math.round(jitterMs * 1000), true);
+    view.setFloat64(24, expectedMediaTime() ?? video.currentTime, true);
+    view.setUint32(32, stallCount, true);
+    view.setUint32(36, Math.round(stallMs), true);
+    dataChannel.send(view.buffer);
+    stallCount = 0;
+    stallMs = 0;
+}
+
+function startClockSync() {
+    stopClockSync();
+    clockSamples = [];
+    clock = { offsetMs: 0, rttMs: 0 };
+    let burst = 0;
+    renderDelayMs = 0;
+    lastJitterStats = null;
+    lastTelemetryAt = 0;
+    stallCount = 0;
+    stallMs = 0;
+    const tick = () => {
+        sendPing();
+        pingTimer = setTimeout(tick, ++burst < CLOCK_BURST ? 200 : 2000);
     };
+    tick();
+    pollViewerStats();
+    telemetryTimer = setInterval(pollViewerStats, TELEMETRY_INTERVAL_MS);
+}
+
+function stopClockSync() {
+    if (pingTimer) clearTimeout(pingTimer);
+    pingTimer = null;
+    if (telemetryTimer) clearInterval(telemetryTimer);
+    telemetryTimer = null;
+}
+
+// Media time the server is presenting right now, on the server's clock.
+function expectedMediaTime() {
+    if (!lastSync) return null;
+    if (!lastSync.playing) return lastSync.mediaTime;
+    const serverNowMs = clientNowUs() / 1000 + clock.offsetMs;
+    return lastSync.mediaTime + (serverNowMs - lastSync.serverTimeMs) / 1000;
 }
 
 
 async function handleSignal(msg) {
     switch (msg.type) {
+        case "session": {
+            const wasResume = !!resumeToken && msg.resume_token === resumeToken;
+            resumeToken = msg.resume_token;
+            clientId = msg.client_id;
+            log("Session " + clientId + (msg.resumed ? " resumed" : " started"));
+            if (msg.resumed && wasResume) {
+                const st = pc ? pc.iceConnectionState : "closed";
+                // The server restarts ICE itself when its side is broken; ask
+                // when only ours is.
+                if (st === "connected" || st === "completed") reportReconnected();
+                else if (st === "failed" || st === "disconnected") sendSignal({ type: "restart_ice" });
+            } else if (!msg.resumed && pc) {
+                // Resume window expired: the server-side peer is gone.
+                try { pc.close(); } catch { }
+                pc = null;
+                reconnectStartedAt = 0;
+            }
+            break;
+        }
+
         case "offer": {
             log("SIG offer (sdp len=" + (msg.sdp ? msg.sdp.length : 0) + ")");
             if (!pc) createPeerConnection();
@@ -216,9 +543,7 @@ async function handleSignal(msg) {
             await pc.setLocalDescription(answer);
 
          
-            if (ws && ws.readyState === WebSocket.OPEN) {
-                ws.send(JSON.stringify({ type: "answer", sdp: pc.localDescription.sdp }));
-            }
+            sendSignal({ type: "answer", sdp: pc.localDescription.sdp });
 
             
             await flushPendingRemoteCandidates();
@@ -260,13 +585,26 @@ async function handleSignal(msg) {
             break;
         }
 
+        case "transcode_progress": {
+            const note = msg.state === "queued" ? "в очереди" : `перекодирование ${msg.percent}%, ${msg.fps} fps`;
+            setTranscodeNote(msg.file_path, note);
+            break;
+        }
+
+        case "transcode_done": {
+            log(`Transcode ${msg.state}: ${msg.file_path}` + (msg.rendition ? " -> " + msg.rendition : "")
+                + (msg.rungs ? `, ${msg.rungs} ladder rungs` : ""));
+            setTranscodeNote(msg.file_path, msg.state === "done" ? "оптимизирован" : "");
+            break;
+        }
+
         default:
             log("SIG unknown type: " + msg.type);
     }
 }
 
 function startStream() {
-    if (!ws || ws.readyState !== WebSocket.OPEN) {
+    if (!signalingReady()) {
         log("Нужно сначала Connect (WS).");
         return;
     }
@@ -278,15 +616,16 @@ function startStream() {
         return;
     }
 
-    ws.send(JSON.stringify({ type: "start_stream", file_path: filePath }));
+    sendSignal({ type: "start_stream", file_path: filePath });
     log("CMD start_stream file_path=" + filePath);
 }
 
+function seekStream(seconds) {
+    if (sendSignal({ type: "seek", position: seconds })) log("CMD seek " + seconds + "s");
+}
+
 function stopStream() {
-    if (ws && ws.readyState === WebSocket.OPEN) {
-        ws.send(JSON.stringify({ type: "stop_stream" }));
-        log("CMD stop_stream");
-    }
+    if (sendSignal({ type: "stop_stream" })) log("CMD stop_stream");
 
     if (pc) { try { pc.close(); } catch { } pc = null; }
     setRtcState("idle");
@@ -295,61 +634,227 @@ function stopStream() {
     pendingRemoteCandidates = [];
 }
 
-function addFileOption(filePath) {
-    const label = (filePath || "").split(/[\\/]/).pop();
+// Server-side transcode state per file, shown after the option's label.
+const transcodeNotes = new Map();
+
+function optionText(filePath, label) {
+    const note = transcodeNotes.get(filePath);
+    return note ? `${label} [${note}]` : label;
+}
+
+function addFileOption(filePath, label, select = true) {
+    label = label || (filePath || "").split(/[\\/]/).pop();
 
     for (const opt of fileSelect.options) {
         if (opt.value === filePath) {
-            fileSelect.value = filePath;
+            opt.dataset.label = label;
+            opt.textContent = optionText(filePath, label);
+            if (select) fileSelect.value = filePath;
             return;
         }
     }
 
     const opt = document.createElement("option");
     opt.value = filePath;
-    opt.textContent = label;
+    opt.dataset.label = label;
+    opt.textContent = optionText(filePath, label);
     fileSelect.appendChild(opt);
-    fileSelect.value = filePath;
+    if (select) fileSelect.value = filePath;
 }
 
-function uploadFile() {
-    const file = fileInput.files && fileInput.files[0] ? fileInput.files[0] : null;
-    if (!file) { uploadInfo.textContent = "Файл не выбран."; return; }
+function setTranscodeNote(filePath, note) {
+    if (note) transcodeNotes.set(filePath, note);
+    else transcodeNotes.delete(filePath);
+    for (const opt of fileSelect.options) {
+        if (opt.value === filePath) opt.textContent = optionText(filePath, opt.dataset.label || opt.textContent);
+    }
+}
 
-    progressBar.style.width = "0%";
-    uploadInfo.textContent = `Загрузка: ${file.name} (${Math.round(file.size / 1024 / 1024)} MB)`;
+function formatDuration(seconds) {
+    const s = Math.round(seconds);
+    const m = Math.floor(s / 60);
+    return `${m}:${String(s % 60).padStart(2, "0")}`;
+}
+
+// GET /files is the server's media catalog, served from memory.
+async function refreshFileList() {
+    try {
+        const res = await fetch("/files", { cache: "no-store" });
+        if (!res.ok) return;
+        for (const f of await res.json()) {
+            let label = f.name;
+            if (f.status === "ready") label += ` (${formatDuration(f.duration)}, ${f.width}x${f.height}, ${f.codec})`;
+            else if (f.status === "pending") label += " (анализ...)";
+            addFileOption(f.file_path, label, false);
+        }
+    } catch (e) {
+        log("GET /files failed: " + e.message);
+    }
+}
+
+// Chunked, resumable upload: POST /uploads creates it, chunks are PUT at
+// their offsets UPLOAD_PARALLEL at a time, and POST .../complete finalizes.
+// The upload id is kept per file, so a retry after a failure or a reload
+// only sends what the server does not have yet. A content hash sent with
+// the create request lets the server skip the body entirely when it already
+// stores the same bytes.
+const UPLOAD_PARALLEL = 4;
+const UPLOAD_CHUNK_BYTES = 8 * 1024 * 1024;
+const UPLOAD_CHUNK_RETRIES = 5;
+// Hashing reads the whole file into memory (SubtleCrypto has no streaming
+// digest), so larger files only reuse a hash remembered from an earlier upload.
+const UPLOAD_HASH_MAX_BYTES = 256 * 1024 * 1024;
+
+function uploadResumeKey(file) {
+    return `upload:${file.name}:${file.size}:${file.lastModified}`;
+}
+
+function contentHashKey(file) {
+    return `hash:${file.name}:${file.size}:${file.lastModified}`;
+}
+
+// "sha256=<hex>" for the X-Content-Hash header, or null.
+async function contentHashHint(file) {
+    const known = localStorage.getItem(contentHashKey(file));
+    if (known && known.startsWith("sha256-")) return "sha256=" + known.slice(7);
+
+    if (file.size > UPLOAD_HASH_MAX_BYTES || !(window.crypto && crypto.subtle)) return null;
+    try {
+        const digest = await crypto.subtle.digest("SHA-256", await file.arrayBuffer());
+        return "sha256=" + Array.from(new Uint8Array(digest), (b) => b.toString(16).padStart(2, "0")).join("");
+    } catch (e) {
+        return null;
+    }
+}
 
-    const xhr = new XMLHttpRequest();
-    xhr.open("PUT", "/upload_raw");
-    xhr.setRequestHeader("X-Filename", file.name);
-    xhr.setRequestHeader("Content-Type", "application/octet-stream");
+function rangeCovered(ranges, begin, end) {
+    return ranges.some(([b, e]) => b <= begin && e >= end);
+}
 
-    xhr.upload.onprogress = (e) => {
-        if (e.lengthComputable) {
-            const pct = Math.round((e.loaded / e.total) * 100);
-            progressBar.style.width = pct + "%";
+async function openUpload(file) {
+    const key = uploadResumeKey(file);
+    const savedId = localStorage.getItem(key);
+    if (savedId) {
+        const res = await fetch(`/uploads/${savedId}`, { cache: "no-store" });
+        if (res.ok) {
+            const st = await res.json();
+            return { id: st.upload_id, filePath: st.file_path, chunkSize: UPLOAD_CHUNK_BYTES, received: st.received || [] };
         }
+        localStorage.removeItem(key);
+    }
+
+    const headers = { "X-Filename": file.name, "X-Upload-Length": String(file.size) };
+    const hint = await contentHashHint(file);
+    if (hint) headers["X-Content-Hash"] = hint;
+
+    const res = await fetch("/uploads", { method: "POST", headers });
+    if (!res.ok) throw new Error(`HTTP ${res.status}`);
+    const created = await res.json();
+    if (created.status === "ok") return { finished: created }; // already stored
+    localStorage.setItem(key, created.upload_id);
+    return {
+        id: created.upload_id,
+        filePath: created.file_path,
+        chunkSize: created.chunk_size || UPLOAD_CHUNK_BYTES,
+        received: [],
     };
+}
 
-    xhr.onload = () => {
-        if (xhr.status >= 200 && xhr.status < 300) {
-            progressBar.style.width = "100%";
-            try {
-                const data = JSON.parse(xhr.responseText);
-                const filePath = data.file_path;
-                uploadInfo.textContent = "OK. Сохранено: " + filePath;
-                if (filePath) addFileOption(filePath);
-            } catch {
-                uploadInfo.textContent = "Upload OK, но ответ не JSON.";
-            }
-        } else {
-            uploadInfo.textContent = `Ошибка upload: HTTP ${xhr.status}`;
+async function putChunk(uploadId, file, begin, end) {
+    for (let attempt = 0; ; attempt++) {
+        try {
+            const res = await fetch(`/uploads/${uploadId}?offset=${begin}`, {
+                method: "PUT",
+                headers: { "Content-Type": "application/octet-stream" },
+                body: file.slice(begin, end),
+            });
+            if (res.ok || res.status === 409) return; // 409: already complete
+            if (res.status === 404) throw Object.assign(new Error("upload expired"), { fatal: true });
+            throw new Error(`HTTP ${res.status}`);
+        } catch (e) {
+            if (e.fatal || attempt + 1 >= UPLOAD_CHUNK_RETRIES) throw e;
+            await new Promise((r) => setTimeout(r, Math.min(8000, 500 * 2 ** attempt)));
+        }
+    }
+}
+
+async function completeUpload(uploadId) {
+    for (let attempt = 0; ; attempt++) {
+        const res = await fetch(`/uploads/${uploadId}/complete`, { method: "POST" });
+        const data = await res.json().catch(() => ({}));
+        if (res.ok) return data;
+        // busy: a chunk write is still settling on the server.
+        if (res.status === 409 && data.status === "busy" && attempt < UPLOAD_CHUNK_RETRIES) {
+            await new Promise((r) => setTimeout(r, 200));
+            continue;
+        }
+        throw new Error(`complete: HTTP ${res.status}`);
+    }
+}
+
+async function uploadChunked(file) {
+    const upload = await openUpload(file);
+    if (upload.finished) {
+        log("Upload skipped: the server already has this file");
+        return upload.finished.file_path;
+    }
+    // The server streams a file while it is still arriving, so it can be
+    // started right away; chunks go out in order to keep the front filled.
+    if (upload.filePath) addFileOption(upload.filePath);
+
+    const pending = [];
+    let done = 0;
+    for (let off = 0; off < file.size; off += upload.chunkSize) {
+        const end = Math.min(file.size, off + upload.chunkSize);
+        if (rangeCovered(upload.received, off, end)) done += end - off;
+        else pending.push([off, end]);
+    }
+    if (done > 0) log(`Upload resumed at ${Math.round((done / file.size) * 100)}%`);
+
+    const showProgress = () => {
+        const pct = file.size > 0 ? Math.round((done / file.size) * 100) : 100;
+        progressBar.style.width = pct + "%";
+    };
+    showProgress();
+
+    let next = 0;
+    const worker = async () => {
+        while (next < pending.length) {
+            const [begin, end] = pending[next++];
+            await putChunk(upload.id, file, begin, end);
+            done += end - begin;
+            showProgress();
         }
     };
+    await Promise.all(Array.from({ length: Math.min(UPLOAD_PARALLEL, pending.length) }, worker));
 
-    xhr.onerror = () => { uploadInfo.textContent = "Ошибка сети при upload."; };
+    const data = await completeUpload(upload.id);
+    localStorage.removeItem(uploadResumeKey(file));
+    if (data.content_hash) localStorage.setItem(contentHashKey(file), data.content_hash);
+    if (data.deduplicated) log("Duplicate of a stored file; no extra disk space used");
+    return data.file_path;
+}
+
+async function uploadFile() {
+    const file = fileInput.files && fileInput.files[0] ? fileInput.files[0] : null;
+    if (!file) { uploadInfo.textContent = "Файл не выбран."; return; }
 
-    xhr.send(file); 
+    progressBar.style.width = "0%";
+    uploadInfo.textContent = `Загрузка: ${file.name} (${Math.round(file.size / 1024 / 1024)} MB)`;
+    uploadBtn.disabled = true;
+
+    try {
+        const filePath = await uploadChunked(file);
+        progressBar.style.width = "100%";
+        uploadInfo.textContent = "OK. Сохранено: " + filePath;
+        if (filePath) addFileOption(filePath);
+        refreshFileList();
+    } catch (e) {
+        // The upload id stays saved; pressing Upload again resumes.
+        uploadInfo.textContent = `Ошибка upload: ${e.message}. Повторите — загрузка продолжится.`;
+    } finally {
+        uploadBtn.disabled = false;
+    }
 }
 
 
@@ -368,3 +873,4 @@ fileInput.onchange = () => {
 
 setWsState("disconnected");
 setRtcState("idle");
+refreshFileList();